@@ -0,0 +1,430 @@
+// Microbenchmarks of tinylog hot paths.
+//
+// Usage: tinylog_bench [iterations]
+//
+// Reports per case:
+//   - ns/op      wall time per operation (all threads)
+//   - p50 ~ p999 latency of a single operation
+//   - allocs/op  heap allocations per operation
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tinylog/tinylog.hpp"
+#include "tinylog/tinylog_extra.hpp"
+
+#if defined(TINYLOG_POSIX_API)
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+/*****************************************************************************/
+/* Allocation Counter. */
+
+namespace
+{
+std::atomic<std::uint64_t> allocs(0u);
+}  // namespace
+
+// GCC sees free() of memory from operator new once both are inlined.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t n)
+{
+    allocs.fetch_add(1u, std::memory_order_relaxed);
+    if (auto p = std::malloc(n ? n : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void* operator new[](std::size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#   pragma GCC diagnostic pop
+#endif
+
+namespace
+{
+
+using namespace tinylog;
+using clock_type = std::chrono::steady_clock;
+
+/*****************************************************************************/
+/* Sinks. */
+
+template <class charT>
+class null_sink : public sink::basic_sink<charT>
+{
+public:
+    using string_t = typename sink::basic_sink<charT>::string_t;
+
+    bool is_open() const override final
+    {
+        return true;
+    }
+
+protected:
+    void writing(level /*lvl*/, string_t& msg) override final
+    {
+        bytes_ += msg.size();
+    }
+
+private:
+    std::size_t bytes_ = 0;
+};
+
+// Discard stdout while console sinks run.
+class stdout_silencer
+{
+public:
+    stdout_silencer()
+    {
+#if defined(TINYLOG_POSIX_API)
+        std::fflush(stdout);
+        saved_ = ::dup(STDOUT_FILENO);
+        auto const null_fd = ::open("/dev/null", O_WRONLY);
+        ::dup2(null_fd, STDOUT_FILENO);
+        ::close(null_fd);
+#endif
+    }
+
+    ~stdout_silencer()
+    {
+#if defined(TINYLOG_POSIX_API)
+        std::fflush(stdout);
+        ::dup2(saved_, STDOUT_FILENO);
+        ::close(saved_);
+#endif
+    }
+
+private:
+    int saved_ = -1;
+};
+
+/*****************************************************************************/
+/* Runner. */
+
+struct result
+{
+    double ns_per_op;
+    double p50;
+    double p99;
+    double p999;
+    double allocs_per_op;
+};
+
+double percentile(std::vector<double>& v, double p)
+{
+    if (v.empty())
+    {
+        return 0;
+    }
+    auto const idx = static_cast<std::size_t>(p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + idx, v.end());
+    return v[idx];
+}
+
+void report(char const* name, result const& r)
+{
+    std::printf("%-36s %10.1f %9.0f %9.0f %9.0f %10.2f\n", name
+                , r.ns_per_op, r.p50, r.p99, r.p999, r.allocs_per_op);
+}
+
+// Run op iterations times on each of thread_count threads: a throughput
+// pass, then a pass timing every operation.
+result measure(std::size_t iterations, std::size_t thread_count
+               , std::function<void(std::size_t)> const& op)
+{
+    for (std::size_t i = 0; i != (std::min)(iterations, std::size_t(1000))
+         ; ++i)
+    {
+        op(i);
+    }
+
+    auto run = [&](std::function<void(std::size_t)> const& body)
+               {
+                   std::vector<std::thread> threads;
+                   for (std::size_t t = 0; t != thread_count; ++t)
+                   {
+                       threads.emplace_back(body, t);
+                   }
+                   for (auto& t : threads)
+                   {
+                       t.join();
+                   }
+               };
+
+    result r;
+
+    auto const allocs_beg = allocs.load();
+    auto const beg = clock_type::now();
+    run([&](std::size_t)
+        {
+            for (std::size_t i = 0; i != iterations; ++i)
+            {
+                op(i);
+            }
+        });
+    auto const end = clock_type::now();
+    auto const total_ops = static_cast<double>(iterations * thread_count);
+    r.ns_per_op = std::chrono::duration<double, std::nano>(end - beg).count()
+                  / total_ops;
+    r.allocs_per_op = (allocs.load() - allocs_beg) / total_ops;
+
+    std::vector<std::vector<double>> samples(thread_count);
+    run([&](std::size_t t)
+        {
+            auto& s = samples[t];
+            s.reserve(iterations);
+            for (std::size_t i = 0; i != iterations; ++i)
+            {
+                auto const b = clock_type::now();
+                op(i);
+                auto const e = clock_type::now();
+                s.push_back(std::chrono::duration<double
+                                                  , std::nano>(e - b).count());
+            }
+        });
+
+    std::vector<double> latency;
+    for (auto& s : samples)
+    {
+        latency.insert(latency.end(), s.begin(), s.end());
+    }
+    r.p50  = percentile(latency, 0.50);
+    r.p99  = percentile(latency, 0.99);
+    r.p999 = percentile(latency, 0.999);
+    return r;
+}
+
+void bench(char const* name, std::size_t iterations
+           , std::function<void(std::size_t)> const& op
+           , std::size_t thread_count = 1)
+{
+    report(name, measure(iterations, thread_count, op));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    std::size_t const n = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                   : 100000;
+
+    std::printf("%-36s %10s %9s %9s %9s %10s\n", "case"
+                , "ns/op", "p50", "p99", "p999", "allocs/op");
+
+    //----------------|
+    // Filtered       |
+    //----------------|
+    {
+        auto inst = registry::create_logger("filtered");
+        inst->create_sink<null_sink<char>>();
+        inst->set_level(info);
+        bench("filtered lout(debug)", n * 10, [](std::size_t i)
+              {
+                  dlout("filtered", debug) << "value " << i;
+              });
+    }
+
+    //----------------|
+    // Null Sink      |
+    //----------------|
+    {
+        auto inst = registry::create_logger("null");
+        inst->create_sink<null_sink<char>>();
+        bench("lout -> null_sink", n, [](std::size_t i)
+              {
+                  dlout("null", info) << "value " << i;
+              });
+        bench("lprintf -> null_sink", n, [](std::size_t i)
+              {
+                  dlprintf("null", info, "value %zu", i);
+              });
+        bench("lfmt -> null_sink", n, [](std::size_t i)
+              {
+                  dlfmt("null", info, "value {}", i);
+              });
+
+        for (std::size_t threads : { 1, 4, 16, 64 })
+        {
+            auto const name = "lout -> null_sink, "
+                              + std::to_string(threads) + " threads";
+            bench(name.c_str(), n / threads + 1, [](std::size_t i)
+                  {
+                      dlout("null", info) << "value " << i;
+                  }, threads);
+        }
+    }
+
+    //----------------|
+    // Deferred       |
+    //----------------|
+    {
+        auto inst = registry::create_logger("deferred");
+        inst->create_sink<null_sink<char>>();
+        inst->enable_deferred(16 * 1024 * 1024);
+        bench("lfmt -> null_sink, deferred", n, [](std::size_t i)
+              {
+                  dlfmt("deferred", info, "value {}", i);
+              });
+        inst->flush();
+    }
+
+    //----------------|
+    // Adapter        |
+    //----------------|
+    {
+        auto inst = registry::create_logger("adapter");
+        inst->create_sink<null_sink<wchar_t>>();
+        bench("lout -> wchar_t null_sink", n, [](std::size_t i)
+              {
+                  dlout("adapter", info) << "value " << i;
+              });
+        auto winst = registry::create_logger("wadapter");
+        winst->create_sink<null_sink<char>>();
+        bench("wlout -> char null_sink", n, [](std::size_t i)
+              {
+                  wdlout(L"wadapter", info) << L"value " << i;
+              });
+    }
+
+    //----------------|
+    // File Sink      |
+    //----------------|
+    {
+        auto const file = "tinylog_bench_file.log";
+        auto const u8_file = "tinylog_bench_u8_file.log";
+        auto const binary_file = "tinylog_bench_binary_file.tlog";
+        {
+            auto inst = std::make_shared<logger>();
+            inst->create_sink<sink::file_sink>(file, sink::file_sink::npos
+                                               , std::ios_base::out);
+            bench("lout -> file_sink", n, [&inst](std::size_t i)
+                  {
+                      dlout(inst, info) << "value " << i;
+                  });
+        }
+        {
+            auto inst = std::make_shared<logger>();
+            inst->create_sink<sink::u8_file_sink>(u8_file
+                                                  , sink::u8_file_sink::npos
+                                                  , std::ios_base::out);
+            bench("lout -> u8_file_sink", n, [&inst](std::size_t i)
+                  {
+                      dlout(inst, info) << "value " << i;
+                  });
+        }
+        {
+            auto inst = std::make_shared<logger>();
+            inst->create_sink<sink::file_sink>(file, sink::file_sink::npos
+                                               , std::ios_base::out);
+            bench("lfmt -> file_sink", n, [&inst](std::size_t i)
+                  {
+                      dlfmt(inst, info, "value {} of {:.2f}", i, 0.5);
+                  });
+        }
+        {
+            auto inst = std::make_shared<logger>();
+            inst->create_sink<sink::binary_file_sink>(binary_file
+                                                      , std::ios_base::out);
+            bench("lfmt -> binary_file_sink", n, [&inst](std::size_t i)
+                  {
+                      dlfmt(inst, info, "value {} of {:.2f}", i, 0.5);
+                  });
+        }
+        std::remove(file);
+        std::remove(u8_file);
+        std::remove(binary_file);
+    }
+
+    //----------------|
+    // Console Sink   |
+    //----------------|
+    {
+        auto inst = registry::create_logger("console");
+        auto sk = inst->create_sink<sink::console_sink>();
+        result colored, plain;
+        {
+            stdout_silencer silencer;
+            colored = measure(n, 1, [](std::size_t i)
+                              {
+                                  dlout("console", info) << "value " << i;
+                              });
+#if !defined(TINYLOG_DISABLE_CONSOLE_COLOR)
+            sk->enable_color(false);
+#endif
+            plain = measure(n, 1, [](std::size_t i)
+                            {
+                                dlout("console", info) << "value " << i;
+                            });
+        }
+        report("lout -> console_sink (color)", colored);
+        report("lout -> console_sink (no color)", plain);
+    }
+
+    //----------------|
+    // Hexdump        |
+    //----------------|
+    {
+        struct input
+        {
+            char const* name;
+            std::size_t size;
+            std::size_t iterations;
+        };
+        input const inputs[] = {
+            { "hexdump 64 B", 64, n },
+            { "hexdump 4 KB", 4 * 1024, n / 64 + 1 },
+            { "hexdump 1 MB", 1024 * 1024, n / 16384 + 1 },
+        };
+        for (auto const& in : inputs)
+        {
+            std::string const data(in.size, 'x');
+            bench(in.name, in.iterations, [&data](std::size_t)
+                  {
+                      auto const s = hexdump(data);
+                      (void)s;
+                  });
+        }
+    }
+
+    return 0;
+}
@@ -35,10 +35,22 @@
  * {
  *     auto inst = registry::create_logger();
  *
+ *     // or write sinks on a background thread:
+ *     //   auto inst = registry::create_async_logger(8192
+ *     //                                             , overflow_policy::block);
+ *     //
+ *     // or format lfmt statements on a background thread:
+ *     //   inst->enable_deferred();
+ *
  *     // setup sink:
  *     //   - [w]console_sink
  *     //   - [w]file_sink
  *     //   - [w]u8_file_sink
+ *     //   - [w]buffered_file_sink
+ *     //   - [w]rotating_file_sink
+ *     //   - [w]mmap_file_sink
+ *     //   - [w]binary_file_sink
+ *     //   - [w]sharded_sink
  *     //   - [w]msvc_sink
  *     //
  *     // @see std::make_shared
@@ -50,11 +62,11 @@
  *
  *     // usage:
  *     //   - char
- *     //            |-- lout_<suffix>、lprintf_<suffix>
- *     //            |-- lout(<level>)、lprintf(<level>)
+ *     //            |-- lout_<suffix>、lprintf_<suffix>、lfmt_<suffix>
+ *     //            |-- lout(<level>)、lprintf(<level>)、lfmt(<level>)
  *     //   - wchar_t
- *     //            |-- wlout_<suffix>、lwprintf_<suffix>
- *     //            |-- wlout(<level>)、lwprintf(<level>)
+ *     //            |-- wlout_<suffix>、lwprintf_<suffix>、lwfmt_<suffix>
+ *     //            |-- wlout(<level>)、lwprintf(<level>)、lwfmt(<level>)
  *     //
  *     // suffix: t --> trace
  *     //         d --> debug
@@ -78,6 +90,9 @@
  *     // 4
  *     lprintf(info, "module: %s\n", "pass");
  *     lprintf_if(info, true, "module: %ls\n", "pass");
+ *
+ *     // 5: checked at compile time.
+ *     lfmt_i("module: {}, took {:.3f} ms\n", "pass", 1.5);
  * }
  *
  * ```
@@ -87,17 +102,26 @@
 #define TINYTINYLOG_HPP
 
 #include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <cwchar>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <codecvt>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <limits>
 #include <locale>
+#include <memory>
 #include <iomanip>
 #include <iostream>
 #include <mutex>
@@ -148,8 +172,38 @@
 // #define TINYLOG_DISABLE_CONSOLE_COLOR 1
 
 
+// Log statements below this level are removed at compile time, e.g.
+// -DTINYLOG_MIN_LEVEL=::tinylog::info (default: ::tinylog::trace).
+
+// #define TINYLOG_MIN_LEVEL ::tinylog::info
+
+
+// Clock of record timestamps loggers start with, e.g.
+// -DTINYLOG_CLOCK_SOURCE=::tinylog::clock_source::coarse (default:
+// ::tinylog::clock_source::system).
+//
+// @see clock_source
+
+// #define TINYLOG_CLOCK_SOURCE ::tinylog::clock_source::coarse
+
+
+// Count records and time formatting and sink locking, read by
+// logger::stats() and stats() of sinks. Off by default, stats are zero
+// then (dropped records are counted anyway).
+
+// #define TINYLOG_ENABLE_STATS 1
+
+
 // --- User Customize End ---
 
+#if !defined(TINYLOG_MIN_LEVEL)
+#   define TINYLOG_MIN_LEVEL ::tinylog::trace
+#endif
+
+#if !defined(TINYLOG_CLOCK_SOURCE)
+#   define TINYLOG_CLOCK_SOURCE ::tinylog::clock_source::system
+#endif
+
 #if defined(TINYLOG_USE_SINGLE_THREAD) && defined(TINYLOG_REGISTRY_THREAD_SAFE)
 #   undef TINYLOG_REGISTRY_THREAD_SAFE
 #endif
@@ -163,10 +217,29 @@
 #if defined(TINYLOG_WINDOWS_API)
 #   include <Windows.h>
 #else
+#   include <dirent.h>
+#   include <fcntl.h>
 #   include <unistd.h>
+#   include <sys/mman.h>
 #   include <sys/stat.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define TINYLOG_SSE2
+#   include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) \
+    || defined(_M_X64) || defined(_M_IX86)
+#   define TINYLOG_TSC
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#   else
+#       include <x86intrin.h>
+#   endif
+#endif
+
 #if defined(TINYLOG_USE_HEADER_ONLY) || !defined(TINYLOG_WINDOWS_API)
 #   define TINYLOG_API
 #elif defined(TINYLOG_EXPORTS) || defined(tinylog_EXPORTS)
@@ -193,6 +266,16 @@
 #define TINYLOG_DEFAULT  "_TINYLOG_DEFAULT_"
 #define TINYLOG_DEFAULTW TINYLOG_CRT_WIDE(TINYLOG_DEFAULT)
 
+// Logger name which must be a string literal, call sites identify it by
+// its address instead of comparing it on every statement.
+//
+// e.g.
+//   dlout(TINYLOG_LITERAL("net"), info) << "connected";
+#define TINYLOG_LITERAL(s) ::tinylog::detail::make_literal_name("" s)
+
+#define TINYLOG_DEFAULT_NAME  TINYLOG_LITERAL(TINYLOG_DEFAULT)
+#define TINYLOG_DEFAULT_NAMEW TINYLOG_LITERAL(TINYLOG_DEFAULTW)
+
 #define TINYLOG_LEVEL_TRACE  "TRACE"
 #define TINYLOG_LEVEL_DEBUG  "DEBUG"
 #define TINYLOG_LEVEL_INFO   "INFO"
@@ -215,66 +298,158 @@
 #   define TINYLOG_FUNCTION __FUNCTION__
 #endif // __GNUC__
 
+// Logger of a log statement, resolved once per call site and thread.
+//
+// @see detail::basic_logger_cache
+#define TINYLOG_CALL_SITE_LOGGER(charT, ln, lvl)                           \
+    []() -> ::tinylog::detail::basic_logger_cache<charT>&                  \
+    {                                                                      \
+        static thread_local ::tinylog::detail::basic_logger_cache<charT> c; \
+        return c;                                                          \
+    }().get((ln), (lvl))
+
+// Enter the statement only if it is not filtered, nothing (record, timestamp,
+// stream) is built for a disabled statement.
+#define TINYLOG_FOR_LOGGER(charT, ln, lvl)                                 \
+    for (::tinylog::detail::logger_ref _tl_inst_(                          \
+             ((lvl) >= TINYLOG_MIN_LEVEL)                                  \
+             ? TINYLOG_CALL_SITE_LOGGER(charT, (ln), (lvl)) : nullptr)     \
+         ; _tl_inst_; _tl_inst_ = nullptr)
+
+// Format of [w]lfmt is checked against the arguments at compile time.
+//
+// @see detail::check_format
+#define TINYLOG_FMT_CHECK(charT, fmt, ...)                                 \
+    ::tinylog::detail::fmt_guard<::tinylog::detail::check_format(          \
+        (fmt), decltype(::tinylog::detail::fmt_kinds<charT>(               \
+                            __VA_ARGS__))())>()
+
 // dlout("logger_name", info) << "message" << std::endl;
 #if defined(TINYLOG_CANCEL_VERBOSE)
 
 #   define dlprintf(ln, lvl, fmt, ...)                                  \
-    for (::tinylog::detail::dlprintf_impl _tl_strm_((ln), (lvl))        \
+    TINYLOG_FOR_LOGGER(char, (ln), (lvl))                               \
+    for (::tinylog::detail::dlprintf_impl _tl_strm_(_tl_inst_, (lvl))   \
          ; _tl_strm_; _tl_strm_.flush()) _tl_strm_((fmt), ##__VA_ARGS__)
 
 #   define dlwprintf(ln, lvl, fmt, ...)                                 \
-    for (::tinylog::detail::dlwprintf_impl _tl_strm_((ln), (lvl))       \
+    TINYLOG_FOR_LOGGER(wchar_t, (ln), (lvl))                            \
+    for (::tinylog::detail::dlwprintf_impl _tl_strm_(_tl_inst_, (lvl))  \
          ; _tl_strm_; _tl_strm_.flush()) _tl_strm_((fmt), ##__VA_ARGS__)
 
-#   define dlout(ln, lvl)                                       \
-    for (::tinylog::detail::odlstream _tl_strm_((ln), (lvl))    \
-         ; _tl_strm_; _tl_strm_.flush()) _tl_strm_
+#   define dlout(ln, lvl)                                               \
+    TINYLOG_FOR_LOGGER(char, (ln), (lvl))                               \
+    for (::tinylog::detail::odlstream _tl_strm_(_tl_inst_, (lvl))       \
+         ; _tl_strm_; _tl_strm_.flush()) _tl_strm_.stream()
 
-#   define wdlout(ln, lvl)                                      \
-    for (::tinylog::detail::wodlstream _tl_strm_((ln), (lvl))   \
-         ; _tl_strm_; _tl_strm_.flush()) _tl_strm_
+#   define wdlout(ln, lvl)                                              \
+    TINYLOG_FOR_LOGGER(wchar_t, (ln), (lvl))                            \
+    for (::tinylog::detail::wodlstream _tl_strm_(_tl_inst_, (lvl))      \
+         ; _tl_strm_; _tl_strm_.flush()) _tl_strm_.stream()
+
+#   define dlfmt(ln, lvl, fmt, ...)                                     \
+    TINYLOG_FOR_LOGGER(char, (ln), (lvl))                               \
+    for (static ::tinylog::detail::basic_fmt_site<char> const _tl_site_ \
+         = { (fmt), { nullptr, 0, {} } }                                \
+         ; _tl_inst_; _tl_inst_ = nullptr)                              \
+        ::tinylog::detail::log_format(                                  \
+            _tl_inst_, (lvl), _tl_site_                                 \
+            , TINYLOG_FMT_CHECK(char, fmt, ##__VA_ARGS__), ##__VA_ARGS__)
+
+#   define dlwfmt(ln, lvl, fmt, ...)                                    \
+    TINYLOG_FOR_LOGGER(wchar_t, (ln), (lvl))                            \
+    for (static ::tinylog::detail::basic_fmt_site<wchar_t> const        \
+         _tl_site_ = { (fmt), { nullptr, 0, {} } }                      \
+         ; _tl_inst_; _tl_inst_ = nullptr)                              \
+        ::tinylog::detail::log_format(                                  \
+            _tl_inst_, (lvl), _tl_site_                                 \
+            , TINYLOG_FMT_CHECK(wchar_t, fmt, ##__VA_ARGS__), ##__VA_ARGS__)
 
 #else
 
+// Call site of a verbose statement, the unicode function name is converted
+// once per call site.
+#   define TINYLOG_LOCATION(charT)                                      \
+    for (static ::tinylog::detail::basic_source_location<charT> const   \
+         _tl_loc_ = TINYLOG_LOCATION_INIT_##charT                       \
+         ; _tl_inst_; _tl_inst_ = nullptr)
+
+#   define TINYLOG_LOCATION_INIT_char                                   \
+    { __FILE__, __LINE__, TINYLOG_FUNCTION }
+
+#   define TINYLOG_LOCATION_INIT_wchar_t                                \
+    { TINYLOG_CRT_WIDE(__FILE__), __LINE__                              \
+      , ::tinylog::a2w(TINYLOG_FUNCTION) }
+
 #   define dlprintf(ln, lvl, fmt, ...)                                  \
+    TINYLOG_FOR_LOGGER(char, (ln), (lvl))                               \
+    TINYLOG_LOCATION(char)                                              \
     for (::tinylog::detail::dlprintf_d_impl                             \
-         _tl_strm_((ln), (lvl), __FILE__, __LINE__                      \
-                   , TINYLOG_FUNCTION)                                  \
+         _tl_strm_(_tl_inst_, (lvl), _tl_loc_)                          \
          ; _tl_strm_; _tl_strm_.flush()) _tl_strm_((fmt), ##__VA_ARGS__)
 
 #   define dlwprintf(ln, lvl, fmt, ...)                                 \
+    TINYLOG_FOR_LOGGER(wchar_t, (ln), (lvl))                            \
+    TINYLOG_LOCATION(wchar_t)                                           \
     for (::tinylog::detail::dlwprintf_d_impl                            \
-         _tl_strm_((ln), (lvl), TINYLOG_CRT_WIDE(__FILE__), __LINE__    \
-                   , ::tinylog::a2w(TINYLOG_FUNCTION))                  \
+         _tl_strm_(_tl_inst_, (lvl), _tl_loc_)                          \
          ; _tl_strm_; _tl_strm_.flush()) _tl_strm_((fmt), ##__VA_ARGS__)
 
-#   define dlout(ln, lvl)                               \
-    for (::tinylog::detail::odlstream_d                 \
-         _tl_strm_((ln), (lvl), __FILE__, __LINE__      \
-                   , TINYLOG_FUNCTION)                  \
-         ; _tl_strm_; _tl_strm_.flush()) _tl_strm_
+#   define dlout(ln, lvl)                                               \
+    TINYLOG_FOR_LOGGER(char, (ln), (lvl))                               \
+    TINYLOG_LOCATION(char)                                              \
+    for (::tinylog::detail::odlstream_d                                 \
+         _tl_strm_(_tl_inst_, (lvl), _tl_loc_)                          \
+         ; _tl_strm_; _tl_strm_.flush()) _tl_strm_.stream()
 
 #   define wdlout(ln, lvl)                                              \
+    TINYLOG_FOR_LOGGER(wchar_t, (ln), (lvl))                            \
+    TINYLOG_LOCATION(wchar_t)                                           \
     for (::tinylog::detail::wodlstream_d                                \
-         _tl_strm_((ln), (lvl), TINYLOG_CRT_WIDE(__FILE__), __LINE__    \
-                   , ::tinylog::a2w(TINYLOG_FUNCTION))                  \
-         ; _tl_strm_; _tl_strm_.flush()) _tl_strm_
+         _tl_strm_(_tl_inst_, (lvl), _tl_loc_)                          \
+         ; _tl_strm_; _tl_strm_.flush()) _tl_strm_.stream()
+
+#   define dlfmt(ln, lvl, fmt, ...)                                     \
+    TINYLOG_FOR_LOGGER(char, (ln), (lvl))                               \
+    for (static ::tinylog::detail::basic_fmt_site<char> const _tl_site_ \
+         = { (fmt), TINYLOG_LOCATION_INIT_char }                        \
+         ; _tl_inst_; _tl_inst_ = nullptr)                              \
+        ::tinylog::detail::log_format(                                  \
+            _tl_inst_, (lvl), _tl_site_                                 \
+            , TINYLOG_FMT_CHECK(char, fmt, ##__VA_ARGS__), ##__VA_ARGS__)
+
+#   define dlwfmt(ln, lvl, fmt, ...)                                    \
+    TINYLOG_FOR_LOGGER(wchar_t, (ln), (lvl))                            \
+    for (static ::tinylog::detail::basic_fmt_site<wchar_t> const        \
+         _tl_site_ = { (fmt), TINYLOG_LOCATION_INIT_wchar_t }           \
+         ; _tl_inst_; _tl_inst_ = nullptr)                              \
+        ::tinylog::detail::log_format(                                  \
+            _tl_inst_, (lvl), _tl_site_                                 \
+            , TINYLOG_FMT_CHECK(wchar_t, fmt, ##__VA_ARGS__), ##__VA_ARGS__)
 
 #endif // defined(TINYLOG_CANCEL_VERBOSE)
 
 // lout(info) << "message" << std::endl;
-#define lprintf(lvl, fmt, ...)  dlprintf(TINYLOG_DEFAULT                \
+#define lprintf(lvl, fmt, ...)  dlprintf(TINYLOG_DEFAULT_NAME           \
                                          , (lvl), (fmt), ##__VA_ARGS__)
-#define lwprintf(lvl, fmt, ...) dlwprintf(TINYLOG_DEFAULTW              \
+#define lwprintf(lvl, fmt, ...) dlwprintf(TINYLOG_DEFAULT_NAMEW         \
                                           , (lvl), (fmt), ##__VA_ARGS__)
-#define lout(lvl)  dlout(TINYLOG_DEFAULT, (lvl))
-#define wlout(lvl) wdlout(TINYLOG_DEFAULTW, (lvl))
+#define lfmt(lvl, fmt, ...)  dlfmt(TINYLOG_DEFAULT_NAME                 \
+                                   , (lvl), fmt, ##__VA_ARGS__)
+#define lwfmt(lvl, fmt, ...) dlwfmt(TINYLOG_DEFAULT_NAMEW               \
+                                    , (lvl), fmt, ##__VA_ARGS__)
+#define lout(lvl)  dlout(TINYLOG_DEFAULT_NAME, (lvl))
+#define wlout(lvl) wdlout(TINYLOG_DEFAULT_NAMEW, (lvl))
 
 // dlout_if("logger_name", info, true) << "message" << std::endl;
 #define dlprintf_if(ln, lvl, boolexpr, fmt, ...)  if ((boolexpr))       \
         dlprintf((ln), (lvl), (fmt), ##__VA_ARGS__)
 #define dlwprintf_if(ln, lvl, boolexpr, fmt, ...) if ((boolexpr))       \
         dlwprintf((ln), (lvl), (fmt), ##__VA_ARGS__)
+#define dlfmt_if(ln, lvl, boolexpr, fmt, ...)  if ((boolexpr))          \
+        dlfmt((ln), (lvl), fmt, ##__VA_ARGS__)
+#define dlwfmt_if(ln, lvl, boolexpr, fmt, ...) if ((boolexpr))          \
+        dlwfmt((ln), (lvl), fmt, ##__VA_ARGS__)
 #define dlout_if(ln, lvl, boolexpr)   if ((boolexpr)) dlout((ln), (lvl))
 #define wdlout_if(ln, lvl, boolexpr)  if ((boolexpr)) wdlout((ln), (lvl))
 
@@ -283,37 +458,116 @@
         lprintf((lvl), (fmt), ##__VA_ARGS__)
 #define lwprintf_if(lvl, boolexpr, fmt, ...) if ((boolexpr))    \
         lwprintf((lvl), (fmt), ##__VA_ARGS__)
+#define lfmt_if(lvl, boolexpr, fmt, ...)  if ((boolexpr))       \
+        lfmt((lvl), fmt, ##__VA_ARGS__)
+#define lwfmt_if(lvl, boolexpr, fmt, ...) if ((boolexpr))       \
+        lwfmt((lvl), fmt, ##__VA_ARGS__)
 #define lout_if(lvl, boolexpr)  if ((boolexpr)) lout((lvl))
 #define wlout_if(lvl, boolexpr) if ((boolexpr)) wlout((lvl))
 
+// Sampled statements: suppressed ones build nothing, how many there were
+// is noted before the message of the next one written.
+//
+// @see detail::every_n_sampler
+#define TINYLOG_SAMPLED(charT, ln, lvl, samplerT, ...)                     \
+    TINYLOG_FOR_LOGGER(charT, (ln), (lvl))                                 \
+    for (std::uint64_t _tl_skip_ = [&]() -> ::tinylog::detail::samplerT&  \
+         {                                                                 \
+             static ::tinylog::detail::samplerT s(__VA_ARGS__);            \
+             return s;                                                     \
+         }().pass()                                                        \
+         ; _tl_skip_ != ::tinylog::detail::sampled_out                     \
+         ; _tl_skip_ = ::tinylog::detail::sampled_out)
+
+#define TINYLOG_SAMPLED_NOTE ::tinylog::detail::suppressed_note{ _tl_skip_ }
+
+// dlout_every_n("logger_name", error, 100) << "message" << std::endl;
+#define dlout_every_n(ln, lvl, n)                                      \
+    TINYLOG_SAMPLED(char, (ln), (lvl), every_n_sampler, (n))           \
+    dlout((ln), (lvl)) << TINYLOG_SAMPLED_NOTE
+#define wdlout_every_n(ln, lvl, n)                                     \
+    TINYLOG_SAMPLED(wchar_t, (ln), (lvl), every_n_sampler, (n))        \
+    wdlout((ln), (lvl)) << TINYLOG_SAMPLED_NOTE
+#define dlout_first_n(ln, lvl, n)                                      \
+    TINYLOG_SAMPLED(char, (ln), (lvl), first_n_sampler, (n))           \
+    dlout((ln), (lvl)) << TINYLOG_SAMPLED_NOTE
+#define wdlout_first_n(ln, lvl, n)                                     \
+    TINYLOG_SAMPLED(wchar_t, (ln), (lvl), first_n_sampler, (n))        \
+    wdlout((ln), (lvl)) << TINYLOG_SAMPLED_NOTE
+#define dlout_every_ms(ln, lvl, ms)                                    \
+    TINYLOG_SAMPLED(char, (ln), (lvl), every_ms_sampler, (ms))         \
+    dlout((ln), (lvl)) << TINYLOG_SAMPLED_NOTE
+#define wdlout_every_ms(ln, lvl, ms)                                   \
+    TINYLOG_SAMPLED(wchar_t, (ln), (lvl), every_ms_sampler, (ms))      \
+    wdlout((ln), (lvl)) << TINYLOG_SAMPLED_NOTE
+#define dlout_rate(ln, lvl, per_sec, burst)                            \
+    TINYLOG_SAMPLED(char, (ln), (lvl), rate_sampler, (per_sec), (burst)) \
+    dlout((ln), (lvl)) << TINYLOG_SAMPLED_NOTE
+#define wdlout_rate(ln, lvl, per_sec, burst)                           \
+    TINYLOG_SAMPLED(wchar_t, (ln), (lvl), rate_sampler                 \
+                    , (per_sec), (burst))                              \
+    wdlout((ln), (lvl)) << TINYLOG_SAMPLED_NOTE
+
+// lout_rate(error, 10, 50) << "message" << std::endl;
+#define lout_every_n(lvl, n)    dlout_every_n(TINYLOG_DEFAULT_NAME      \
+                                              , (lvl), (n))
+#define wlout_every_n(lvl, n)   wdlout_every_n(TINYLOG_DEFAULT_NAMEW    \
+                                               , (lvl), (n))
+#define lout_first_n(lvl, n)    dlout_first_n(TINYLOG_DEFAULT_NAME      \
+                                              , (lvl), (n))
+#define wlout_first_n(lvl, n)   wdlout_first_n(TINYLOG_DEFAULT_NAMEW    \
+                                               , (lvl), (n))
+#define lout_every_ms(lvl, ms)  dlout_every_ms(TINYLOG_DEFAULT_NAME     \
+                                               , (lvl), (ms))
+#define wlout_every_ms(lvl, ms) wdlout_every_ms(TINYLOG_DEFAULT_NAMEW   \
+                                                , (lvl), (ms))
+#define lout_rate(lvl, per_sec, burst)  dlout_rate(TINYLOG_DEFAULT_NAME \
+                                                   , (lvl), (per_sec)   \
+                                                   , (burst))
+#define wlout_rate(lvl, per_sec, burst) wdlout_rate(                    \
+                                            TINYLOG_DEFAULT_NAMEW       \
+                                            , (lvl), (per_sec), (burst))
+
 // lout_i << "message" << std::endl;
 #define lprintf_t(fmt, ...)  lprintf(::tinylog::trace, fmt, ##__VA_ARGS__)
 #define lwprintf_t(fmt, ...) lwprintf(::tinylog::trace, fmt, ##__VA_ARGS__)
+#define lfmt_t(fmt, ...)  lfmt(::tinylog::trace, fmt, ##__VA_ARGS__)
+#define lwfmt_t(fmt, ...) lwfmt(::tinylog::trace, fmt, ##__VA_ARGS__)
 #define lout_t  lout(::tinylog::trace)
 #define wlout_t wlout(::tinylog::trace)
 
 #define lprintf_d(fmt, ...)  lprintf(::tinylog::debug, fmt, ##__VA_ARGS__)
 #define lwprintf_d(fmt, ...) lwprintf(::tinylog::debug, fmt, ##__VA_ARGS__)
+#define lfmt_d(fmt, ...)  lfmt(::tinylog::debug, fmt, ##__VA_ARGS__)
+#define lwfmt_d(fmt, ...) lwfmt(::tinylog::debug, fmt, ##__VA_ARGS__)
 #define lout_d  lout(::tinylog::debug)
 #define wlout_d wlout(::tinylog::debug)
 
 #define lprintf_i(fmt, ...)  lprintf(::tinylog::info, fmt, ##__VA_ARGS__)
 #define lwprintf_i(fmt, ...) lwprintf(::tinylog::info, fmt, ##__VA_ARGS__)
+#define lfmt_i(fmt, ...)  lfmt(::tinylog::info, fmt, ##__VA_ARGS__)
+#define lwfmt_i(fmt, ...) lwfmt(::tinylog::info, fmt, ##__VA_ARGS__)
 #define lout_i  lout(::tinylog::info)
 #define wlout_i wlout(::tinylog::info)
 
 #define lprintf_w(fmt, ...)  lprintf(::tinylog::warn, fmt, ##__VA_ARGS__)
 #define lwprintf_w(fmt, ...) lwprintf(::tinylog::warn, fmt, ##__VA_ARGS__)
+#define lfmt_w(fmt, ...)  lfmt(::tinylog::warn, fmt, ##__VA_ARGS__)
+#define lwfmt_w(fmt, ...) lwfmt(::tinylog::warn, fmt, ##__VA_ARGS__)
 #define lout_w  lout(::tinylog::warn)
 #define wlout_w wlout(::tinylog::warn)
 
 #define lprintf_e(fmt, ...)  lprintf(::tinylog::error, fmt, ##__VA_ARGS__)
 #define lwprintf_e(fmt, ...) lwprintf(::tinylog::error, fmt, ##__VA_ARGS__)
+#define lfmt_e(fmt, ...)  lfmt(::tinylog::error, fmt, ##__VA_ARGS__)
+#define lwfmt_e(fmt, ...) lwfmt(::tinylog::error, fmt, ##__VA_ARGS__)
 #define lout_e  lout(::tinylog::error)
 #define wlout_e wlout(::tinylog::error)
 
 #define lprintf_f(fmt, ...)  lprintf(::tinylog::fatal, fmt, ##__VA_ARGS__)
 #define lwprintf_f(fmt, ...) lwprintf(::tinylog::fatal, fmt, ##__VA_ARGS__)
+#define lfmt_f(fmt, ...)  lfmt(::tinylog::fatal, fmt, ##__VA_ARGS__)
+#define lwfmt_f(fmt, ...) lwfmt(::tinylog::fatal, fmt, ##__VA_ARGS__)
 #define lout_f  lout(::tinylog::fatal)
 #define wlout_f wlout(::tinylog::fatal)
 
@@ -322,6 +576,29 @@
 
 namespace tinylog
 {
+
+// Clock of record timestamps, read by the logging thread. Reading it is
+// all the statement pays, the conversion to wall time is done before sinks
+// are called (by the background thread of an async or deferred logger).
+//
+//   system: std::chrono::system_clock.
+//   coarse: CLOCK_REALTIME_COARSE, resolution of a scheduler tick (1~4ms),
+//           the system clock where it is not available.
+//   tsc:    CPU time stamp counter, calibrated against the system clock
+//           (the first conversion waits 1ms to measure its rate).
+//   none:   no timestamp, layouts leave the time out.
+//
+// @attention tsc needs a constant rate counter synchronized across cores
+//            (invariant TSC on x86), a steady clock is read on CPUs
+//            without one.
+enum class clock_source : std::uint8_t
+{
+    system,
+    coarse,
+    tsc,
+    none,
+};
+
 namespace detail
 {
 // Dummy mutex.
@@ -341,18 +618,272 @@ struct time_value
     std::size_t tv_usec;
 };
 
-// Get current time.
-inline time_value curr_time()
+inline time_value to_time_value(std::chrono::system_clock::duration dtn)
 {
     using namespace std::chrono;
 
-    auto const tp          = system_clock::now();
-    auto const dtn         = tp.time_since_epoch();
     std::time_t const sec  = duration_cast<seconds>(dtn).count();
     std::size_t const usec = duration_cast<microseconds>(dtn).count() % 1000000;
     return { sec, static_cast<std::size_t>(usec) };
 }
 
+inline time_value nsec_to_time_value(std::int64_t nsec)
+{
+    return { static_cast<std::time_t>(nsec / 1000000000)
+             , static_cast<std::size_t>(nsec % 1000000000 / 1000) };
+}
+
+// Get current time.
+inline time_value curr_time()
+{
+    return to_time_value(std::chrono::system_clock::now().time_since_epoch());
+}
+
+// Time read from a clock_source, unconverted. clock is none once it is
+// converted (or if there is no time).
+struct raw_time
+{
+    std::int64_t ticks = 0;
+    clock_source clock = clock_source::none;
+};
+
+// Counter of clock_source::tsc.
+inline std::int64_t read_tsc()
+{
+#if defined(TINYLOG_TSC)
+    return static_cast<std::int64_t>(__rdtsc());
+#elif defined(__aarch64__) && defined(__GNUC__)
+    std::uint64_t ticks;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return static_cast<std::int64_t>(ticks);
+#else
+    return static_cast<std::int64_t>(
+        std::chrono::steady_clock::now().time_since_epoch().count());
+#endif // TINYLOG_TSC
+}
+
+// Nanoseconds since epoch of clock_source::coarse.
+inline std::int64_t read_coarse()
+{
+#if defined(CLOCK_REALTIME_COARSE)
+    struct timespec ts;
+    ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+        system_clock::now().time_since_epoch()).count();
+#endif // CLOCK_REALTIME_COARSE
+}
+
+inline raw_time read_clock(clock_source clock)
+{
+    raw_time t;
+    t.clock = clock;
+    switch (clock)
+    {
+    case clock_source::system:
+        t.ticks = static_cast<std::int64_t>(
+            std::chrono::system_clock::now().time_since_epoch().count());
+        break;
+    case clock_source::coarse:
+        t.ticks = read_coarse();
+        break;
+    case clock_source::tsc:
+        t.ticks = read_tsc();
+        break;
+    default:
+        t.clock = clock_source::none;
+        break;
+    }
+    return t;
+}
+
+// Convert ticks of read_tsc to wall time. Rate of the counter is measured
+// against the steady clock over a span doubled each time up to a second,
+// the system clock is sampled along with it, so the error stays about the
+// resolution of the clocks.
+//
+// Time never goes back: a new calibration starts where the last one ends,
+// running ahead of the system clock is slewed away over the next span at
+// half rate at most, falling behind is caught up at once.
+class tsc_clock
+{
+public:
+    static tsc_clock& instance()
+    {
+        static tsc_clock c;
+        return c;
+    }
+
+    // Take the first rate now instead of on the first record, it waits
+    // about a millisecond.
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (epoch_.load(std::memory_order_relaxed) == 0)
+        {
+            calibrate();
+        }
+    }
+
+    // Nanoseconds since epoch.
+    std::int64_t to_nsec(std::int64_t ticks)
+    {
+        static thread_local calibration local;
+        static thread_local std::size_t local_epoch = 0;
+
+        if (local_epoch != epoch_.load(std::memory_order_acquire)
+            || ticks >= local.next)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (epoch_.load(std::memory_order_relaxed) == 0
+                || ticks >= calibration_.next)
+            {
+                calibrate();
+            }
+            local = calibration_;
+            local_epoch = epoch_.load(std::memory_order_relaxed);
+        }
+        return local.at(ticks);
+    }
+
+private:
+    struct calibration
+    {
+        std::int64_t ticks = 0;
+        std::int64_t nsec  = 0;
+        std::int64_t next  = 0;
+        double rate = 0.0;  // nanoseconds per tick
+
+        std::int64_t at(std::int64_t t) const
+        {
+            return nsec + static_cast<std::int64_t>(
+                static_cast<double>(t - ticks) * rate);
+        }
+    };
+
+    static constexpr std::int64_t min_span = 1000000;     // 1ms
+    static constexpr std::int64_t max_span = 1000000000;  // 1s
+
+    tsc_clock()
+        : base_ticks_(read_tsc()), base_steady_(steady_nsec())
+    {}
+
+    static std::int64_t steady_nsec()
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(
+            steady_clock::now().time_since_epoch()).count();
+    }
+
+    static std::int64_t system_nsec()
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(
+            system_clock::now().time_since_epoch()).count();
+    }
+
+    void calibrate()
+    {
+        // The first rate is taken over min_span at least.
+        auto steady = steady_nsec();
+        while (steady - base_steady_ < min_span)
+        {
+            std::this_thread::yield();
+            steady = steady_nsec();
+        }
+
+        auto& c = calibration_;
+        auto const last = c;
+        auto const first = epoch_.load(std::memory_order_relaxed) == 0;
+        c.ticks = read_tsc();
+        auto const sys = system_nsec();
+        auto const span = c.ticks - base_ticks_;
+        auto const rate = static_cast<double>(steady - base_steady_)
+                          / static_cast<double>(span > 0 ? span : 1);
+
+        auto const max_ticks = static_cast<std::int64_t>(
+            static_cast<double>(max_span) / rate);
+        auto const next_span = (std::max)(
+            (std::min)(span, max_ticks), std::int64_t(1));
+        c.next = c.ticks + next_span;
+        c.nsec = sys;
+        c.rate = rate;
+
+        auto const ahead = first ? 0 : last.at(c.ticks) - sys;
+        if (ahead > 0)
+        {
+            // Meet the system clock at next, time still moves forward.
+            c.nsec = sys + ahead;
+            c.rate = (std::max)(rate * 0.5
+                                , rate - static_cast<double>(ahead)
+                                         / static_cast<double>(next_span));
+        }
+        epoch_.fetch_add(1, std::memory_order_release);
+    }
+
+private:
+    std::int64_t const base_ticks_;
+    std::int64_t const base_steady_;
+
+    std::mutex mtx_;
+    calibration calibration_;
+    std::atomic_size_t epoch_{ 0u };
+};
+
+inline time_value to_time_value(raw_time const& t)
+{
+    switch (t.clock)
+    {
+    case clock_source::system:
+        return to_time_value(std::chrono::system_clock::duration(t.ticks));
+    case clock_source::coarse:
+        return nsec_to_time_value(t.ticks);
+    case clock_source::tsc:
+        return nsec_to_time_value(tsc_clock::instance().to_nsec(t.ticks));
+    default:
+        return { 0, 0 };
+    }
+}
+
+// Bumped when the timezone may have changed.
+inline std::atomic_size_t& timezone_epoch()
+{
+    static std::atomic_size_t epoch(0u);
+    return epoch;
+}
+
+// Convert to local time, localtime_r is called once a minute per thread
+// (it takes a global lock for TZ handling).
+inline void local_time(std::time_t sec, struct tm& ti)
+{
+    struct cache
+    {
+        std::time_t minute = 0;
+        std::size_t epoch  = 0;
+        bool valid         = false;
+        struct tm ti;
+    };
+    static thread_local cache c;
+
+    auto const epoch = timezone_epoch().load(std::memory_order_relaxed);
+    if (!c.valid || c.epoch != epoch
+        || sec < c.minute || sec - c.minute >= 60)
+    {
+#if defined(TINYLOG_WINDOWS_API)
+        ::localtime_s(&c.ti, &sec);
+#else
+        ::localtime_r(&sec, &c.ti);
+#endif // TINYLOG_WINDOWS_API
+        c.minute = sec - c.ti.tm_sec;
+        c.epoch  = epoch;
+        c.valid  = true;
+    }
+    ti = c.ti;
+    ti.tm_sec = static_cast<int>(sec - c.minute);
+}
+
 // Get current thread id.
 inline std::size_t curr_thrd_id()
 {
@@ -381,26 +912,25 @@ strftime_impl(strftimeT strftime_cb, charT const* fmt, time_value const& tv)
     std::basic_string<charT> time_buffer(time_bufsize, '\0');
 
     struct tm timeinfo;
-
-#if defined(TINYLOG_WINDOWS_API)
-    ::localtime_s(&timeinfo, &tv.tv_sec);
-#else
-    ::localtime_r(&tv.tv_sec, &timeinfo);
-#endif // TINYLOG_WINDOWS_API
+    local_time(tv.tv_sec, timeinfo);
 
     auto const n = strftime_cb(const_cast<charT*>(time_buffer.data())
                                , time_bufsize, fmt, &timeinfo);
     time_buffer.resize(n);
 
     // append microseconds
-    std::basic_string<charT> fmt_s(fmt);
-    std::basic_ostringstream<charT> oss;
-    if (!fmt_s.empty() && *(fmt_s.rbegin()) == oss.widen('.'))
+    auto const fmt_len = std::char_traits<charT>::length(fmt);
+    if (fmt_len != 0 && fmt[fmt_len - 1] == charT('.'))
     {
-        oss.imbue(std::locale::classic());
-        oss << std::setfill(oss.widen('0')) << std::setw(6) << tv.tv_usec;
+        auto usec = tv.tv_usec;
+        charT digits[6];
+        for (auto i = 6; i-- != 0; usec /= 10)
+        {
+            digits[i] = static_cast<charT>('0' + usec % 10);
+        }
+        time_buffer.append(digits, 6);
     }
-    return time_buffer + oss.str();
+    return time_buffer;
 }
 
 // Ensure l[w]printf's argument is available. Try make compile error,
@@ -448,29 +978,35 @@ struct sprintf_constructor<char>
     using char_type = char;
     using string_t = std::basic_string<char_type>;
 
+    static constexpr std::size_t stack_bufsize = 512;
+
     template <class... Args>
     static void construct(string_t& s, string_t const& fmt, Args&&... args)
     {
 #if !defined(TINYLOG_CANCEL_VERBOSE)
         ensure_va_args_safe_A(std::forward<Args>(args)...);
 #endif
-        for (int n = BUFSIZ; true; n += BUFSIZ)
+        // Format on the stack first, snprintf tells the exact size if the
+        // message does not fit.
+        char_type buf[stack_bufsize];
+        auto const r = std::snprintf(buf, stack_bufsize, fmt.c_str()
+                                     , args...);
+        if (r < 0)
         {
-            s.resize(n--);
-            auto r = std::snprintf(const_cast<char_type*>(s.data()), n
-                                   , fmt.c_str(), args...);
-            if (r < 0)
-            {
-                // TODO: throw system_error
-                s.clear();
-                break;
-            }
-            if (r < n)
-            {
-                s.resize(r);
-                break;
-            }
+            // TODO: throw system_error
+            s.clear();
+            return;
+        }
+
+        auto const n = static_cast<std::size_t>(r);
+        if (n < stack_bufsize)
+        {
+            s.assign(buf, n);
+            return;
         }
+        s.resize(n + 1);
+        std::snprintf(&s[0], n + 1, fmt.c_str(), args...);
+        s.resize(n);
     }
 };
 
@@ -480,29 +1016,36 @@ struct sprintf_constructor<wchar_t>
     using char_type = wchar_t;
     using string_t = std::basic_string<char_type>;
 
+    static constexpr std::size_t stack_bufsize = 512;
+    static constexpr std::size_t max_bufsize = 16 * 1024 * 1024;
+
     template <class... Args>
     static void construct(string_t& s, string_t const& fmt, Args&&... args)
     {
 #if !defined(TINYLOG_CANCEL_VERBOSE)
         ensure_va_args_safe_W(std::forward<Args>(args)...);
 #endif
-        for (int n = BUFSIZ; true; n += BUFSIZ)
+        char_type buf[stack_bufsize];
+        auto r = std::swprintf(buf, stack_bufsize, fmt.c_str(), args...);
+        if (r >= 0)
         {
-            s.resize(n--);
-            auto r = std::swprintf(const_cast<char_type*>(s.data()), n
-                                   , fmt.c_str(), args...);
-            if (r < 0)
-            {
-                // TODO: throw system_error
-                s.clear();
-                break;
-            }
-            if (r < n)
+            s.assign(buf, static_cast<std::size_t>(r));
+            return;
+        }
+
+        // swprintf fails without the size needed, grow geometrically.
+        for (std::size_t n = 4 * stack_bufsize; n <= max_bufsize; n *= 2)
+        {
+            s.resize(n);
+            r = std::swprintf(&s[0], n, fmt.c_str(), args...);
+            if (r >= 0)
             {
-                s.resize(r);
-                break;
+                s.resize(static_cast<std::size_t>(r));
+                return;
             }
         }
+        // TODO: throw system_error
+        s.clear();
     }
 };
 
@@ -555,7 +1098,7 @@ inline void file_rename(std::string const& old
 
 #else
 
-    if (!::rename(old.c_str(), now.c_str()))
+    if (::rename(old.c_str(), now.c_str()) != 0)
     {
         throw std::system_error(errno
                                 , std::system_category(), "move file failed");
@@ -564,6 +1107,55 @@ inline void file_rename(std::string const& old
 #endif
 }
 
+// Names of the files in a directory.
+inline std::vector<std::string> list_files(std::string const& dir)
+{
+    std::vector<std::string> names;
+
+#if defined(TINYLOG_WINDOWS_API)
+
+    WIN32_FIND_DATAA data;
+    auto const h = ::FindFirstFileA((dir + "\\*").c_str(), &data);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        return names;
+    }
+    do
+    {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            names.emplace_back(data.cFileName);
+        }
+    } while (::FindNextFileA(h, &data));
+    ::FindClose(h);
+
+#else
+
+    auto const d = ::opendir(dir.c_str());
+    if (!d)
+    {
+        return names;
+    }
+    while (auto const entry = ::readdir(d))
+    {
+        names.emplace_back(entry->d_name);
+    }
+    ::closedir(d);
+
+#endif
+
+    return names;
+}
+
+inline unsigned long process_id()
+{
+#if defined(TINYLOG_WINDOWS_API)
+    return static_cast<unsigned long>(::GetCurrentProcessId());
+#else
+    return static_cast<unsigned long>(::getpid());
+#endif
+}
+
 // Generate string message.
 //
 // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -610,6 +1202,18 @@ gen_title(std::basic_string<charT> const& tm_text, charT sep)
 
 } // namespace detail
 
+// Local time is cached, call it after the timezone is changed
+// (e.g. TZ environment variable).
+inline void refresh_timezone()
+{
+#if defined(TINYLOG_WINDOWS_API)
+    ::_tzset();
+#else
+    ::tzset();
+#endif // TINYLOG_WINDOWS_API
+    detail::timezone_epoch().fetch_add(1u, std::memory_order_relaxed);
+}
+
 /*****************************************************************************/
 /* String Charset Convertion. */
 
@@ -635,65 +1239,273 @@ struct string_traits<u8string>
 namespace detail
 {
 
-template <class charT>
-struct ansi_constructor;
-
-template <>
-struct ansi_constructor<char>
+// Length of the leading ASCII run of s.
+inline std::size_t ascii_length(char const* s, std::size_t n)
 {
-    using char_type = char;
-    using string_t = std::basic_string<char_type>;
-
-    template <class charFT
-              , typename std::enable_if<std::is_same<charFT, char_type>::value
-                                        , int>::type = 0>
-    static void construct(string_t& to, std::basic_string<charFT> const& from)
+    std::size_t i = 0;
+#if defined(TINYLOG_SSE2)
+    for (; i + 16 <= n; i += 16)
     {
-        to = from;
+        auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s + i));
+        if (_mm_movemask_epi8(v) != 0)
+        {
+            break;
+        }
     }
-
-    template <class charFT
-              , typename std::enable_if<std::is_same<charFT, wchar_t>::value
-                                        , int>::type = 0>
-    static void construct(string_t& to, std::basic_string<charFT> const& from)
+#endif
+    for (; i + 8 <= n; i += 8)
     {
-        using from_type = charFT;
-        using to_type = char_type;
-        using cvt_facet = std::codecvt<from_type, to_type, std::mbstate_t>;
-
-        constexpr std::size_t codecvt_buf_size = BUFSIZ;
-        // Perhaps too large, but that's OK.
-        // Encodings like shift-JIS need some prefix space
-        std::size_t buf_size = from.length() * 4 + 4;
-        if (buf_size < codecvt_buf_size)
+        std::uint64_t w;
+        std::memcpy(&w, s + i, sizeof(w));
+        if (w & 0x8080808080808080ull)
         {
-            buf_size = codecvt_buf_size;
+            break;
         }
-        to.resize(buf_size);
+    }
+    while (i != n && !(static_cast<unsigned char>(s[i]) & 0x80))
+    {
+        ++i;
+    }
+    return i;
+}
 
-        std::locale loc("");
-        auto& cvt = std::use_facet<cvt_facet>(loc);
-        do
+// Whether s is well-formed UTF-8.
+inline bool is_utf8(char const* s, std::size_t n)
+{
+    auto p = reinterpret_cast<unsigned char const*>(s);
+    auto const e = p + n;
+    while (p != e)
+    {
+        auto const ascii = ascii_length(reinterpret_cast<char const*>(p)
+                                        , static_cast<std::size_t>(e - p));
+        p += ascii;
+        if (p == e)
         {
-            from_type const* fb = from.data();
-            from_type const* fe = from.data() + from.length();
-            from_type const* fn = nullptr;
-
-            to_type* tb = const_cast<to_type*>(to.data());
-            to_type* te = const_cast<to_type*>(to.data() + to.length());
-            to_type* tn = nullptr;
+            break;
+        }
 
-            std::mbstate_t state = std::mbstate_t();
-            auto result = cvt.out(state, fb, fe, fn, tb, te, tn);
-            if (result == cvt_facet::ok || result == cvt_facet::noconv)
+        auto const c = *p;
+        std::size_t len = 0;
+        unsigned char lo = 0x80, hi = 0xbf;  // range of the second byte
+        if (c >= 0xc2 && c <= 0xdf)
+        {
+            len = 2;
+        }
+        else if (c >= 0xe0 && c <= 0xef)
+        {
+            len = 3;
+            lo = c == 0xe0 ? 0xa0 : 0x80;   // overlong
+            hi = c == 0xed ? 0x9f : 0xbf;   // surrogates
+        }
+        else if (c >= 0xf0 && c <= 0xf4)
+        {
+            len = 4;
+            lo = c == 0xf0 ? 0x90 : 0x80;   // overlong
+            hi = c == 0xf4 ? 0x8f : 0xbf;   // beyond U+10FFFF
+        }
+        if (len == 0 || static_cast<std::size_t>(e - p) < len
+            || p[1] < lo || p[1] > hi)
+        {
+            return false;
+        }
+        for (std::size_t i = 2; i != len; ++i)
+        {
+            if ((p[i] & 0xc0) != 0x80)
             {
-                to.resize(tn - tb);
-                break;
+                return false;
             }
-            else if (result == cvt_facet::partial)
+        }
+        p += len;
+    }
+    return true;
+}
+
+// Narrow charset and its codecvt facet, kept per thread and rebuilt after
+// set_conversion_locale().
+struct conversion_context
+{
+    using cvt_facet = std::codecvt<wchar_t, char, std::mbstate_t>;
+
+    std::locale loc;
+    cvt_facet const* cvt = nullptr;
+    bool utf8 = false;
+    unsigned epoch = 0;
+
+    // Output of codecvt, appended to the target string once done.
+    std::vector<char> narrow_buf;
+    std::vector<wchar_t> wide_buf;
+};
+
+inline std::locale make_default_locale()
+{
+    try
+    {
+        return std::locale("");
+    }
+    catch (...)
+    {
+        // A bad LANG or LC_* of the environment, convert as "C".
+        return std::locale::classic();
+    }
+}
+
+inline std::mutex& conversion_mutex()
+{
+    static std::mutex mtx;
+    return mtx;
+}
+
+// Guarded by conversion_mutex().
+inline std::locale& conversion_locale()
+{
+    static std::locale loc = make_default_locale();
+    return loc;
+}
+
+inline std::atomic<unsigned>& conversion_epoch()
+{
+    static std::atomic<unsigned> epoch(1u);
+    return epoch;
+}
+
+// Whether cvt writes UTF-8, tried on code points of two and three bytes.
+// Names like "LC_CTYPE=en_US.UTF-8;LC_TIME=C" don't tell it reliably.
+inline bool is_utf8_facet(conversion_context::cvt_facet const& cvt)
+{
+    static wchar_t const from[] = { wchar_t(0xe9), wchar_t(0x20ac) };
+    static char const utf8[] = "\xc3\xa9\xe2\x82\xac";
+
+    std::mbstate_t state = std::mbstate_t();
+    wchar_t const* from_next = nullptr;
+    char to[16];
+    char* to_next = nullptr;
+    auto const res = cvt.out(state, from, from + 2, from_next
+                             , to, to + sizeof(to), to_next);
+    return res == std::codecvt_base::ok && from_next == from + 2
+           && static_cast<std::size_t>(to_next - to) == sizeof(utf8) - 1
+           && std::memcmp(to, utf8, sizeof(utf8) - 1) == 0;
+}
+
+inline conversion_context& get_conversion_context()
+{
+    static thread_local conversion_context ctx;
+
+    auto const epoch = conversion_epoch().load(std::memory_order_acquire);
+    if (ctx.epoch != epoch)
+    {
+        {
+            std::lock_guard<std::mutex> lock(conversion_mutex());
+            ctx.loc = conversion_locale();
+        }
+        ctx.cvt = &std::use_facet<conversion_context::cvt_facet>(ctx.loc);
+        ctx.utf8 = is_utf8_facet(*ctx.cvt);
+        ctx.epoch = epoch;
+    }
+    return ctx;
+}
+
+// Whether narrow strings of the conversion locale are UTF-8 already.
+inline bool is_utf8_locale()
+{
+    return get_conversion_context().utf8;
+}
+
+// Whether all characters of s are ASCII, the same in any charset.
+inline bool is_ascii(std::wstring const& s)
+{
+    for (auto const c : s)
+    {
+        if (static_cast<std::uint32_t>(c) >= 0x80)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Copy ASCII text into to in place, assigning a range of the other char
+// type builds a temporary string.
+template <class toCharT, class fromCharT>
+void copy_ascii(std::basic_string<toCharT>& to
+                , std::basic_string<fromCharT> const& from)
+{
+    to.resize(from.size());
+    for (std::size_t i = 0; i != from.size(); ++i)
+    {
+        to[i] = static_cast<toCharT>(from[i]);
+    }
+}
+
+template <class charT>
+struct ansi_constructor;
+
+template <>
+struct ansi_constructor<char>
+{
+    using char_type = char;
+    using string_t = std::basic_string<char_type>;
+
+    template <class charFT
+              , typename std::enable_if<std::is_same<charFT, char_type>::value
+                                        , int>::type = 0>
+    static void construct(string_t& to, std::basic_string<charFT> const& from)
+    {
+        to = from;
+    }
+
+    template <class charFT
+              , typename std::enable_if<std::is_same<charFT, wchar_t>::value
+                                        , int>::type = 0>
+    static void construct(string_t& to, std::basic_string<charFT> const& from)
+    {
+        using from_type = charFT;
+        using to_type = char_type;
+        using cvt_facet = conversion_context::cvt_facet;
+
+        if (is_ascii(from))
+        {
+            copy_ascii(to, from);
+            return ;
+        }
+
+        auto& ctx = get_conversion_context();
+        auto& buf = ctx.narrow_buf;
+
+        constexpr std::size_t codecvt_buf_size = BUFSIZ;
+        // Perhaps too large, but that's OK.
+        // Encodings like shift-JIS need some prefix space
+        std::size_t buf_size = from.length() * 4 + 4;
+        if (buf.size() < buf_size)
+        {
+            buf.resize(buf_size);
+        }
+
+        auto& cvt = *ctx.cvt;
+        do
+        {
+            from_type const* fb = from.data();
+            from_type const* fe = from.data() + from.length();
+            from_type const* fn = nullptr;
+
+            to_type* tb = buf.data();
+            to_type* te = buf.data() + buf.size();
+            to_type* tn = nullptr;
+
+            std::mbstate_t state = std::mbstate_t();
+            auto result = cvt.out(state, fb, fe, fn, tb, te, tn);
+            if (result == cvt_facet::ok)
+            {
+                to.assign(tb, tn);
+                break;
+            }
+            else if (result == cvt_facet::noconv)
+            {
+                to.assign(from.begin(), from.end());
+                break;
+            }
+            else if (result == cvt_facet::partial)
             {
-                buf_size += codecvt_buf_size;
-                to.resize(buf_size);
+                buf.resize(buf.size() + codecvt_buf_size);
                 continue;
             }
             to.clear();
@@ -723,40 +1535,51 @@ struct ansi_constructor<wchar_t>
     {
         using from_type = charFT;
         using to_type = char_type;
-        using cvt_facet = std::codecvt<to_type, from_type, std::mbstate_t>;
+        using cvt_facet = conversion_context::cvt_facet;
+
+        if (ascii_length(from.data(), from.size()) == from.size())
+        {
+            copy_ascii(to, from);
+            return ;
+        }
+
+        auto& ctx = get_conversion_context();
+        auto& buf = ctx.wide_buf;
 
         constexpr std::size_t codecvt_buf_size = BUFSIZ;
-        // Perhaps too large, but that's OK
-        std::size_t buf_size = from.length() * 3;
-        if (buf_size < codecvt_buf_size)
+        // A narrow character never makes more than one wide character.
+        std::size_t buf_size = from.length() + 1;
+        if (buf.size() < buf_size)
         {
-            buf_size = codecvt_buf_size;
+            buf.resize(buf_size);
         }
-        to.resize(buf_size);
 
-        std::locale loc("");
-        auto& cvt = std::use_facet<cvt_facet>(loc);
+        auto& cvt = *ctx.cvt;
         do
         {
             from_type const* fb = from.data();
             from_type const* fe = from.data() + from.length();
             from_type const* fn = nullptr;
 
-            to_type* tb = const_cast<to_type*>(to.data());
-            to_type* te = const_cast<to_type*>(to.data() + to.length());
+            to_type* tb = buf.data();
+            to_type* te = buf.data() + buf.size();
             to_type* tn = nullptr;
 
             std::mbstate_t state = std::mbstate_t();
             auto result = cvt.in(state, fb, fe, fn, tb, te, tn);
-            if (result == cvt_facet::ok || result == cvt_facet::noconv)
+            if (result == cvt_facet::ok)
+            {
+                to.assign(tb, tn);
+                break;
+            }
+            else if (result == cvt_facet::noconv)
             {
-                to.resize(tn - tb);
+                to.assign(from.begin(), from.end());
                 break;
             }
             else if (result == cvt_facet::partial)
             {
-                buf_size += codecvt_buf_size;
-                to.resize(buf_size);
+                buf.resize(buf.size() + codecvt_buf_size);
                 continue;
             }
             to.clear();
@@ -779,6 +1602,12 @@ struct utf8_constructor<char>
                                         , int>::type = 0>
     static void construct(string_t& to, std::basic_string<charFT> const& from)
     {
+        if (is_utf8_already(from))
+        {
+            to = from;
+            return ;
+        }
+
         using wide_type = wchar_t;
         // ansi --> wide
         std::basic_string<wide_type> ws;
@@ -796,6 +1625,14 @@ struct utf8_constructor<char>
         std::wstring_convert<std::codecvt_utf8<charFT>, charFT> cv;
         to = cv.to_bytes(from);
     }
+
+    // ASCII, or valid UTF-8 of a UTF-8 locale, needs no convertion.
+    static bool is_utf8_already(string_t const& s)
+    {
+        auto const n = ascii_length(s.data(), s.size());
+        return n == s.size()
+               || (is_utf8_locale() && is_utf8(s.data() + n, s.size() - n));
+    }
 };
 
 template <>
@@ -849,6 +1686,24 @@ inline std::wstring a2w(std::string const& s)
     return ws;
 }
 
+// Locale of charset convertion between narrow and unicode strings,
+// std::locale("") by default. Threads pick it up on their next
+// convertion.
+inline void set_conversion_locale(std::locale const& loc)
+{
+    {
+        std::lock_guard<std::mutex> lock(detail::conversion_mutex());
+        detail::conversion_locale() = loc;
+    }
+    detail::conversion_epoch().fetch_add(1u, std::memory_order_release);
+}
+
+inline std::locale get_conversion_locale()
+{
+    std::lock_guard<std::mutex> lock(detail::conversion_mutex());
+    return detail::conversion_locale();
+}
+
 /*****************************************************************************/
 /* Log Level. */
 
@@ -857,1274 +1712,7420 @@ enum level : std::uint8_t
     trace, debug, info, warn, error, fatal
 };
 
+// Name of a level, a literal nothing needs to allocate.
 template <class charT>
-std::basic_string<charT> to_string(level lvl);
+charT const* level_name(level lvl);
 
 template <>
-inline std::basic_string<char> to_string(level lvl)
+inline char const* level_name(level lvl)
 {
-    std::basic_string<char> text;
     switch (lvl)
     {
     case level::trace:
-        text = TINYLOG_LEVEL_TRACE;
-        break;
+        return TINYLOG_LEVEL_TRACE;
     case level::debug:
-        text = TINYLOG_LEVEL_DEBUG;
-        break;
+        return TINYLOG_LEVEL_DEBUG;
     case level::info:
-        text = TINYLOG_LEVEL_INFO;
-        break;
+        return TINYLOG_LEVEL_INFO;
     case level::warn:
-        text = TINYLOG_LEVEL_WARN;
-        break;
+        return TINYLOG_LEVEL_WARN;
     case level::error:
-        text = TINYLOG_LEVEL_ERROR;
-        break;
+        return TINYLOG_LEVEL_ERROR;
     case level::fatal:
-        text = TINYLOG_LEVEL_FATAL;
-        break;
+        return TINYLOG_LEVEL_FATAL;
     default:
-        text = TINYLOG_LEVEL_UNKOWN;
-        break;
+        return TINYLOG_LEVEL_UNKOWN;
     }
-    return  text;
 }
 
 template <>
-inline std::basic_string<wchar_t> to_string(level lvl)
+inline wchar_t const* level_name(level lvl)
 {
-    std::basic_string<wchar_t> text;
     switch (lvl)
     {
     case level::trace:
-        text = TINYLOG_LEVEL_TRACEW;
-        break;
+        return TINYLOG_LEVEL_TRACEW;
     case level::debug:
-        text = TINYLOG_LEVEL_DEBUGW;
-        break;
+        return TINYLOG_LEVEL_DEBUGW;
     case level::info:
-        text = TINYLOG_LEVEL_INFOW;
-        break;
+        return TINYLOG_LEVEL_INFOW;
     case level::warn:
-        text = TINYLOG_LEVEL_WARNW;
-        break;
+        return TINYLOG_LEVEL_WARNW;
     case level::error:
-        text = TINYLOG_LEVEL_ERRORW;
-        break;
+        return TINYLOG_LEVEL_ERRORW;
     case level::fatal:
-        text = TINYLOG_LEVEL_FATALW;
-        break;
+        return TINYLOG_LEVEL_FATALW;
     default:
-        text = TINYLOG_LEVEL_UNKOWNW;
-        break;
+        return TINYLOG_LEVEL_UNKOWNW;
     }
-    return text;
+}
+
+template <class charT>
+std::basic_string<charT> to_string(level lvl)
+{
+    return level_name<charT>(lvl);
 }
 
 /*****************************************************************************/
-/* Record Entry. */
+/* Format. */
+
+// Type-safe format checked at compile time, e.g.
+//
+//     lfmt(info, "user {} took {:.3f} ms", id, ms);
+//
+// Replacement field: {[:[align][0][width][.precision][type]]}
+//   - align:     < (left), > (right), ^ (center)
+//   - 0:         pad number with zeros after sign
+//   - precision: digits of a float, max characters of a string
+//   - type:      d x X o b c (integer), f F e E g G (float), s (string),
+//                p (pointer)
+//
+// Use {{ and }} for literal braces. Format string must be a literal, so
+// placeholders and argument types are checked by the compiler.
+
+namespace detail
+{
 
+// Stream buffer appending to a string.
 template <class charT>
-struct basic_record
+class basic_string_appendbuf : public std::basic_streambuf<charT>
 {
-    using self      = basic_record<charT>;
-    using char_type = charT;
-    using string_t  = std::basic_string<char_type>;
+public:
+    using base        = std::basic_streambuf<charT>;
+    using char_type   = charT;
+    using traits_type = typename base::traits_type;
+    using int_type    = typename base::int_type;
+    using string_t    = std::basic_string<char_type>;
 
-    explicit basic_record(detail::time_value const& t, level l
-                          , std::uintmax_t thrd_id, string_t const& m)
-        : tv(t), lvl(l), id(thrd_id), message(m)
-    {}
+public:
+    void attach(string_t* s)
+    {
+        str_ = s;
+    }
 
-    explicit basic_record(level l, string_t const& m)
-        : self(detail::curr_time(), l, detail::curr_thrd_id(), m)
-    {}
+    // Nothing is buffered, text may be appended to it directly.
+    string_t* str() const
+    {
+        return str_;
+    }
 
-    explicit basic_record(level l)
-        : tv(detail::curr_time()), lvl(l), id(detail::curr_thrd_id())
-    {}
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            str_->push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
 
-    detail::time_value  tv;
-    level               lvl;
-    std::uintmax_t      id;
-    string_t            message;
+    std::streamsize xsputn(char_type const* s, std::streamsize n) override
+    {
+        str_->append(s, static_cast<std::size_t>(n));
+        return n;
+    }
+
+private:
+    string_t* str_ = nullptr;
 };
 
-using record  = basic_record<char>;
-using wrecord = basic_record<wchar_t>;
+enum class fmt_kind : std::uint8_t
+{
+    none,  // unsupported
+    boolean,
+    character,
+    signed_int,
+    unsigned_int,
+    floating,
+    string,
+    pointer,
+    custom  // written by operator<<
+};
 
-template <class charT>
-struct basic_record_d : public basic_record<charT>
+template <class charT, class T, class U = typename std::decay<T>::type>
+struct fmt_kind_of
+    : std::integral_constant<fmt_kind
+    , std::is_same<U, bool>::value ? fmt_kind::boolean
+    : std::is_same<U, char>::value || std::is_same<U, charT>::value
+    ? fmt_kind::character
+    : std::is_same<U, wchar_t>::value || std::is_same<U, char16_t>::value
+      || std::is_same<U, char32_t>::value ? fmt_kind::none
+    : std::is_integral<U>::value
+    ? (std::is_signed<U>::value ? fmt_kind::signed_int
+                                : fmt_kind::unsigned_int)
+    : std::is_floating_point<U>::value ? fmt_kind::floating
+    : std::is_same<U, charT*>::value || std::is_same<U, charT const*>::value
+      || std::is_same<U, std::basic_string<charT>>::value
+    ? fmt_kind::string
+    : std::is_same<U, wchar_t*>::value || std::is_same<U, wchar_t const*>::value
+      || std::is_same<U, std::wstring>::value ? fmt_kind::none
+    : std::is_same<U, char*>::value || std::is_same<U, char const*>::value
+    ? fmt_kind::custom  // widened by wostream
+    : std::is_same<U, std::nullptr_t>::value
+      || (std::is_pointer<U>::value
+          && !std::is_function<typename std::remove_pointer<U>::type>::value)
+    ? fmt_kind::pointer
+    : fmt_kind::custom>
 {
-    using base      = basic_record<charT>;
-    using self      = basic_record_d<charT>;
-    using char_type = typename base::char_type;
-    using string_t  = typename base::string_t;
+};
 
-    explicit basic_record_d(detail::time_value const& t, level l
-                            , std::uintmax_t thrd_id, string_t const& m
-                            , string_t const& fn, std::size_t ln
-                            , string_t const& fun)
-        : base(t, l, thrd_id, m), file(fn), line(ln), func(fun)
-    {}
+template <fmt_kind... Ks>
+struct fmt_kind_list
+{
+};
 
-    explicit basic_record_d(level l, string_t const& m
-                            , string_t const& fn, std::size_t ln
-                            , string_t const& fun)
-        : base(l, m), file(fn), line(ln), func(fun)
-    {}
+// Kinds of arguments, only used in unevaluated context.
+template <class charT, class... Args>
+fmt_kind_list<fmt_kind_of<charT, Args>::value...> fmt_kinds(Args&&...);
 
-    explicit basic_record_d(level l
-                            , string_t const& fn, std::size_t ln
-                            , string_t const& fun)
-        : base(l), file(fn), line(ln), func(fun)
-    {}
+template <fmt_kind... Ks>
+constexpr std::size_t fmt_kind_count(fmt_kind_list<Ks...>)
+{
+    return sizeof...(Ks);
+}
 
-    string_t        file;
-    std::size_t     line;
-    string_t        func;
+constexpr fmt_kind fmt_kind_at(fmt_kind_list<>, std::size_t)
+{
+    return fmt_kind::none;
+}
+
+template <fmt_kind K, fmt_kind... Ks>
+constexpr fmt_kind fmt_kind_at(fmt_kind_list<K, Ks...>, std::size_t i)
+{
+    return i == 0 ? K : fmt_kind_at(fmt_kind_list<Ks...>(), i - 1);
+}
+
+enum fmt_error : int
+{
+    fmt_ok = 0,
+    fmt_too_few_args,
+    fmt_too_many_args,
+    fmt_unmatched_brace,
+    fmt_bad_spec,
+    fmt_bad_arg
 };
 
-using record_d = basic_record_d<char>;
-using wrecord_d = basic_record_d<wchar_t>;
+// C++11 constexpr is a single return statement, the format string is
+// scanned by recursion. Text is skipped eight characters a step to stay
+// far from the compiler's recursion limit.
+template <class charT>
+constexpr bool fmt_is_text(charT c)
+{
+    return c != charT('{') && c != charT('}') && c != charT('\0');
+}
 
-/*****************************************************************************/
-/* Build Layout: Convert record entry to log message string. */
+template <class charT>
+constexpr std::size_t fmt_skip_text_1(charT const* f, std::size_t i)
+{
+    return fmt_is_text(f[i]) ? fmt_skip_text_1(f, i + 1) : i;
+}
 
-namespace detail
+template <class charT>
+constexpr std::size_t fmt_skip_text(charT const* f, std::size_t i)
 {
+    return fmt_is_text(f[i]) && fmt_is_text(f[i + 1])
+           && fmt_is_text(f[i + 2]) && fmt_is_text(f[i + 3])
+           && fmt_is_text(f[i + 4]) && fmt_is_text(f[i + 5])
+           && fmt_is_text(f[i + 6]) && fmt_is_text(f[i + 7])
+           ? fmt_skip_text(f, i + 8) : fmt_skip_text_1(f, i);
+}
 
-template <class deriveT, class charT>
-struct layout_constructor_base
+template <class charT>
+constexpr std::size_t fmt_skip_digits(charT const* f, std::size_t i)
 {
-    using derive     = deriveT;
-    using char_type  = charT;
-    using string_t   = std::basic_string<char_type>;
-    using ostream_t  = std::basic_ostringstream<char_type>;
-    using record     = basic_record<char_type>;
-    using record_d   = basic_record_d<char_type>;
+    return f[i] >= charT('0') && f[i] <= charT('9')
+           ? fmt_skip_digits(f, i + 1) : i;
+}
 
-    static void construct(string_t& s, record const& r
-                          , string_t& cache, bool /*verbose*/)
-    {
-        ostream_t strm;
-        strm.imbue(std::locale::classic());
-        derive::record_prefix(strm, r, cache);
-        derive::record_suffix(strm, r, cache);
-        s = strm.str();
-    }
+template <class charT>
+constexpr std::size_t fmt_skip_align(charT const* f, std::size_t i)
+{
+    return f[i] == charT('<') || f[i] == charT('>') || f[i] == charT('^')
+           ? i + 1 : i;
+}
 
-    static void construct(string_t& s, record_d const& r
-                          , string_t& cache, bool verbose)
-    {
-        ostream_t strm;
-        strm.imbue(std::locale::classic());
-        derive::record_prefix(strm, r, cache);
-        if (verbose)
-        {
-            derive::record_debug(strm, r, cache);
-        }
-        derive::record_suffix(strm, r, cache);
-        s = strm.str();
-    }
+// Position after [align][0][width].
+template <class charT>
+constexpr std::size_t fmt_skip_width(charT const* f, std::size_t i)
+{
+    return fmt_skip_digits(f, f[fmt_skip_align(f, i)] == charT('0')
+                              ? fmt_skip_align(f, i) + 1
+                              : fmt_skip_align(f, i));
+}
 
-protected:
-    //
-    // [format] time (file, line, func) [level] #id message
-    //
+template <class charT>
+constexpr std::size_t fmt_skip_precision(charT const* f, std::size_t i)
+{
+    return f[i] == charT('.') ? fmt_skip_digits(f, i + 1) : i;
+}
 
-    // [prefix] time
-    static void record_prefix(ostream_t& strm
-                              , record const& r, string_t& /*cache*/)
-    {
-        format_time(strm, r);
-    }
+// Whether type (0: none) is available to the argument.
+template <class charT>
+constexpr bool fmt_type_ok(fmt_kind k, charT t)
+{
+    return t == charT('\0') ? k != fmt_kind::none
+    : t == charT('d') || t == charT('x') || t == charT('X')
+      || t == charT('o') || t == charT('b')
+    ? k == fmt_kind::signed_int || k == fmt_kind::unsigned_int
+      || k == fmt_kind::character || k == fmt_kind::boolean
+    : t == charT('c')
+    ? k == fmt_kind::signed_int || k == fmt_kind::unsigned_int
+      || k == fmt_kind::character
+    : t == charT('f') || t == charT('F') || t == charT('e')
+      || t == charT('E') || t == charT('g') || t == charT('G')
+    ? k == fmt_kind::floating
+    : t == charT('s') ? k == fmt_kind::string || k == fmt_kind::boolean
+    : t == charT('p') ? k == fmt_kind::pointer
+    : false;
+}
 
-    // [suffix] [level] #id message
-    static void record_suffix(ostream_t& strm
-                              , record const& r, string_t& cache);
+template <class charT>
+constexpr bool fmt_spec_ok(fmt_kind k, charT t, bool precision)
+{
+    return fmt_type_ok(k, t)
+           && (!precision || k == fmt_kind::floating
+               || k == fmt_kind::string);
+}
 
-    // [debug] (file, line, func)
-    static void record_debug(ostream_t& strm
-                             , record_d const& r, string_t& cache);
+template <class charT, class listT>
+constexpr int check_format(charT const* f, listT l, std::size_t i = 0
+                           , std::size_t arg = 0);
 
-protected:
-    static void format_time(ostream_t& strm, record const& r)
-    {
-        struct tm ti;
-#if defined(TINYLOG_WINDOWS_API)
-        ::localtime_s(&ti, &r.tv.tv_sec);
-#else
-        ::localtime_r(&r.tv.tv_sec, &ti);
-#endif // TINYLOG_WINDOWS_API
-        strm << std::setfill(strm.widen('0'))
-             << std::setw(4) << (ti.tm_year + 1900)
-             << strm.widen('-') << std::setw(2) << (ti.tm_mon + 1)
-             << strm.widen('-') << std::setw(2) << ti.tm_mday
-             << strm.widen(' ') << std::setw(2) << ti.tm_hour
-             << strm.widen(':') << std::setw(2) << ti.tm_min
-             << strm.widen(':') << std::setw(2) << ti.tm_sec
-             << strm.widen('.') << std::setw(6) << r.tv.tv_usec;
-    }
+template <class charT, class listT>
+constexpr int check_format_next(charT const* f, listT l, std::size_t i
+                                , std::size_t arg, bool ok)
+{
+    return ok ? check_format(f, l, i, arg) : fmt_bad_spec;
+}
 
-    static void end_with(ostream_t& strm, char_type delimiter)
-    {
-        auto const s = strm.str();
-        if (s.empty())
+// Spec ends at '}', t is the position of the type or the '}'.
+template <class charT, class listT>
+constexpr int check_format_spec(charT const* f, listT l, std::size_t t
+                                , std::size_t arg, bool precision)
+{
+    return f[t] == charT('}')
+           ? check_format_next(f, l, t + 1, arg + 1
+                               , fmt_spec_ok(fmt_kind_at(l, arg)
+                                             , charT('\0'), precision))
+           : f[t] != charT('\0') && f[t + 1] == charT('}')
+           ? check_format_next(f, l, t + 2, arg + 1
+                               , fmt_spec_ok(fmt_kind_at(l, arg)
+                                             , f[t], precision))
+           : fmt_bad_spec;
+}
+
+template <class charT, class listT>
+constexpr int check_format_field(charT const* f, listT l, std::size_t i
+                                 , std::size_t arg)
+{
+    return f[i] == charT('}')
+           ? (fmt_kind_at(l, arg) != fmt_kind::none
+              ? check_format(f, l, i + 1, arg + 1) : fmt_bad_arg)
+           : f[i] == charT(':')
+           ? (fmt_kind_at(l, arg) != fmt_kind::none
+              ? check_format_spec(f, l
+                                  , fmt_skip_precision(
+                                        f, fmt_skip_width(f, i + 1))
+                                  , arg
+                                  , f[fmt_skip_width(f, i + 1)]
+                                    == charT('.'))
+              : fmt_bad_arg)
+           : fmt_bad_spec;
+}
+
+template <class charT, class listT>
+constexpr int check_format_token(charT const* f, listT l, std::size_t i
+                                 , std::size_t arg)
+{
+    return f[i] == charT('\0')
+           ? (arg == fmt_kind_count(l) ? fmt_ok : fmt_too_many_args)
+           : f[i] == charT('}')
+           ? (f[i + 1] == charT('}') ? check_format(f, l, i + 2, arg)
+                                     : fmt_unmatched_brace)
+           : f[i + 1] == charT('{') ? check_format(f, l, i + 2, arg)
+           : arg >= fmt_kind_count(l) ? fmt_too_few_args
+           : check_format_field(f, l, i + 1, arg);
+}
+
+template <class charT, class listT>
+constexpr int check_format(charT const* f, listT l, std::size_t i
+                           , std::size_t arg)
+{
+    return check_format_token(f, l, fmt_skip_text(f, i), arg);
+}
+
+// Instantiated with the result of check_format, fails to compile if the
+// format does not match the arguments.
+template <int err>
+struct fmt_guard
+{
+    static_assert(err != fmt_too_few_args
+                  , "lfmt: more replacement fields than arguments.");
+    static_assert(err != fmt_too_many_args
+                  , "lfmt: more arguments than replacement fields.");
+    static_assert(err != fmt_unmatched_brace
+                  , "lfmt: unmatched '}' in format, use '}}'.");
+    static_assert(err != fmt_bad_spec
+                  , "lfmt: invalid format spec for the argument.");
+    static_assert(err != fmt_bad_arg
+                  , "lfmt: argument type is not supported.");
+};
+
+// Type erased argument.
+template <class charT>
+struct fmt_arg
+{
+    using char_type = charT;
+    using ostream_t = std::basic_ostream<char_type>;
+
+    fmt_kind kind;
+    union
+    {
+        bool b;
+        char_type c;
+        long long i;
+        unsigned long long u;
+        double d;
+        void const* p;
+        struct
         {
-            strm << delimiter;
-            return ;
-        }
-        if (*s.crbegin() != delimiter)
+            char_type const* data;
+            std::size_t size;
+        } s;
+        struct
         {
-            strm << delimiter;
-        }
-    }
+            void const* obj;
+            void (*write)(ostream_t&, void const*);
+        } custom;
+    };
 };
 
+template <class charT, class T>
+void fmt_write_custom(std::basic_ostream<charT>& os, void const* obj)
+{
+    os << *static_cast<T const*>(obj);
+}
+
 template <class charT>
-struct layout_constructor;
+charT fmt_widen(char c)
+{
+    return static_cast<charT>(static_cast<unsigned char>(c));
+}
 
-template <>
-struct layout_constructor<char>
-    : public layout_constructor_base<layout_constructor<char>, char>
+template <class charT, class T>
+fmt_arg<charT> make_fmt_arg(T const& v, std::integral_constant<
+                                fmt_kind, fmt_kind::boolean>)
 {
-    friend struct layout_constructor_base<layout_constructor<char>, char>;
+    fmt_arg<charT> a;
+    a.kind = fmt_kind::boolean;
+    a.b = v;
+    return a;
+}
 
-    using base = layout_constructor_base<layout_constructor<char>, char>;
+template <class charT, class T>
+fmt_arg<charT> make_fmt_arg(T const& v, std::integral_constant<
+                                fmt_kind, fmt_kind::character>)
+{
+    fmt_arg<charT> a;
+    a.kind = fmt_kind::character;
+    a.c = std::is_same<T, charT>::value
+          ? static_cast<charT>(v) : fmt_widen<charT>(static_cast<char>(v));
+    return a;
+}
 
-    static constexpr auto sep = TINYLOG_SEPARATOR;
-    static constexpr auto lf  = '\n';
+template <class charT, class T>
+fmt_arg<charT> make_fmt_arg(T const& v, std::integral_constant<
+                                fmt_kind, fmt_kind::signed_int>)
+{
+    fmt_arg<charT> a;
+    a.kind = fmt_kind::signed_int;
+    a.i = static_cast<long long>(v);
+    return a;
+}
 
-protected:
-    static void record_suffix(ostream_t& strm
-                              , record const& r, string_t& /*cache*/)
+template <class charT, class T>
+fmt_arg<charT> make_fmt_arg(T const& v, std::integral_constant<
+                                fmt_kind, fmt_kind::unsigned_int>)
+{
+    fmt_arg<charT> a;
+    a.kind = fmt_kind::unsigned_int;
+    a.u = static_cast<unsigned long long>(v);
+    return a;
+}
+
+template <class charT, class T>
+fmt_arg<charT> make_fmt_arg(T const& v, std::integral_constant<
+                                fmt_kind, fmt_kind::floating>)
+{
+    fmt_arg<charT> a;
+    a.kind = fmt_kind::floating;
+    a.d = static_cast<double>(v);
+    return a;
+}
+
+template <class charT>
+fmt_arg<charT> make_fmt_arg(charT const* v, std::integral_constant<
+                                fmt_kind, fmt_kind::string>)
+{
+    fmt_arg<charT> a;
+    a.kind = fmt_kind::string;
+    a.s.data = v;
+    a.s.size = v ? std::char_traits<charT>::length(v) : 0;
+    return a;
+}
+
+template <class charT>
+fmt_arg<charT> make_fmt_arg(std::basic_string<charT> const& v
+                            , std::integral_constant<
+                                fmt_kind, fmt_kind::string>)
+{
+    fmt_arg<charT> a;
+    a.kind = fmt_kind::string;
+    a.s.data = v.data();
+    a.s.size = v.size();
+    return a;
+}
+
+template <class charT, class T>
+fmt_arg<charT> make_fmt_arg(T const& v, std::integral_constant<
+                                fmt_kind, fmt_kind::pointer>)
+{
+    fmt_arg<charT> a;
+    a.kind = fmt_kind::pointer;
+    a.p = static_cast<void const*>(v);
+    return a;
+}
+
+template <class charT, class T>
+fmt_arg<charT> make_fmt_arg(T const& v, std::integral_constant<
+                                fmt_kind, fmt_kind::custom>)
+{
+    fmt_arg<charT> a;
+    a.kind = fmt_kind::custom;
+    a.custom.obj = &v;
+    a.custom.write = &fmt_write_custom<charT, T>;
+    return a;
+}
+
+template <class charT, class T>
+fmt_arg<charT> make_fmt_arg(T const& v)
+{
+    using kind_t = std::integral_constant<
+        fmt_kind, fmt_kind_of<charT, T>::value>;
+    return make_fmt_arg<charT>(v, kind_t());
+}
+
+template <class charT>
+struct fmt_spec
+{
+    charT align = charT('\0');
+    bool zero = false;
+    std::size_t width = 0;
+    int precision = -1;
+    charT type = charT('\0');
+};
+
+// Append s with the padding of spec, zeros are put after the first
+// prefix_len characters (i.e. sign).
+template <class charT>
+void fmt_append_padded(std::basic_string<charT>& out, charT const* s
+                       , std::size_t n, fmt_spec<charT> const& spec
+                       , charT default_align, std::size_t prefix_len = 0)
+{
+    if (spec.width <= n)
     {
-        strm << sep << "[" << to_string<char_type>(r.lvl) << "]"
-             << sep << "#" << r.id
-             << sep << r.message;
-        end_with(strm, lf);
+        out.append(s, n);
+        return;
     }
 
-    static void record_debug(ostream_t& strm
-                             , record_d const& r, string_t& /*cache*/)
+    auto const fill = spec.width - n;
+    if (spec.zero && spec.align == charT('\0'))
     {
-        strm << sep << "(" << r.file
-             << ", " << r.line << ", " << r.func << ")";
+        out.append(s, prefix_len);
+        out.append(fill, charT('0'));
+        out.append(s + prefix_len, n - prefix_len);
+        return;
     }
-};
 
-template <>
-struct layout_constructor<wchar_t>
-    : public layout_constructor_base<layout_constructor<wchar_t>, wchar_t>
+    auto const align = spec.align != charT('\0') ? spec.align : default_align;
+    auto const left = align == charT('<') ? 0
+                      : align == charT('^') ? fill / 2 : fill;
+    out.append(left, charT(' '));
+    out.append(s, n);
+    out.append(fill - left, charT(' '));
+}
+
+template <class charT>
+void fmt_append_int(std::basic_string<charT>& out, unsigned long long v
+                    , bool negative, fmt_spec<charT> const& spec)
 {
-    friend struct layout_constructor_base<layout_constructor<wchar_t>
-                                          , wchar_t>;
+    if (spec.type == charT('c'))
+    {
+        auto const c = static_cast<charT>(v);
+        fmt_append_padded(out, &c, 1, spec, charT('<'));
+        return;
+    }
 
-    using base = layout_constructor_base<layout_constructor<wchar_t>
-                                         , wchar_t>;
+    static char const digits[] = "0123456789abcdef0123456789ABCDEF";
+    auto const base = spec.type == charT('x') || spec.type == charT('X') ? 16u
+                      : spec.type == charT('o') ? 8u
+                      : spec.type == charT('b') ? 2u : 10u;
+    auto const table = spec.type == charT('X') ? digits + 16 : digits;
 
-    static constexpr auto sep = TINYLOG_SEPARATORW;
-    static constexpr auto lf  = L'\n';
+    charT buf[72];
+    auto end = buf + sizeof(buf) / sizeof(buf[0]);
+    auto p = end;
+    do
+    {
+        *--p = static_cast<charT>(table[v % base]);
+        v /= base;
+    } while (v != 0);
 
-protected:
-    static void record_prefix(ostream_t& strm
-                              , record const& r, string_t& /*cache*/)
+    if (negative)
     {
-        format_time(strm, r);
+        *--p = charT('-');
     }
+    fmt_append_padded(out, p, static_cast<std::size_t>(end - p), spec
+                      , charT('>'), negative ? 1 : 0);
+}
 
-    static void record_suffix(ostream_t& strm
-                              , record const& r, string_t& /*cache*/)
+template <class charT>
+void fmt_append_float(std::basic_string<charT>& out, double v
+                      , fmt_spec<charT> const& spec)
+{
+    char fmt[8] = { '%', '.', '*', static_cast<char>(
+                        spec.type != charT('\0') ? spec.type : charT('g')) };
+    auto const precision = spec.precision >= 0 ? spec.precision : 6;
+    char buf[128];
+    auto n = std::snprintf(buf, sizeof(buf), fmt, precision, v);
+    if (n < 0)
     {
-        strm << sep << L"[" << to_string<char_type>(r.lvl) << L"]"
-             << sep << L"#" << r.id
-             << sep << r.message;
-        end_with(strm, lf);
+        return;
     }
 
-    static void record_debug(ostream_t& strm
-                             , record_d const& r, string_t& /*cache*/)
+    std::string large;
+    char const* s = buf;
+    if (static_cast<std::size_t>(n) >= sizeof(buf))
     {
-        strm << sep << L"(" << r.file
-             << L", " << r.line << L", " << r.func << L")";
+        large.resize(static_cast<std::size_t>(n) + 1);
+        std::snprintf(&large[0], large.size(), fmt, precision, v);
+        s = large.data();
     }
-};
 
-template <class charT>
-struct endpage_constructor;
+    charT wbuf[128];
+    charT const* ws = wbuf;
+    std::basic_string<charT> wlarge;
+    auto const len = static_cast<std::size_t>(n);
+    if (len < sizeof(wbuf) / sizeof(wbuf[0]))
+    {
+        std::transform(s, s + len, wbuf, fmt_widen<charT>);
+    }
+    else
+    {
+        wlarge.resize(len);
+        std::transform(s, s + len, &wlarge[0], fmt_widen<charT>);
+        ws = wlarge.data();
+    }
+    auto const sign = len != 0 && (s[0] == '-' || s[0] == '+') ? 1 : 0;
+    fmt_append_padded(out, ws, len, spec, charT('>'), sign);
+}
 
-template <>
-struct endpage_constructor<char>
-    : public layout_constructor_base<endpage_constructor<char>, char>
+template <class charT>
+void fmt_append_arg(std::basic_string<charT>& out, fmt_arg<charT> const& a
+                    , fmt_spec<charT> const& spec)
 {
-    friend struct layout_constructor_base<endpage_constructor<char>, char>;
-
-    using base = layout_constructor_base<endpage_constructor<char>, char>;
-
-    static constexpr auto sep = TINYLOG_SEPARATOR;
-    static constexpr auto lf  = '\f';
+    static charT const true_str[] = { 't', 'r', 'u', 'e' };
+    static charT const false_str[] = { 'f', 'a', 'l', 's', 'e' };
+    static charT const null_str[] = { '(', 'n', 'u', 'l', 'l', ')' };
 
-protected:
-    static void record_prefix(ostream_t& strm
-                              , record const& r, string_t& cache)
+    switch (a.kind)
     {
-        if (cache.empty())
+    case fmt_kind::boolean:
+        if (spec.type != charT('\0') && spec.type != charT('s'))
         {
-            format_time(strm, r);
+            fmt_append_int(out, a.b ? 1 : 0, false, spec);
         }
-    }
-
-    static void record_suffix(ostream_t& strm
-                              , record const& r, string_t& cache)
-    {
-        if (cache.empty())
+        else if (a.b)
         {
-            strm << sep << "[" << to_string<char_type>(r.lvl) << "]"
-                 << sep << "#" << r.id << sep;
+            fmt_append_padded(out, true_str, 4, spec, charT('<'));
         }
+        else
+        {
+            fmt_append_padded(out, false_str, 5, spec, charT('<'));
+        }
+        break;
 
-        if (!r.message.empty() && (*r.message.crbegin() == lf))
+    case fmt_kind::character:
+        if (spec.type != charT('\0') && spec.type != charT('c'))
         {
-            strm << r.message.substr(0, r.message.size()-1) << std::endl;
-            cache.clear();
-            return ;
+            fmt_append_int(out, static_cast<unsigned long long>(
+                               static_cast<typename std::make_unsigned<
+                                   charT>::type>(a.c)), false, spec);
         }
-        else if (cache.empty())
+        else
         {
-            cache = { lf };
+            fmt_append_padded(out, &a.c, 1, spec, charT('<'));
         }
-        strm << r.message;
-    }
+        break;
 
-    static void record_debug(ostream_t& strm
-                             , record_d const& r, string_t& cache)
-    {
-        if (cache.empty())
+    case fmt_kind::signed_int:
         {
-            strm << sep << "(" << r.file
-                 << ", " << r.line << ", " << r.func << ")";
+            auto const u = static_cast<unsigned long long>(a.i);
+            fmt_append_int(out, a.i < 0 ? 0ull - u : u, a.i < 0, spec);
         }
-    }
-};
-
-template <>
-struct endpage_constructor<wchar_t>
-    : public layout_constructor_base<endpage_constructor<wchar_t>, wchar_t>
-{
-    friend struct layout_constructor_base<endpage_constructor<wchar_t>
-                                          , wchar_t>;
+        break;
 
-    using base = layout_constructor_base<endpage_constructor<wchar_t>, wchar_t>;
+    case fmt_kind::unsigned_int:
+        fmt_append_int(out, a.u, false, spec);
+        break;
 
-    static constexpr auto sep = TINYLOG_SEPARATORW;
-    static constexpr auto lf  = L'\f';
+    case fmt_kind::floating:
+        fmt_append_float(out, a.d, spec);
+        break;
 
-protected:
-    static void record_prefix(ostream_t& strm
-                              , record const& r, string_t& cache)
-    {
-        if (cache.empty())
+    case fmt_kind::string:
+        if (!a.s.data)
         {
-            format_time(strm, r);
+            fmt_append_padded(out, null_str, 6, spec, charT('<'));
         }
-    }
-
-    static void record_suffix(ostream_t& strm
-                              , record const& r, string_t& cache)
-    {
-        if (cache.empty())
+        else
         {
-            strm << sep << L"[" << to_string<char_type>(r.lvl) << L"]"
-                 << sep << L"#" << r.id << sep;
+            auto const n = spec.precision >= 0
+                           ? (std::min)(a.s.size, static_cast<std::size_t>(
+                                            spec.precision))
+                           : a.s.size;
+            fmt_append_padded(out, a.s.data, n, spec, charT('<'));
         }
+        break;
 
-        if (!r.message.empty() && (*r.message.crbegin() == lf))
+    case fmt_kind::pointer:
         {
-            strm << r.message.substr(0, r.message.size()-1) << std::endl;
-            cache.clear();
-            return ;
+            fmt_spec<charT> hex = spec;
+            hex.type = charT('x');
+            hex.width = 0;
+            auto const pos = out.size();
+            out.append(1, charT('0'));
+            out.append(1, charT('x'));
+            fmt_append_int(out, static_cast<unsigned long long>(
+                               reinterpret_cast<std::uintptr_t>(a.p))
+                           , false, hex);
+            if (spec.width > out.size() - pos)
+            {
+                auto const s = out.substr(pos);
+                out.resize(pos);
+                fmt_append_padded(out, s.data(), s.size(), spec, charT('>')
+                                  , 2);
+            }
         }
-        else if (cache.empty())
+        break;
+
+    case fmt_kind::custom:
         {
-            cache = { lf };
+            auto const pos = out.size();
+            {
+                basic_string_appendbuf<charT> sbuf;
+                sbuf.attach(&out);
+                std::basic_ostream<charT> os(&sbuf);
+                a.custom.write(os, a.custom.obj);
+            }
+            if (spec.width > out.size() - pos)
+            {
+                auto const s = out.substr(pos);
+                out.resize(pos);
+                fmt_append_padded(out, s.data(), s.size(), spec, charT('<'));
+            }
         }
-        strm << r.message;
-    }
+        break;
 
-    static void record_debug(ostream_t& strm
-                             , record_d const& r, string_t& cache)
+    default:
+        break;
+    }
+}
+
+// Format into out in a single pass. The format is checked before.
+template <class charT>
+void vformat(std::basic_string<charT>& out, charT const* fmt
+             , fmt_arg<charT> const* args, std::size_t arg_count)
+{
+    std::size_t arg = 0;
+    auto p = fmt;
+    while (*p != charT('\0'))
     {
-        if (cache.empty())
+        auto q = p;
+        while (fmt_is_text(*q))
+        {
+            ++q;
+        }
+        out.append(p, static_cast<std::size_t>(q - p));
+        p = q;
+
+        if (*p == charT('\0'))
+        {
+            break;
+        }
+
+        if (*p == charT('}') || p[1] == charT('{'))
+        {
+            out.push_back(*p);
+            p += p[1] == *p ? 2 : 1;
+            continue;
+        }
+
+        fmt_spec<charT> spec;
+        if (*++p == charT(':'))
+        {
+            ++p;
+            if (*p == charT('<') || *p == charT('>') || *p == charT('^'))
+            {
+                spec.align = *p++;
+            }
+            if (*p == charT('0'))
+            {
+                spec.zero = true;
+                ++p;
+            }
+            for (; *p >= charT('0') && *p <= charT('9'); ++p)
+            {
+                spec.width = spec.width * 10 + (*p - charT('0'));
+            }
+            if (*p == charT('.'))
+            {
+                spec.precision = 0;
+                for (++p; *p >= charT('0') && *p <= charT('9'); ++p)
+                {
+                    spec.precision = spec.precision * 10 + (*p - charT('0'));
+                }
+            }
+            if (*p != charT('}') && *p != charT('\0'))
+            {
+                spec.type = *p++;
+            }
+        }
+        while (*p != charT('}') && *p != charT('\0'))
+        {
+            ++p;
+        }
+        if (*p == charT('}'))
         {
-            strm << sep << L"(" << r.file
-                 << L", " << r.line << L", " << r.func << L")";
+            ++p;
+        }
+
+        if (arg < arg_count)
+        {
+            fmt_append_arg(out, args[arg++], spec);
         }
     }
-};
+}
 
-}  // namespace detail
+// Call site of a verbose statement, one static instance per call site, so
+// that records refer to it instead of copying (and converting) names.
+template <class charT>
+struct basic_source_location
+{
+    using char_type = charT;
+    using string_t  = std::basic_string<char_type>;
 
-/*****************************************************************************/
-/* Build Formatter：Use layout constructor generate log message string. */
+    char_type const* file;  // nullptr: not verbose
+    std::size_t line;
+    string_t func;
+};
 
-struct default_layout
+// Static description of a [w]lfmt statement, one per call site.
+template <class charT>
+struct basic_fmt_site
 {
-    template <class stringT, class recordT>
-    static void to_string(stringT& s, recordT const& r
-                          , stringT& cache, bool verbose)
-    {
-        using char_type = typename stringT::value_type;
-        detail::layout_constructor<char_type>::construct(s, r, cache, verbose);
-    }
+    charT const* fmt;
+    basic_source_location<charT> loc;
 };
 
-// Log record breaks when message contains form feed (i.e. \f).
-//
-// loading......ok
-// e.g.
-//   lout(info) << "loading......";
-//   lout(info) << "ok\f";
-//
-// @warn non-thread-safe.
-struct endpage_layout
+// Format and arguments of a [w]lfmt record, valid while the record is
+// written synchronously.
+template <class charT>
+struct basic_fmt_payload
 {
-    template <class stringT, class recordT>
-    static void to_string(stringT& s, recordT const& r
-                          , stringT& cache, bool verbose)
-    {
-        using char_type = typename stringT::value_type;
-        detail::endpage_constructor<char_type>::construct(s, r, cache, verbose);
-    }
+    basic_fmt_site<charT> const* site;
+    fmt_arg<charT> const* args;
+    std::size_t arg_count;
 };
 
-template <class charT, class layoutT = default_layout>
-struct formatter
+}  // namespace detail
+
+/*****************************************************************************/
+/* Record Entry. */
+
+namespace detail
+{
+
+// Structured fields of a record, added by kv(key, value) of [w]lout. Keys
+// and texts share one buffer and the first fields are kept inline, so a
+// reused record doesn't allocate.
+template <class charT>
+class basic_kv_fields
 {
 public:
     using char_type = charT;
-    using string_t = std::basic_string<char_type>;
+    using string_t  = std::basic_string<char_type>;
+
+    static constexpr std::size_t inline_count = 4;
+
+    // Numbers and booleans keep their type, other values are kept as the
+    // text lfmt writes (kind string).
+    struct field
+    {
+        fmt_kind kind;
+        std::size_t key;        // offset in text
+        std::size_t key_size;
+        std::size_t text;
+        std::size_t text_size;
+        union
+        {
+            bool b;
+            long long i;
+            unsigned long long u;
+            double d;
+        };
+    };
 
 public:
-    template <class recordT
-              , typename std::enable_if<
-                    std::is_same<typename recordT::char_type, char_type>::value
-                    , int>::type = 0>
-    typename recordT::string_t format(recordT const& r, bool verbose)
+    template <class T>
+    void add(char_type const* key, std::size_t key_size, T const& value)
     {
-        typename recordT::string_t s;
-        layoutT::to_string(s, r, cache_, verbose);
-        return s;
+        using kind_t = std::integral_constant<
+            fmt_kind, fmt_kind_of<charT, T>::value>;
+        static_assert(kind_t::value != fmt_kind::none
+                      , "kv: value type is not supported.");
+        set(push(key, key_size), make_fmt_arg<charT>(value, kind_t()));
     }
 
-    // String charset convertion is needed.
-    template <class recordT
-              , typename std::enable_if<
-                    !std::is_same<typename recordT::char_type, char_type>::value
-                    , int>::type = 0>
-    typename recordT::string_t format(recordT const& r, bool verbose)
+    // Add a field of an argument already captured, e.g. read back from a
+    // binary log.
+    void add_arg(char_type const* key, std::size_t key_size
+                 , fmt_arg<charT> const& a)
     {
-        typename recordT::string_t s, cache;
-        string_traits<>::convert(cache, cache_);
-        layoutT::to_string(s, r, cache, verbose);
-        string_traits<>::convert(cache_, cache);
-        return s;
+        set(push(key, key_size), a);
+    }
+
+    void clear()
+    {
+        text_.clear();
+        spill_.clear();
+        size_ = 0;
+    }
+
+    void swap(basic_kv_fields& other)
+    {
+        for (std::size_t i = 0; i != inline_count; ++i)
+        {
+            std::swap(inline_[i], other.inline_[i]);
+        }
+        spill_.swap(other.spill_);
+        text_.swap(other.text_);
+        std::swap(size_, other.size_);
+    }
+
+    // Convert fields of the other char type.
+    template <class fromCharT>
+    void assign(basic_kv_fields<fromCharT> const& from)
+    {
+        clear();
+
+        // Kept by the thread, converting doesn't allocate once warm.
+        static thread_local std::basic_string<fromCharT> piece;
+        static thread_local string_t s;
+        for (auto const& f : from)
+        {
+            piece.assign(from.key(f), f.key_size);
+            string_traits<>::convert(s, piece);
+            auto& to = push(s.data(), s.size());
+            to.kind = f.kind;
+            to.u    = f.u;
+            if (f.kind == fmt_kind::string)
+            {
+                piece.assign(from.text(f), f.text_size);
+                string_traits<>::convert(s, piece);
+                to.text = text_.size();
+                to.text_size = s.size();
+                text_.append(s);
+            }
+        }
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    field const* begin() const
+    {
+        return data();
+    }
+
+    field const* end() const
+    {
+        return data() + size_;
+    }
+
+    char_type const* key(field const& f) const
+    {
+        return text_.data() + f.key;
+    }
+
+    // Text of a string field.
+    char_type const* text(field const& f) const
+    {
+        return text_.data() + f.text;
     }
 
 private:
-    string_t cache_;
+    field const* data() const
+    {
+        return size_ <= inline_count ? inline_ : spill_.data();
+    }
+
+    field& push(char_type const* key, std::size_t key_size)
+    {
+        field* f = nullptr;
+        if (size_ < inline_count)
+        {
+            f = &inline_[size_];
+        }
+        else
+        {
+            if (size_ == inline_count)
+            {
+                spill_.assign(inline_, inline_ + inline_count);
+            }
+            spill_.emplace_back();
+            f = &spill_.back();
+        }
+        ++size_;
+
+        f->key = text_.size();
+        f->key_size = key_size;
+        f->text = 0;
+        f->text_size = 0;
+        text_.append(key, key_size);
+        return *f;
+    }
+
+    void set(field& f, fmt_arg<charT> const& a)
+    {
+        f.kind = a.kind;
+        switch (a.kind)
+        {
+        case fmt_kind::boolean:
+            f.u = 0;
+            f.b = a.b;
+            break;
+        case fmt_kind::signed_int:
+            f.i = a.i;
+            break;
+        case fmt_kind::unsigned_int:
+            f.u = a.u;
+            break;
+        case fmt_kind::floating:
+            f.d = a.d;
+            break;
+        default:
+            f.kind = fmt_kind::string;
+            f.u = 0;
+            f.text = text_.size();
+            fmt_append_arg(text_, a, fmt_spec<charT>());
+            f.text_size = text_.size() - f.text;
+            break;
+        }
+    }
+
+private:
+    field inline_[inline_count] = {};
+    std::vector<field> spill_;
+    std::size_t size_ = 0;
+    string_t text_;
 };
 
-/*****************************************************************************/
-/* Colors Support in Terminal Output. */
+}  // namespace detail
 
-namespace detail
+template <class charT>
+struct basic_record
 {
+    using self      = basic_record<charT>;
+    using char_type = charT;
+    using string_t  = std::basic_string<char_type>;
 
-enum class foreground
-{
-#if defined(TINYLOG_WINDOWS_API)
+    explicit basic_record(detail::time_value const& t, level l
+                          , std::uintmax_t thrd_id, string_t const& m)
+        : tv(t), lvl(l), id(thrd_id), message(m)
+    {}
 
-    white       = FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_RED
-    , cyan      = FOREGROUND_BLUE | FOREGROUND_GREEN
-    , green     = FOREGROUND_GREEN
-    , yellow    = FOREGROUND_GREEN | FOREGROUND_RED
-    , red       = FOREGROUND_RED
+    explicit basic_record(level l, string_t const& m)
+        : self(detail::curr_time(), l, detail::curr_thrd_id(), m)
+    {}
 
-#else
+    explicit basic_record(level l)
+        : tv(detail::curr_time()), lvl(l), id(detail::curr_thrd_id())
+    {}
 
-    white       = 37
-    , cyan      = 36
-    , green     = 32
-    , yellow    = 33
-    , red       = 31
+    basic_record() : tv(), lvl(level::trace), id(0)
+    {}
 
-#endif  // TINYLOG_WINDOWS_API
+    detail::time_value  tv;
+    level               lvl;
+    std::uintmax_t      id;
+    string_t            message;
+
+    // Format and arguments of the message written by [w]lfmt, nullptr if
+    // not available (e.g. queued by an async logger).
+    detail::basic_fmt_payload<charT> const* payload = nullptr;
+
+    // Time read by the logging thread, converted into tv by the logger
+    // before sinks are called.
+    detail::raw_time    stamp;
+
+    // Structured fields, e.g. lout(info).kv("user", id) << "login".
+    detail::basic_kv_fields<charT> fields;
 };
 
-enum class background
+using record  = basic_record<char>;
+using wrecord = basic_record<wchar_t>;
+
+template <class charT>
+struct basic_record_d : public basic_record<charT>
 {
-#if defined(TINYLOG_WINDOWS_API)
+    using base      = basic_record<charT>;
+    using self      = basic_record_d<charT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
 
-    white       = BACKGROUND_BLUE | BACKGROUND_GREEN | BACKGROUND_RED
-    , cyan      = BACKGROUND_BLUE | BACKGROUND_GREEN
-    , green     = BACKGROUND_GREEN
-    , yellow    = BACKGROUND_GREEN | BACKGROUND_RED
-    , red       = BACKGROUND_RED
+    explicit basic_record_d(detail::time_value const& t, level l
+                            , std::uintmax_t thrd_id, string_t const& m
+                            , string_t const& fn, std::size_t ln
+                            , string_t const& fun)
+        : base(t, l, thrd_id, m), file(fn), line(ln), func(fun)
+    {}
 
-#else
+    explicit basic_record_d(level l, string_t const& m
+                            , string_t const& fn, std::size_t ln
+                            , string_t const& fun)
+        : base(l, m), file(fn), line(ln), func(fun)
+    {}
 
-    white       = 47
-    , cyan      = 46
-    , green     = 42
-    , yellow    = 43
-    , red       = 41
+    explicit basic_record_d(level l
+                            , string_t const& fn, std::size_t ln
+                            , string_t const& fun)
+        : base(l), file(fn), line(ln), func(fun)
+    {}
+
+    explicit basic_record_d(level l
+                            , detail::basic_source_location<charT> const& loc)
+        : base(l), line(0), location(&loc)
+    {}
+
+    basic_record_d() : line(0)
+    {}
+
+    // Call site, from location if it is set.
+    char_type const* file_name() const
+    {
+        return location ? location->file : file.c_str();
+    }
+
+    std::size_t line_number() const
+    {
+        return location ? location->line : line;
+    }
+
+    string_t const& func_name() const
+    {
+        return location ? location->func : func;
+    }
+
+    string_t        file;
+    std::size_t     line;
+    string_t        func;
+
+    // Static call site of the statement, file, line and func are left
+    // empty if it is set.
+    detail::basic_source_location<charT> const* location = nullptr;
+};
+
+using record_d = basic_record_d<char>;
+using wrecord_d = basic_record_d<wchar_t>;
+
+namespace detail
+{
+
+// Stamp r with the time of clock.
+template <class charT>
+void stamp_record(basic_record<charT>& r, clock_source clock)
+{
+    r.stamp = read_clock(clock);
+    if (r.stamp.clock == clock_source::none)
+    {
+        r.tv = { 0, 0 };
+    }
+}
+
+// Convert the stamp of r into tv.
+template <class charT>
+void resolve_time(basic_record<charT>& r)
+{
+    if (r.stamp.clock != clock_source::none)
+    {
+        r.tv = to_time_value(r.stamp);
+        r.stamp = raw_time();
+    }
+}
+
+struct time_resolver
+{
+    template <class recordT>
+    void operator()(recordT& r) const
+    {
+        resolve_time(r);
+    }
+};
+
+// Records without time, clock_source::none.
+inline bool has_time(time_value const& tv)
+{
+    return tv.tv_sec != 0 || tv.tv_usec != 0;
+}
+
+}  // namespace detail
+
+// Records handed over to a sink at once, e.g. drained from an async queue.
+template <class charT>
+struct basic_record_span
+{
+    struct item
+    {
+        basic_record<charT> const* record;
+        bool detailed;  // record is basic_record_d
+    };
+
+    item const* begin() const
+    {
+        return data;
+    }
+
+    item const* end() const
+    {
+        return data + size;
+    }
+
+    item const* data;
+    std::size_t size;
+};
+
+/*****************************************************************************/
+/* Build Layout: Convert record entry to log message string. */
+
+namespace detail
+{
+
+// Stack storage that spills to the heap.
+template <class charT, std::size_t N = 512>
+class basic_memory_buffer
+{
+public:
+    using char_type = charT;
+    using traits    = std::char_traits<char_type>;
+
+public:
+    basic_memory_buffer() = default;
+    basic_memory_buffer(basic_memory_buffer const&) = delete;
+    basic_memory_buffer& operator=(basic_memory_buffer const&) = delete;
+
+    void push_back(char_type c)
+    {
+        reserve(size_ + 1);
+        ptr_[size_++] = c;
+    }
+
+    void append(char_type const* s, std::size_t n)
+    {
+        reserve(size_ + n);
+        traits::copy(ptr_ + size_, s, n);
+        size_ += n;
+    }
+
+    void append(char_type const* s)
+    {
+        append(s, traits::length(s));
+    }
+
+    void append(std::basic_string<char_type> const& s)
+    {
+        append(s.data(), s.size());
+    }
+
+    char_type const* data() const
+    {
+        return ptr_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    // @attention Undefined if empty.
+    char_type back() const
+    {
+        return ptr_[size_ - 1];
+    }
+
+    void clear()
+    {
+        size_ = 0;
+    }
+
+private:
+    void reserve(std::size_t n)
+    {
+        if (n <= capacity_)
+        {
+            return ;
+        }
+
+        auto const cap = (std::max)(n, capacity_ * 2);
+        std::unique_ptr<char_type[]> heap(new char_type[cap]);
+        traits::copy(heap.get(), ptr_, size_);
+        heap_.swap(heap);
+        ptr_ = heap_.get();
+        capacity_ = cap;
+    }
+
+private:
+    char_type inline_[N];
+    std::unique_ptr<char_type[]> heap_;
+    char_type* ptr_ = inline_;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = N;
+};
+
+// Write decimal integer, padded with zeros to width.
+template <class bufferT, class uintT>
+void write_uint(bufferT& buf, uintT v, std::size_t width = 0)
+{
+    using char_type = typename bufferT::char_type;
+    static_assert(std::is_unsigned<uintT>::value, "unsigned integer expected");
+
+    char_type digits[std::numeric_limits<uintT>::digits10 + 1];
+    std::size_t n = 0;
+    do
+    {
+        digits[n++] = static_cast<char_type>('0' + v % 10);
+        v /= 10;
+    } while (v);
+
+    for (; width > n; --width)
+    {
+        buf.push_back(char_type('0'));
+    }
+    while (n)
+    {
+        buf.push_back(digits[--n]);
+    }
+}
+
+// Rendered "YYYY-MM-DD HH:MM:SS." of the last second, per thread.
+template <class charT>
+class time_prefix
+{
+public:
+    static constexpr std::size_t size = 20;
+
+    static time_prefix& instance()
+    {
+        static thread_local time_prefix prefix;
+        return prefix;
+    }
+
+    charT const* get(std::time_t sec)
+    {
+        auto const epoch = timezone_epoch().load(std::memory_order_relaxed);
+        if (sec != sec_ || epoch != epoch_ || !valid_)
+        {
+            render(sec);
+            sec_   = sec;
+            epoch_ = epoch;
+            valid_ = true;
+        }
+        return text_;
+    }
+
+private:
+    void render(std::time_t sec)
+    {
+        struct tm ti;
+        local_time(sec, ti);
+
+        text_buffer buf{ text_, 0 };
+        write_uint(buf, static_cast<unsigned>(ti.tm_year + 1900), 4);
+        buf.push_back(charT('-'));
+        write_uint(buf, static_cast<unsigned>(ti.tm_mon + 1), 2);
+        buf.push_back(charT('-'));
+        write_uint(buf, static_cast<unsigned>(ti.tm_mday), 2);
+        buf.push_back(charT(' '));
+        write_uint(buf, static_cast<unsigned>(ti.tm_hour), 2);
+        buf.push_back(charT(':'));
+        write_uint(buf, static_cast<unsigned>(ti.tm_min), 2);
+        buf.push_back(charT(':'));
+        write_uint(buf, static_cast<unsigned>(ti.tm_sec), 2);
+        buf.push_back(charT('.'));
+    }
+
+    // Years beyond 9999 are truncated.
+    struct text_buffer
+    {
+        using char_type = charT;
+
+        void push_back(char_type c)
+        {
+            if (n != size)
+            {
+                p[n++] = c;
+            }
+        }
+
+        char_type* p;
+        std::size_t n;
+    };
+
+private:
+    charT text_[size];
+    std::time_t sec_ = 0;
+    std::size_t epoch_ = 0;
+    bool valid_ = false;
+};
+
+template <class charT>
+constexpr std::size_t time_prefix<charT>::size;
+
+inline char const* separator(char const*)
+{
+    return TINYLOG_SEPARATOR;
+}
+
+inline wchar_t const* separator(wchar_t const*)
+{
+    return TINYLOG_SEPARATORW;
+}
+
+// Construct messages by ostream, for layouts that need its formatting.
+template <class deriveT, class charT>
+struct layout_constructor_base
+{
+    using derive     = deriveT;
+    using char_type  = charT;
+    using string_t   = std::basic_string<char_type>;
+    using ostream_t  = std::basic_ostringstream<char_type>;
+    using record     = basic_record<char_type>;
+    using record_d   = basic_record_d<char_type>;
+
+    static void construct(string_t& s, record const& r
+                          , string_t& cache, bool /*verbose*/)
+    {
+        ostream_t strm;
+        strm.imbue(std::locale::classic());
+        derive::record_prefix(strm, r, cache);
+        derive::record_suffix(strm, r, cache);
+        s = strm.str();
+    }
+
+    static void construct(string_t& s, record_d const& r
+                          , string_t& cache, bool verbose)
+    {
+        ostream_t strm;
+        strm.imbue(std::locale::classic());
+        derive::record_prefix(strm, r, cache);
+        if (verbose)
+        {
+            derive::record_debug(strm, r, cache);
+        }
+        derive::record_suffix(strm, r, cache);
+        s = strm.str();
+    }
+
+protected:
+    //
+    // [format] time (file, line, func) [level] #id message
+    //
+
+    // [prefix] time
+    static void record_prefix(ostream_t& strm
+                              , record const& r, string_t& /*cache*/)
+    {
+        format_time(strm, r);
+    }
+
+    // [suffix] [level] #id message
+    static void record_suffix(ostream_t& strm
+                              , record const& r, string_t& cache);
+
+    // [debug] (file, line, func)
+    static void record_debug(ostream_t& strm
+                             , record_d const& r, string_t& cache);
+
+protected:
+    static void format_time(ostream_t& strm, record const& r)
+    {
+        if (!has_time(r.tv))
+        {
+            return ;
+        }
+
+        struct tm ti;
+        local_time(r.tv.tv_sec, ti);
+        strm << std::setfill(strm.widen('0'))
+             << std::setw(4) << (ti.tm_year + 1900)
+             << strm.widen('-') << std::setw(2) << (ti.tm_mon + 1)
+             << strm.widen('-') << std::setw(2) << ti.tm_mday
+             << strm.widen(' ') << std::setw(2) << ti.tm_hour
+             << strm.widen(':') << std::setw(2) << ti.tm_min
+             << strm.widen(':') << std::setw(2) << ti.tm_sec
+             << strm.widen('.') << std::setw(6) << r.tv.tv_usec;
+    }
+
+    static void end_with(ostream_t& strm, char_type delimiter)
+    {
+        auto const s = strm.str();
+        if (s.empty())
+        {
+            strm << delimiter;
+            return ;
+        }
+        if (*s.crbegin() != delimiter)
+        {
+            strm << delimiter;
+        }
+    }
+};
+
+// Structured fields and the JSON / logfmt text of records.
+
+template <class bufferT>
+void write_ascii(bufferT& buf, char const* s)
+{
+    using char_type = typename bufferT::char_type;
+    for (; *s != '\0'; ++s)
+    {
+        buf.push_back(static_cast<char_type>(*s));
+    }
+}
+
+template <class bufferT>
+void write_int(bufferT& buf, long long v)
+{
+    auto const u = static_cast<unsigned long long>(v);
+    if (v < 0)
+    {
+        buf.push_back(typename bufferT::char_type('-'));
+        write_uint(buf, 0ull - u);
+        return ;
+    }
+    write_uint(buf, u);
+}
+
+// Shorter of %.15g and %.17g that reads back the same value.
+template <class bufferT>
+void write_double(bufferT& buf, double v)
+{
+    char s[32];
+    auto n = std::snprintf(s, sizeof(s), "%.15g", v);
+    if (n > 0 && std::isfinite(v) && std::strtod(s, nullptr) != v)
+    {
+        n = std::snprintf(s, sizeof(s), "%.17g", v);
+    }
+    if (n > 0)
+    {
+        write_ascii(buf, s);
+    }
+}
+
+// Escape as a JSON string body: quote, backslash and control characters.
+template <class bufferT, class charT>
+void write_escaped(bufferT& buf, charT const* s, std::size_t n)
+{
+    using uchar_t = typename std::make_unsigned<charT>::type;
+    static char const hex[] = "0123456789abcdef";
+
+    auto const e = s + n;
+    while (s != e)
+    {
+        auto p = s;
+        while (p != e && static_cast<uchar_t>(*p) >= 0x20
+               && *p != charT('"') && *p != charT('\\'))
+        {
+            ++p;
+        }
+        buf.append(s, static_cast<std::size_t>(p - s));
+        if (p == e)
+        {
+            break;
+        }
+
+        auto const c = static_cast<uchar_t>(*p);
+        buf.push_back(charT('\\'));
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            buf.push_back(static_cast<charT>(c));
+            break;
+        case '\n':
+            buf.push_back(charT('n'));
+            break;
+        case '\r':
+            buf.push_back(charT('r'));
+            break;
+        case '\t':
+            buf.push_back(charT('t'));
+            break;
+        default:
+            write_ascii(buf, "u00");
+            buf.push_back(static_cast<charT>(hex[c >> 4]));
+            buf.push_back(static_cast<charT>(hex[c & 0xf]));
+            break;
+        }
+        s = p + 1;
+    }
+}
+
+// Quoted if empty or it has spaces, '=', quotes or control characters.
+template <class bufferT, class charT>
+void write_logfmt_text(bufferT& buf, charT const* s, std::size_t n)
+{
+    using uchar_t = typename std::make_unsigned<charT>::type;
+
+    auto const plain = n != 0 && std::none_of(
+        s, s + n, [](charT c)
+                  {
+                      return static_cast<uchar_t>(c) <= 0x20
+                             || c == charT('=') || c == charT('"')
+                             || c == charT('\\');
+                  });
+    if (plain)
+    {
+        buf.append(s, n);
+        return ;
+    }
+    buf.push_back(charT('"'));
+    write_escaped(buf, s, n);
+    buf.push_back(charT('"'));
+}
+
+// Key of a logfmt field, characters ending a key are written as '_' and
+// an empty key as "_", so the line always parses back.
+template <class bufferT, class charT>
+void write_logfmt_key(bufferT& buf, charT const* s, std::size_t n)
+{
+    using uchar_t = typename std::make_unsigned<charT>::type;
+
+    if (n == 0)
+    {
+        buf.push_back(charT('_'));
+        return ;
+    }
+    auto const e = s + n;
+    while (s != e)
+    {
+        auto p = s;
+        while (p != e && static_cast<uchar_t>(*p) > 0x20
+               && *p != charT('=') && *p != charT('"') && *p != charT('\\'))
+        {
+            ++p;
+        }
+        buf.append(s, static_cast<std::size_t>(p - s));
+        if (p == e)
+        {
+            break;
+        }
+        buf.push_back(charT('_'));
+        s = p + 1;
+    }
+}
+
+template <class bufferT, class charT>
+void write_number(bufferT& buf, typename basic_kv_fields<charT>::field const& f)
+{
+    switch (f.kind)
+    {
+    case fmt_kind::boolean:
+        write_ascii(buf, f.b ? "true" : "false");
+        break;
+    case fmt_kind::signed_int:
+        write_int(buf, f.i);
+        break;
+    case fmt_kind::unsigned_int:
+        write_uint(buf, f.u);
+        break;
+    case fmt_kind::floating:
+        write_double(buf, f.d);
+        break;
+    default:
+        break;
+    }
+}
+
+// ,"key":value...
+template <class bufferT, class charT>
+void write_json_fields(bufferT& buf, basic_kv_fields<charT> const& fields)
+{
+    for (auto const& f : fields)
+    {
+        buf.push_back(charT(','));
+        buf.push_back(charT('"'));
+        write_escaped(buf, fields.key(f), f.key_size);
+        buf.push_back(charT('"'));
+        buf.push_back(charT(':'));
+        if (f.kind == fmt_kind::string)
+        {
+            buf.push_back(charT('"'));
+            write_escaped(buf, fields.text(f), f.text_size);
+            buf.push_back(charT('"'));
+        }
+        else if (f.kind == fmt_kind::floating && !std::isfinite(f.d))
+        {
+            // JSON has no NaN or infinity, written as strings.
+            write_ascii(buf, std::isnan(f.d) ? "\"NaN\""
+                             : f.d > 0 ? "\"Infinity\"" : "\"-Infinity\"");
+        }
+        else
+        {
+            write_number<bufferT, charT>(buf, f);
+        }
+    }
+}
+
+// " key=value"...
+template <class bufferT, class charT>
+void write_logfmt_fields(bufferT& buf, basic_kv_fields<charT> const& fields)
+{
+    for (auto const& f : fields)
+    {
+        buf.push_back(charT(' '));
+        write_logfmt_key(buf, fields.key(f), f.key_size);
+        buf.push_back(charT('='));
+        if (f.kind == fmt_kind::string)
+        {
+            write_logfmt_text(buf, fields.text(f), f.text_size);
+        }
+        else
+        {
+            write_number<bufferT, charT>(buf, f);
+        }
+    }
+}
+
+// YYYY-MM-DDTHH:MM:SS.uuuuuu in local time.
+template <class bufferT>
+void write_iso_time(bufferT& buf, time_value const& tv)
+{
+    using char_type = typename bufferT::char_type;
+
+    auto& prefix = time_prefix<char_type>::instance();
+    auto const p = prefix.get(tv.tv_sec);
+    buf.append(p, 10);
+    buf.push_back(char_type('T'));
+    buf.append(p + 11, prefix.size - 11);
+    write_uint(buf, tv.tv_usec, 6);
+}
+
+// Message without the line feed closing it.
+template <class charT>
+std::size_t message_size(basic_record<charT> const& r)
+{
+    auto const n = r.message.size();
+    return n != 0 && r.message[n - 1] == charT('\n') ? n - 1 : n;
+}
+
+template <class charT>
+struct layout_constructor
+{
+    using char_type  = charT;
+    using string_t   = std::basic_string<char_type>;
+    using buffer_t   = basic_memory_buffer<char_type>;
+    using record     = basic_record<char_type>;
+    using record_d   = basic_record_d<char_type>;
+
+    static void construct(string_t& s, record const& r
+                          , string_t& /*cache*/, bool /*verbose*/)
+    {
+        buffer_t buf;
+        record_prefix(buf, r);
+        record_suffix(buf, r);
+        s.assign(buf.data(), buf.size());
+    }
+
+    static void construct(string_t& s, record_d const& r
+                          , string_t& /*cache*/, bool verbose)
+    {
+        buffer_t buf;
+        record_prefix(buf, r);
+        if (verbose)
+        {
+            record_debug(buf, r);
+        }
+        record_suffix(buf, r);
+        s.assign(buf.data(), buf.size());
+    }
+
+private:
+    //
+    // [format] time (file, line, func) [level] #id message
+    //
+
+    // [prefix] time
+    static void record_prefix(buffer_t& buf, record const& r)
+    {
+        if (!has_time(r.tv))
+        {
+            return ;
+        }
+
+        auto& prefix = time_prefix<char_type>::instance();
+        buf.append(prefix.get(r.tv.tv_sec), prefix.size);
+        write_uint(buf, r.tv.tv_usec, 6);
+    }
+
+    // [suffix] [level] #id message
+    static void record_suffix(buffer_t& buf, record const& r)
+    {
+        auto const sep = separator(static_cast<char_type const*>(nullptr));
+
+        if (!buf.empty())
+        {
+            buf.append(sep);
+        }
+        buf.push_back(char_type('['));
+        buf.append(level_name<char_type>(r.lvl));
+        buf.push_back(char_type(']'));
+        buf.append(sep);
+        buf.push_back(char_type('#'));
+        write_uint(buf, r.id);
+        buf.append(sep);
+        if (r.fields.empty())
+        {
+            buf.append(r.message);
+            if (buf.back() != char_type('\n'))
+            {
+                buf.push_back(char_type('\n'));
+            }
+            return ;
+        }
+        buf.append(r.message.data(), message_size(r));
+        write_logfmt_fields(buf, r.fields);
+        buf.push_back(char_type('\n'));
+    }
+
+    // [debug] (file, line, func)
+    static void record_debug(buffer_t& buf, record_d const& r)
+    {
+        if (!buf.empty())
+        {
+            buf.append(separator(static_cast<char_type const*>(nullptr)));
+        }
+        buf.push_back(char_type('('));
+        buf.append(r.file_name());
+        buf.push_back(char_type(','));
+        buf.push_back(char_type(' '));
+        write_uint(buf, r.line_number());
+        buf.push_back(char_type(','));
+        buf.push_back(char_type(' '));
+        buf.append(r.func_name());
+        buf.push_back(char_type(')'));
+    }
+};
+
+// {"time":"...","level":"INFO","thread":1,"file":"...","line":1
+// ,"func":"...","msg":"...","key":value...}
+template <class charT>
+struct json_constructor
+{
+    using char_type  = charT;
+    using string_t   = std::basic_string<char_type>;
+    using buffer_t   = basic_memory_buffer<char_type>;
+    using record     = basic_record<char_type>;
+    using record_d   = basic_record_d<char_type>;
+
+    static void construct(string_t& s, record const& r
+                          , string_t& /*cache*/, bool /*verbose*/)
+    {
+        buffer_t buf;
+        record_prefix(buf, r);
+        record_suffix(buf, r);
+        s.assign(buf.data(), buf.size());
+    }
+
+    static void construct(string_t& s, record_d const& r
+                          , string_t& /*cache*/, bool verbose)
+    {
+        buffer_t buf;
+        record_prefix(buf, r);
+        if (verbose)
+        {
+            record_debug(buf, r);
+        }
+        record_suffix(buf, r);
+        s.assign(buf.data(), buf.size());
+    }
+
+private:
+    static void record_prefix(buffer_t& buf, record const& r)
+    {
+        buf.push_back(char_type('{'));
+        if (has_time(r.tv))
+        {
+            write_ascii(buf, "\"time\":\"");
+            write_iso_time(buf, r.tv);
+            write_ascii(buf, "\",");
+        }
+        write_ascii(buf, "\"level\":\"");
+        buf.append(level_name<char_type>(r.lvl));
+        write_ascii(buf, "\",\"thread\":");
+        write_uint(buf, r.id);
+    }
+
+    static void record_suffix(buffer_t& buf, record const& r)
+    {
+        write_ascii(buf, ",\"msg\":\"");
+        write_escaped(buf, r.message.data(), message_size(r));
+        buf.push_back(char_type('"'));
+        write_json_fields(buf, r.fields);
+        buf.push_back(char_type('}'));
+        buf.push_back(char_type('\n'));
+    }
+
+    static void record_debug(buffer_t& buf, record_d const& r)
+    {
+        auto const file = r.file_name();
+        auto const& func = r.func_name();
+
+        write_ascii(buf, ",\"file\":\"");
+        write_escaped(buf, file, std::char_traits<char_type>::length(file));
+        write_ascii(buf, "\",\"line\":");
+        write_uint(buf, r.line_number());
+        write_ascii(buf, ",\"func\":\"");
+        write_escaped(buf, func.data(), func.size());
+        buf.push_back(char_type('"'));
+    }
+};
+
+// time=... level=INFO thread=1 file=... line=1 func=... msg=... key=value...
+template <class charT>
+struct logfmt_constructor
+{
+    using char_type  = charT;
+    using string_t   = std::basic_string<char_type>;
+    using buffer_t   = basic_memory_buffer<char_type>;
+    using record     = basic_record<char_type>;
+    using record_d   = basic_record_d<char_type>;
+
+    static void construct(string_t& s, record const& r
+                          , string_t& /*cache*/, bool /*verbose*/)
+    {
+        buffer_t buf;
+        record_prefix(buf, r);
+        record_suffix(buf, r);
+        s.assign(buf.data(), buf.size());
+    }
+
+    static void construct(string_t& s, record_d const& r
+                          , string_t& /*cache*/, bool verbose)
+    {
+        buffer_t buf;
+        record_prefix(buf, r);
+        if (verbose)
+        {
+            record_debug(buf, r);
+        }
+        record_suffix(buf, r);
+        s.assign(buf.data(), buf.size());
+    }
+
+private:
+    static void record_prefix(buffer_t& buf, record const& r)
+    {
+        if (has_time(r.tv))
+        {
+            write_ascii(buf, "time=");
+            write_iso_time(buf, r.tv);
+            buf.push_back(char_type(' '));
+        }
+        write_ascii(buf, "level=");
+        buf.append(level_name<char_type>(r.lvl));
+        write_ascii(buf, " thread=");
+        write_uint(buf, r.id);
+    }
+
+    static void record_suffix(buffer_t& buf, record const& r)
+    {
+        write_ascii(buf, " msg=");
+        write_logfmt_text(buf, r.message.data(), message_size(r));
+        write_logfmt_fields(buf, r.fields);
+        buf.push_back(char_type('\n'));
+    }
+
+    static void record_debug(buffer_t& buf, record_d const& r)
+    {
+        auto const file = r.file_name();
+        auto const& func = r.func_name();
+
+        write_ascii(buf, " file=");
+        write_logfmt_text(buf, file, std::char_traits<char_type>::length(file));
+        write_ascii(buf, " line=");
+        write_uint(buf, r.line_number());
+        write_ascii(buf, " func=");
+        write_logfmt_text(buf, func.data(), func.size());
+    }
+};
+
+template <class charT>
+struct endpage_constructor;
+
+template <>
+struct endpage_constructor<char>
+    : public layout_constructor_base<endpage_constructor<char>, char>
+{
+    friend struct layout_constructor_base<endpage_constructor<char>, char>;
+
+    using base = layout_constructor_base<endpage_constructor<char>, char>;
+
+    static constexpr auto sep = TINYLOG_SEPARATOR;
+    static constexpr auto lf  = '\f';
+
+protected:
+    static void record_prefix(ostream_t& strm
+                              , record const& r, string_t& cache)
+    {
+        if (cache.empty())
+        {
+            format_time(strm, r);
+        }
+    }
+
+    static void record_suffix(ostream_t& strm
+                              , record const& r, string_t& cache)
+    {
+        if (cache.empty())
+        {
+            strm << sep << "[" << level_name<char_type>(r.lvl) << "]"
+                 << sep << "#" << r.id << sep;
+        }
+
+        if (!r.message.empty() && (*r.message.crbegin() == lf))
+        {
+            strm << r.message.substr(0, r.message.size()-1) << std::endl;
+            cache.clear();
+            return ;
+        }
+        else if (cache.empty())
+        {
+            cache = { lf };
+        }
+        strm << r.message;
+    }
+
+    static void record_debug(ostream_t& strm
+                             , record_d const& r, string_t& cache)
+    {
+        if (cache.empty())
+        {
+            strm << sep << "(" << r.file_name()
+                 << ", " << r.line_number() << ", " << r.func_name() << ")";
+        }
+    }
+};
+
+template <>
+struct endpage_constructor<wchar_t>
+    : public layout_constructor_base<endpage_constructor<wchar_t>, wchar_t>
+{
+    friend struct layout_constructor_base<endpage_constructor<wchar_t>
+                                          , wchar_t>;
+
+    using base = layout_constructor_base<endpage_constructor<wchar_t>, wchar_t>;
+
+    static constexpr auto sep = TINYLOG_SEPARATORW;
+    static constexpr auto lf  = L'\f';
+
+protected:
+    static void record_prefix(ostream_t& strm
+                              , record const& r, string_t& cache)
+    {
+        if (cache.empty())
+        {
+            format_time(strm, r);
+        }
+    }
+
+    static void record_suffix(ostream_t& strm
+                              , record const& r, string_t& cache)
+    {
+        if (cache.empty())
+        {
+            strm << sep << L"[" << level_name<char_type>(r.lvl) << L"]"
+                 << sep << L"#" << r.id << sep;
+        }
+
+        if (!r.message.empty() && (*r.message.crbegin() == lf))
+        {
+            strm << r.message.substr(0, r.message.size()-1) << std::endl;
+            cache.clear();
+            return ;
+        }
+        else if (cache.empty())
+        {
+            cache = { lf };
+        }
+        strm << r.message;
+    }
+
+    static void record_debug(ostream_t& strm
+                             , record_d const& r, string_t& cache)
+    {
+        if (cache.empty())
+        {
+            strm << sep << L"(" << r.file_name() << L", "
+                 << r.line_number() << L", " << r.func_name() << L")";
+        }
+    }
+};
+
+}  // namespace detail
+
+/*****************************************************************************/
+/* Build Formatter：Use layout constructor generate log message string. */
+
+struct default_layout
+{
+    template <class stringT, class recordT>
+    static void to_string(stringT& s, recordT const& r
+                          , stringT& cache, bool verbose)
+    {
+        using char_type = typename stringT::value_type;
+        detail::layout_constructor<char_type>::construct(s, r, cache, verbose);
+    }
+};
+
+// Log record breaks when message contains form feed (i.e. \f).
+//
+// loading......ok
+// e.g.
+//   lout(info) << "loading......";
+//   lout(info) << "ok\f";
+//
+// @warn non-thread-safe.
+struct endpage_layout
+{
+    template <class stringT, class recordT>
+    static void to_string(stringT& s, recordT const& r
+                          , stringT& cache, bool verbose)
+    {
+        using char_type = typename stringT::value_type;
+        detail::endpage_constructor<char_type>::construct(s, r, cache, verbose);
+    }
+};
+
+// One JSON object per line, kv fields follow the message.
+//
+// {"time":"2018-05-20T10:30:01.000123","level":"INFO","thread":1
+// ,"msg":"login","user":42}
+// e.g.
+//   inst->create_sink<sink::basic_file_sink<char, json_layout>>(...);
+struct json_layout
+{
+    template <class stringT, class recordT>
+    static void to_string(stringT& s, recordT const& r
+                          , stringT& cache, bool verbose)
+    {
+        using char_type = typename stringT::value_type;
+        detail::json_constructor<char_type>::construct(s, r, cache, verbose);
+    }
+};
+
+// key=value pairs per line, values with spaces are quoted.
+//
+// time=2018-05-20T10:30:01.000123 level=INFO thread=1 msg=login user=42
+struct logfmt_layout
+{
+    template <class stringT, class recordT>
+    static void to_string(stringT& s, recordT const& r
+                          , stringT& cache, bool verbose)
+    {
+        using char_type = typename stringT::value_type;
+        detail::logfmt_constructor<char_type>::construct(s, r, cache
+                                                         , verbose);
+    }
+};
+
+// Output of a stateless layout depends on the record only, so sinks using
+// the same one share the formatted message of a record.
+template <class layoutT>
+struct is_stateless_layout : public std::false_type
+{
+};
+
+template <>
+struct is_stateless_layout<default_layout> : public std::true_type
+{
+};
+
+template <>
+struct is_stateless_layout<json_layout> : public std::true_type
+{
+};
+
+template <>
+struct is_stateless_layout<logfmt_layout> : public std::true_type
+{
+};
+
+namespace detail
+{
+
+// Address identifies (charT, layoutT, verbose).
+template <class charT, class layoutT>
+struct layout_key
+{
+    static char const value[2];
+};
+
+template <class charT, class layoutT>
+char const layout_key<charT, layoutT>::value[2] = {};
+
+// Thread local string to copy a message into, falls back to a local one
+// when already in use (i.e. a sink logs while writing).
+template <class charT>
+class scratch_string
+{
+public:
+    using string_t = std::basic_string<charT>;
+
+    scratch_string() : owner_(!busy())
+    {
+        busy() = true;
+    }
+
+    ~scratch_string()
+    {
+        if (owner_)
+        {
+            busy() = false;
+        }
+    }
+
+    scratch_string(scratch_string const&) = delete;
+    scratch_string& operator=(scratch_string const&) = delete;
+
+    string_t& get()
+    {
+        return owner_ ? shared() : local_;
+    }
+
+private:
+    static bool& busy()
+    {
+        static thread_local bool b = false;
+        return b;
+    }
+
+    static string_t& shared()
+    {
+        static thread_local string_t s;
+        return s;
+    }
+
+private:
+    bool owner_;
+    string_t local_;
+};
+
+}  // namespace detail
+
+template <class charT, class layoutT = default_layout>
+struct formatter
+{
+public:
+    using char_type = charT;
+    using string_t = std::basic_string<char_type>;
+
+public:
+    template <class recordT
+              , typename std::enable_if<
+                    std::is_same<typename recordT::char_type, char_type>::value
+                    , int>::type = 0>
+    typename recordT::string_t format(recordT const& r, bool verbose)
+    {
+        typename recordT::string_t s;
+        layoutT::to_string(s, r, cache_, verbose);
+        return s;
+    }
+
+    template <class recordT
+              , typename std::enable_if<
+                    std::is_same<typename recordT::char_type, char_type>::value
+                    , int>::type = 0>
+    void format(recordT const& r, bool verbose, typename recordT::string_t& s)
+    {
+        layoutT::to_string(s, r, cache_, verbose);
+    }
+
+    // String charset convertion is needed.
+    template <class recordT
+              , typename std::enable_if<
+                    !std::is_same<typename recordT::char_type, char_type>::value
+                    , int>::type = 0>
+    typename recordT::string_t format(recordT const& r, bool verbose)
+    {
+        typename recordT::string_t s, cache;
+        string_traits<>::convert(cache, cache_);
+        layoutT::to_string(s, r, cache, verbose);
+        string_traits<>::convert(cache_, cache);
+        return s;
+    }
+
+private:
+    string_t cache_;
+};
+
+/*****************************************************************************/
+/* Colors Support in Terminal Output. */
+
+namespace detail
+{
+
+enum class foreground
+{
+#if defined(TINYLOG_WINDOWS_API)
+
+    white       = FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_RED
+    , cyan      = FOREGROUND_BLUE | FOREGROUND_GREEN
+    , green     = FOREGROUND_GREEN
+    , yellow    = FOREGROUND_GREEN | FOREGROUND_RED
+    , red       = FOREGROUND_RED
+
+#else
+
+    white       = 37
+    , cyan      = 36
+    , green     = 32
+    , yellow    = 33
+    , red       = 31
+
+#endif  // TINYLOG_WINDOWS_API
+};
+
+enum class background
+{
+#if defined(TINYLOG_WINDOWS_API)
+
+    white       = BACKGROUND_BLUE | BACKGROUND_GREEN | BACKGROUND_RED
+    , cyan      = BACKGROUND_BLUE | BACKGROUND_GREEN
+    , green     = BACKGROUND_GREEN
+    , yellow    = BACKGROUND_GREEN | BACKGROUND_RED
+    , red       = BACKGROUND_RED
+
+#else
+
+    white       = 47
+    , cyan      = 46
+    , green     = 42
+    , yellow    = 43
+    , red       = 41
+
+#endif  // TINYLOG_WINDOWS_API
+};
+
+enum class emphasize
+{
+#if defined(TINYLOG_WINDOWS_API)
+
+    normal      = 0
+    , bold      = FOREGROUND_INTENSITY
+
+#else
+
+    normal      = 22
+    , bold      = 1
+
+#endif  // TINYLOG_WINDOWS_API
+};
+
+struct rgb
+{
+    foreground fg;
+    background bg;
+    emphasize  em;
+};
+
+template <class charT>
+struct basic_style_impl
+{
+    using char_type     = charT;
+    using string_t      = std::basic_string<char_type>;
+
+    static rgb curr_rgb(bool raw = false)
+    {
+#if defined(TINYLOG_WINDOWS_API)
+
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        auto handle = ::GetStdHandle(STD_OUTPUT_HANDLE);
+        ::GetConsoleScreenBufferInfo(handle, &info);
+
+        auto fg = static_cast<foreground>(info.wAttributes & 0x07);
+        auto bg = static_cast<background>(info.wAttributes & 0x70);
+        auto em = static_cast<emphasize>(info.wAttributes & 0x08);
+
+#else
+
+        auto fg = raw ? static_cast<foreground>(39) : curr_.fg;
+        auto bg = raw ? static_cast<background>(49) : curr_.bg;
+        auto em = raw ? static_cast<emphasize>(22) : curr_.em;
+
+#endif  // TINYLOG_WINDOWS_API
+
+        if (raw)
+        {
+            // nothing to do.
+        }
+        else if (reset_)
+        {
+            reset_ = false;
+        }
+
+        return { fg, bg, em };
+    }
+
+    static rgb curr_rgb_raw()
+    {
+        bool raw = true;
+        return curr_rgb(raw);
+    }
+
+    static string_t set_rgb(rgb const& c)
+    {
+#if defined(TINYLOG_WINDOWS_API)
+
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        auto handle = ::GetStdHandle(STD_OUTPUT_HANDLE);
+        ::GetConsoleScreenBufferInfo(handle, &info);
+
+        info.wAttributes &= 0xFF80;
+        using attr_t    = decltype(info.wAttributes);
+        auto fg         = static_cast<attr_t>(c.fg);
+        auto bg         = (info.wAttributes & 0x70) | static_cast<attr_t>(c.bg);
+        auto em         = static_cast<attr_t>(c.em);
+
+        info.wAttributes |= fg;
+        info.wAttributes |= bg;
+        info.wAttributes |= em;
+        ::SetConsoleTextAttribute(handle, info.wAttributes);
+        return string_t();
+
+#else
+
+        curr_ = c;
+
+        std::basic_ostringstream<char_type> oss;
+        auto calc = [&oss](std::size_t n)
+                    {
+                        oss << oss.widen('\033') << oss.widen('[')
+                            << n << oss.widen('m');
+                    };
+        calc(static_cast<std::size_t>(curr_.fg));
+        calc(static_cast<std::size_t>(curr_.bg));
+        calc(static_cast<std::size_t>(curr_.em));
+
+        return oss.str();
+
+#endif  // TINYLOG_WINDOWS_API
+    }
+
+    static string_t set_rgb_raw()
+    {
+        reset_ = true;
+        return set_rgb(default_);
+    }
+
+private:
+    static rgb default_;
+    static bool reset_;
+    static rgb curr_;
+};
+
+template <class charT>
+rgb basic_style_impl<charT>::default_ = basic_style_impl<charT>::curr_rgb_raw();
+
+template <class charT>
+bool basic_style_impl<charT>::reset_ = true;
+
+template <class charT>
+rgb basic_style_impl<charT>::curr_ = basic_style_impl<charT>::curr_rgb_raw();
+
+template <class charT>
+void style(std::basic_string<charT>& color, foreground fg)
+{
+    using impl  = basic_style_impl<charT>;
+    auto curr   = impl::curr_rgb();
+    curr.fg     = fg;
+    color       = impl::set_rgb(curr);
+}
+
+template <class charT>
+void style(std::basic_string<charT>& color, background bg)
+{
+    using impl  = basic_style_impl<charT>;
+    auto curr   = impl::curr_rgb();
+    curr.bg     = bg;
+    color       = impl::set_rgb(curr);
+}
+
+template <class charT>
+void style(std::basic_string<charT>& color, emphasize em)
+{
+    using impl  = basic_style_impl<charT>;
+    auto curr   = impl::curr_rgb();
+    curr.em     = em;
+    color       = impl::set_rgb(curr);
+}
+
+template <class charT>
+void style(std::basic_string<charT>& color)
+{
+    using impl  = basic_style_impl<charT>;
+    color       = impl::set_rgb_raw();
+}
+
+#if !defined(TINYLOG_WINDOWS_API)
+
+// Escape sequences of levels built once, console sink writes them along
+// with the text instead of setting colors line by line.
+template <class charT>
+struct basic_console_escapes
+{
+    using char_type = charT;
+    using string_t  = std::basic_string<char_type>;
+
+    static basic_console_escapes const& get()
+    {
+        static basic_console_escapes const escapes;
+        return escapes;
+    }
+
+    string_t const& begin(level lvl) const
+    {
+        return lvl <= level::fatal ? begin_[lvl] : none_;
+    }
+
+    string_t const& end() const
+    {
+        return end_;
+    }
+
+private:
+    basic_console_escapes()
+    {
+        auto const def = rgb{ static_cast<foreground>(39)
+                              , static_cast<background>(49)
+                              , static_cast<emphasize>(22) };
+
+        rgb c[level::fatal + 1] = { def, def, def, def, def, def };
+        c[level::trace].fg = foreground::white;
+        c[level::debug].fg = foreground::cyan;
+        c[level::info].fg  = foreground::green;
+        c[level::warn].fg  = foreground::yellow;
+        c[level::warn].em  = emphasize::bold;
+        c[level::error].fg = foreground::red;
+        c[level::error].em = emphasize::bold;
+        c[level::fatal].fg = foreground::red;
+        c[level::fatal].bg = background::white;
+        c[level::fatal].em = emphasize::bold;
+
+        for (std::size_t i = 0; i != level::fatal + 1; ++i)
+        {
+            begin_[i] = escape(c[i]);
+        }
+        end_ = escape(def);
+    }
+
+    static string_t escape(rgb const& c)
+    {
+        string_t text;
+        auto calc = [&text](std::size_t n)
+                    {
+                        char code[8];
+                        auto const len = std::snprintf(code, sizeof(code)
+                                                       , "\033[%um"
+                                                       , static_cast<unsigned>(
+                                                           n));
+                        text.append(code, code + len);
+                    };
+        calc(static_cast<std::size_t>(c.fg));
+        calc(static_cast<std::size_t>(c.bg));
+        calc(static_cast<std::size_t>(c.em));
+        return text;
+    }
+
+private:
+    string_t begin_[level::fatal + 1];
+    string_t end_;
+    string_t none_;
+};
+
+#endif  // TINYLOG_WINDOWS_API
+
+}  // namespace detail
+
+/*****************************************************************************/
+/* Binary Log: Compact framed stream of records. */
+
+// Stream written by binary_file_sink:
+//
+//   session: "TLOGBIN" version(1), written whenever the file is opened. It
+//            resets format ids and timestamps of the stream.
+//   frame:   type(1) size(varint) body
+//     format: id, line, fmt, file, func
+//     record: level(1), thread, time delta, format id, arg count, args,
+//             fields
+//     text:   level(1), thread, time delta, message, file, line, func,
+//             fields
+//   arg:     kind(1) value
+//   fields:  count, then key and arg of each kv field
+//
+// Integers are LEB128 varints, signed ones zigzag encoded, floats are 8
+// bytes in host order. Time is microseconds since epoch, delta to the
+// previous record of the same thread. Strings are varint length plus
+// bytes, narrow strings as they are and wide strings in UTF-8. The high
+// bit of level marks the record as verbose. Version 1 streams have no
+// fields and are still read.
+
+namespace detail
+{
+
+enum class binary_frame : std::uint8_t
+{
+    format = 1,
+    record = 2,
+    text   = 3
+};
+
+constexpr char binary_magic[] = "TLOGBIN";
+constexpr std::uint8_t binary_version = 2;
+constexpr std::uint8_t binary_first_version = 1;
+constexpr std::uint8_t binary_verbose = 0x80;
+
+inline void put_varint(std::string& out, std::uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline std::uint64_t zigzag(std::int64_t v)
+{
+    return (static_cast<std::uint64_t>(v) << 1)
+           ^ static_cast<std::uint64_t>(v >> 63);
+}
+
+inline std::int64_t unzigzag(std::uint64_t v)
+{
+    return static_cast<std::int64_t>(v >> 1)
+           ^ -static_cast<std::int64_t>(v & 1);
+}
+
+inline void put_string(std::string& out, char const* s, std::size_t n)
+{
+    put_varint(out, n);
+    out.append(s, n);
+}
+
+inline void put_string(std::string& out, wchar_t const* s, std::size_t n)
+{
+    std::string u8;
+    string_traits<u8string>::convert(u8, std::wstring(s, n));
+    put_string(out, u8.data(), u8.size());
+}
+
+template <class charT>
+void put_string(std::string& out, std::basic_string<charT> const& s)
+{
+    put_string(out, s.data(), s.size());
+}
+
+template <class charT>
+void put_string(std::string& out, charT const* s)
+{
+    put_string(out, s, s ? std::char_traits<charT>::length(s) : 0);
+}
+
+inline std::int64_t time_usec(time_value const& tv)
+{
+    return static_cast<std::int64_t>(tv.tv_sec) * 1000000
+           + static_cast<std::int64_t>(tv.tv_usec);
+}
+
+template <class charT>
+void put_fmt_arg(std::string& out, fmt_arg<charT> const& a)
+{
+    static char const null_str[] = "(null)";
+
+    auto kind = a.kind;
+    if (kind == fmt_kind::custom)
+    {
+        // Decoder can't call operator<<, store the text.
+        kind = fmt_kind::string;
+    }
+    out.push_back(static_cast<char>(kind));
+
+    switch (a.kind)
+    {
+    case fmt_kind::boolean:
+        out.push_back(a.b ? 1 : 0);
+        break;
+    case fmt_kind::character:
+        put_varint(out, static_cast<typename std::make_unsigned<
+                       charT>::type>(a.c));
+        break;
+    case fmt_kind::signed_int:
+        put_varint(out, zigzag(a.i));
+        break;
+    case fmt_kind::unsigned_int:
+        put_varint(out, a.u);
+        break;
+    case fmt_kind::floating:
+        {
+            char bytes[sizeof(double)];
+            std::memcpy(bytes, &a.d, sizeof(bytes));
+            out.append(bytes, sizeof(bytes));
+        }
+        break;
+    case fmt_kind::string:
+        if (a.s.data)
+        {
+            put_string(out, a.s.data, a.s.size);
+        }
+        else
+        {
+            put_string(out, null_str, sizeof(null_str) - 1);
+        }
+        break;
+    case fmt_kind::pointer:
+        put_varint(out, reinterpret_cast<std::uintptr_t>(a.p));
+        break;
+    case fmt_kind::custom:
+        {
+            std::basic_string<charT> s;
+            {
+                basic_string_appendbuf<charT> sbuf;
+                sbuf.attach(&s);
+                std::basic_ostream<charT> os(&sbuf);
+                a.custom.write(os, a.custom.obj);
+            }
+            put_string(out, s);
+        }
+        break;
+    default:
+        put_varint(out, 0);
+        break;
+    }
+}
+
+template <class charT>
+void put_kv_fields(std::string& out, basic_kv_fields<charT> const& fields)
+{
+    put_varint(out, fields.size());
+    for (auto const& f : fields)
+    {
+        put_string(out, fields.key(f), f.key_size);
+        out.push_back(static_cast<char>(f.kind));
+        switch (f.kind)
+        {
+        case fmt_kind::boolean:
+            out.push_back(f.b ? 1 : 0);
+            break;
+        case fmt_kind::signed_int:
+            put_varint(out, zigzag(f.i));
+            break;
+        case fmt_kind::unsigned_int:
+            put_varint(out, f.u);
+            break;
+        case fmt_kind::floating:
+            {
+                char bytes[sizeof(double)];
+                std::memcpy(bytes, &f.d, sizeof(bytes));
+                out.append(bytes, sizeof(bytes));
+            }
+            break;
+        default:
+            put_string(out, fields.text(f), f.text_size);
+            break;
+        }
+    }
+}
+
+// Cursor on a frame body, fails once data runs out.
+class binary_cursor
+{
+public:
+    binary_cursor(char const* b, char const* e) : p_(b), e_(e)
+    {
+    }
+
+    bool ok() const
+    {
+        return ok_;
+    }
+
+    std::uint8_t byte()
+    {
+        if (p_ == e_)
+        {
+            ok_ = false;
+            return 0;
+        }
+        return static_cast<std::uint8_t>(*p_++);
+    }
+
+    std::uint64_t varint()
+    {
+        std::uint64_t v = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+            auto const b = byte();
+            v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+            {
+                return v;
+            }
+        }
+        ok_ = false;
+        return v;
+    }
+
+    // String in the frame body, valid while the body is.
+    std::pair<char const*, std::size_t> string()
+    {
+        auto const n = varint();
+        if (!ok_ || n > static_cast<std::uint64_t>(e_ - p_))
+        {
+            ok_ = false;
+            return { p_, 0 };
+        }
+        auto const s = p_;
+        p_ += n;
+        return { s, static_cast<std::size_t>(n) };
+    }
+
+    double float64()
+    {
+        double d = 0;
+        if (static_cast<std::size_t>(e_ - p_) < sizeof(d))
+        {
+            ok_ = false;
+            return d;
+        }
+        std::memcpy(&d, p_, sizeof(d));
+        p_ += sizeof(d);
+        return d;
+    }
+
+private:
+    char const* p_;
+    char const* e_;
+    bool ok_ = true;
+};
+
+// Append UTF-8 of code point c.
+inline void append_utf8(std::string& out, std::uint64_t c)
+{
+    if (c < 0x80)
+    {
+        out.push_back(static_cast<char>(c));
+    }
+    else if (c < 0x800)
+    {
+        out.push_back(static_cast<char>(0xc0 | (c >> 6)));
+        out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+    }
+    else if (c < 0x10000)
+    {
+        out.push_back(static_cast<char>(0xe0 | (c >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xf0 | ((c >> 18) & 0x07)));
+        out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+    }
+}
+
+}  // namespace detail
+
+// Read records written by binary_file_sink back, messages are formatted
+// as narrow (UTF-8 for wide records) strings.
+class binary_log_reader
+{
+public:
+    explicit binary_log_reader(std::istream& is) : is_(is)
+    {
+    }
+
+    // Next record, false at the end of stream or on corrupted data.
+    bool next(record_d& r, bool& verbose)
+    {
+        for (;;)
+        {
+            auto const type = is_.get();
+            if (type == std::char_traits<char>::eof())
+            {
+                return false;
+            }
+            if (type == detail::binary_magic[0])
+            {
+                if (!read_session())
+                {
+                    return corrupt();
+                }
+                continue;
+            }
+            if (!read_body())
+            {
+                return corrupt();
+            }
+
+            detail::binary_cursor c(body_.data()
+                                    , body_.data() + body_.size());
+            switch (static_cast<detail::binary_frame>(type))
+            {
+            case detail::binary_frame::format:
+                if (!read_format(c))
+                {
+                    return corrupt();
+                }
+                continue;
+            case detail::binary_frame::record:
+                if (!read_record(c, r, verbose))
+                {
+                    return corrupt();
+                }
+                return true;
+            case detail::binary_frame::text:
+                if (!read_text(c, r, verbose))
+                {
+                    return corrupt();
+                }
+                return true;
+            default:
+                // Unknown frame of a later version.
+                continue;
+            }
+        }
+    }
+
+    bool corrupted() const
+    {
+        return corrupted_;
+    }
+
+private:
+    struct format_entry
+    {
+        std::string fmt;
+        std::string file;
+        std::size_t line;
+        std::string func;
+    };
+
+    bool corrupt()
+    {
+        corrupted_ = true;
+        return false;
+    }
+
+    bool read_session()
+    {
+        char magic[sizeof(detail::binary_magic)];
+        is_.read(magic, sizeof(magic) - 1);
+        if (!is_ || std::memcmp(magic, detail::binary_magic + 1
+                                , sizeof(magic) - 2) != 0
+            || static_cast<std::uint8_t>(magic[sizeof(magic) - 2])
+               < detail::binary_first_version
+            || static_cast<std::uint8_t>(magic[sizeof(magic) - 2])
+               > detail::binary_version)
+        {
+            return false;
+        }
+        version_ = static_cast<std::uint8_t>(magic[sizeof(magic) - 2]);
+        formats_.clear();
+        last_time_.clear();
+        return true;
+    }
+
+    bool read_body()
+    {
+        std::uint64_t size = 0;
+        for (unsigned shift = 0; true; shift += 7)
+        {
+            auto const b = is_.get();
+            if (b == std::char_traits<char>::eof() || shift >= 64)
+            {
+                return false;
+            }
+            size |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+            {
+                break;
+            }
+        }
+        body_.resize(static_cast<std::size_t>(size));
+        is_.read(&body_[0], static_cast<std::streamsize>(size));
+        return is_.gcount() == static_cast<std::streamsize>(size);
+    }
+
+    static std::string to_string(std::pair<char const*, std::size_t> s)
+    {
+        return std::string(s.first, s.second);
+    }
+
+    bool read_format(detail::binary_cursor& c)
+    {
+        auto const id = c.varint();
+        format_entry f;
+        f.line = static_cast<std::size_t>(c.varint());
+        f.fmt  = to_string(c.string());
+        f.file = to_string(c.string());
+        f.func = to_string(c.string());
+        if (!c.ok() || id != formats_.size() + 1)
+        {
+            return false;
+        }
+        formats_.emplace_back(std::move(f));
+        return true;
+    }
+
+    void read_head(detail::binary_cursor& c, record_d& r, bool& verbose)
+    {
+        auto const lvl = c.byte();
+        verbose = (lvl & detail::binary_verbose) != 0;
+        r.lvl = static_cast<level>(lvl & ~detail::binary_verbose);
+        r.id = c.varint();
+
+        auto& last = last_time_[r.id];
+        last += detail::unzigzag(c.varint());
+        r.tv.tv_sec  = static_cast<std::time_t>(last / 1000000);
+        r.tv.tv_usec = static_cast<std::size_t>(last % 1000000);
+    }
+
+    bool read_fields(detail::binary_cursor& c, record_d& r)
+    {
+        using detail::fmt_kind;
+
+        r.fields.clear();
+        if (version_ < 2)
+        {
+            return c.ok();
+        }
+
+        auto const count = c.varint();
+        if (!c.ok() || count > body_.size())
+        {
+            return false;
+        }
+        for (std::uint64_t i = 0; i != count; ++i)
+        {
+            auto const key = c.string();
+            detail::fmt_arg<char> a;
+            a.kind = static_cast<fmt_kind>(c.byte());
+            switch (a.kind)
+            {
+            case fmt_kind::boolean:
+                a.b = c.byte() != 0;
+                break;
+            case fmt_kind::signed_int:
+                a.i = detail::unzigzag(c.varint());
+                break;
+            case fmt_kind::unsigned_int:
+                a.u = c.varint();
+                break;
+            case fmt_kind::floating:
+                a.d = c.float64();
+                break;
+            case fmt_kind::string:
+                {
+                    auto const s = c.string();
+                    a.s.data = s.first;
+                    a.s.size = s.second;
+                }
+                break;
+            default:
+                return false;
+            }
+            if (!c.ok())
+            {
+                return false;
+            }
+            r.fields.add_arg(key.first, key.second, a);
+        }
+        return true;
+    }
+
+    bool read_record(detail::binary_cursor& c, record_d& r, bool& verbose)
+    {
+        using detail::fmt_kind;
+
+        read_head(c, r, verbose);
+        auto const id = c.varint();
+        auto const arg_count = static_cast<std::size_t>(c.varint());
+        if (!c.ok() || id == 0 || id > formats_.size()
+            || arg_count > body_.size())
+        {
+            return false;
+        }
+
+        args_.resize(arg_count);
+        chars_.resize(arg_count);
+        for (std::size_t i = 0; i != arg_count; ++i)
+        {
+            auto& a = args_[i];
+            a.kind = static_cast<fmt_kind>(c.byte());
+            switch (a.kind)
+            {
+            case fmt_kind::boolean:
+                a.b = c.byte() != 0;
+                break;
+            case fmt_kind::character:
+                {
+                    auto const ch = c.varint();
+                    if (ch < 0x80)
+                    {
+                        a.c = static_cast<char>(ch);
+                        break;
+                    }
+                    // Not a single narrow charactor.
+                    chars_[i].clear();
+                    detail::append_utf8(chars_[i], ch);
+                    a.kind = fmt_kind::string;
+                    a.s.data = chars_[i].data();
+                    a.s.size = chars_[i].size();
+                }
+                break;
+            case fmt_kind::signed_int:
+                a.i = detail::unzigzag(c.varint());
+                break;
+            case fmt_kind::unsigned_int:
+                a.u = c.varint();
+                break;
+            case fmt_kind::floating:
+                a.d = c.float64();
+                break;
+            case fmt_kind::string:
+                {
+                    auto const s = c.string();
+                    a.s.data = s.first;
+                    a.s.size = s.second;
+                }
+                break;
+            case fmt_kind::pointer:
+                a.p = reinterpret_cast<void const*>(
+                    static_cast<std::uintptr_t>(c.varint()));
+                break;
+            default:
+                return false;
+            }
+        }
+        if (!c.ok() || !read_fields(c, r))
+        {
+            return false;
+        }
+
+        auto const& f = formats_[static_cast<std::size_t>(id - 1)];
+        r.message.clear();
+        detail::vformat(r.message, f.fmt.c_str(), args_.data(), arg_count);
+        r.file = f.file;
+        r.line = f.line;
+        r.func = f.func;
+        verbose = verbose && !r.file.empty();
+        return true;
+    }
+
+    bool read_text(detail::binary_cursor& c, record_d& r, bool& verbose)
+    {
+        read_head(c, r, verbose);
+        r.message = to_string(c.string());
+        r.file = to_string(c.string());
+        r.line = static_cast<std::size_t>(c.varint());
+        r.func = to_string(c.string());
+        verbose = verbose && !r.file.empty();
+        return c.ok() && read_fields(c, r);
+    }
+
+private:
+    std::istream& is_;
+    std::string body_;
+    std::vector<format_entry> formats_;
+    std::unordered_map<std::uintmax_t, std::int64_t> last_time_;
+    std::vector<detail::fmt_arg<char>> args_;
+    std::vector<std::string> chars_;
+    std::uint8_t version_ = detail::binary_version;
+    bool corrupted_ = false;
+};
+
+/*****************************************************************************/
+/* Stats: Counters and latency histograms of loggers and sinks. */
+
+// Durations in log2 buckets of nanoseconds, bucket i counts the ones below
+// 2^i ns and not below 2^(i-1) ns, the last bucket the longer ones too.
+// Cumulative buckets map to a Prometheus histogram.
+//
+// e.g.
+//   auto const s = sk->stats();
+//   std::uint64_t le = 0;
+//   for (std::size_t i = 0; i != histogram_stats::bucket_count; ++i) {
+//       le += s.format_time.buckets[i];
+//       // upper_bound(i) / 1e9 seconds: le
+//   }
+struct histogram_stats
+{
+    static constexpr std::size_t bucket_count = 40;
+
+    std::uint64_t count  = 0;
+    std::uint64_t sum_ns = 0;
+    std::uint64_t buckets[bucket_count] = {};
+
+    // Exclusive upper bound of bucket i in nanoseconds.
+    static std::uint64_t upper_bound(std::size_t i)
+    {
+        return std::uint64_t(1) << i;
+    }
+};
+
+struct logger_stats
+{
+    // Records handed to sinks, the async queue or the deferred buffer.
+    std::uint64_t emitted = 0;
+
+    // Statements below the level of the logger.
+    std::uint64_t filtered = 0;
+
+    // Records lost by a full async queue or deferred buffer.
+    std::uint64_t dropped = 0;
+
+    // Records of the async or deferred worker a sink threw on, the rest
+    // of the sinks may have missed them.
+    std::uint64_t failed = 0;
+
+    // Most records in the async queue at once.
+    std::uint64_t queue_high_water = 0;
+};
+
+struct sink_stats
+{
+    std::uint64_t records   = 0;
+    std::uint64_t bytes     = 0;
+    std::uint64_t rotations = 0;
+
+    // Records lost by a sink wrapped by this one throwing.
+    std::uint64_t failed    = 0;
+
+    // Formatting records into messages.
+    histogram_stats format_time;
+
+    // Waiting for the sink mutex, 0 if it isn't contended.
+    histogram_stats lock_wait;
+};
+
+namespace detail
+{
+
+constexpr std::size_t cache_line_size = 64;
+constexpr std::size_t stats_stripes = 16;
+
+// Stripe of the calling thread, threads take them round robin.
+inline std::size_t stats_stripe()
+{
+    static std::atomic<std::size_t> next{ 0 };
+    static thread_local std::size_t const stripe
+        = next.fetch_add(1, std::memory_order_relaxed) % stats_stripes;
+    return stripe;
+}
+
+// Start of a timed section, steady clock in nanoseconds.
+inline std::int64_t stats_now()
+{
+#if defined(TINYLOG_ENABLE_STATS)
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+#else
+    return 0;
+#endif // TINYLOG_ENABLE_STATS
+}
+
+// Counter striped over cache lines, each thread adds to a line of its own
+// and reading sums them up. Nothing is counted without TINYLOG_ENABLE_STATS.
+class stats_counter
+{
+public:
+    void add(std::uint64_t n = 1)
+    {
+#if defined(TINYLOG_ENABLE_STATS)
+        stripes_[stats_stripe()].value.fetch_add(n
+                                                 , std::memory_order_relaxed);
+#else
+        (void)n;
+#endif // TINYLOG_ENABLE_STATS
+    }
+
+    std::uint64_t load() const
+    {
+        std::uint64_t sum = 0;
+#if defined(TINYLOG_ENABLE_STATS)
+        for (auto const& s : stripes_)
+        {
+            sum += s.value.load(std::memory_order_relaxed);
+        }
+#endif // TINYLOG_ENABLE_STATS
+        return sum;
+    }
+
+#if defined(TINYLOG_ENABLE_STATS)
+private:
+    struct stripe
+    {
+        std::atomic<std::uint64_t> value{ 0 };
+        char pad_[cache_line_size - sizeof(std::atomic<std::uint64_t>)];
+    };
+
+    stripe stripes_[stats_stripes];
+#endif // TINYLOG_ENABLE_STATS
+};
+
+// Durations striped like stats_counter, buckets of histogram_stats.
+class stats_histogram
+{
+public:
+    void record(std::uint64_t ns)
+    {
+#if defined(TINYLOG_ENABLE_STATS)
+        auto& s = stripes_[stats_stripe()];
+        s.buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        s.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+#else
+        (void)ns;
+#endif // TINYLOG_ENABLE_STATS
+    }
+
+    // Time since start, a value of stats_now().
+    void record_since(std::int64_t start)
+    {
+#if defined(TINYLOG_ENABLE_STATS)
+        auto const d = stats_now() - start;
+        record(d > 0 ? static_cast<std::uint64_t>(d) : 0);
+#else
+        (void)start;
+#endif // TINYLOG_ENABLE_STATS
+    }
+
+    void load(histogram_stats& h) const
+    {
+        h = histogram_stats();
+#if defined(TINYLOG_ENABLE_STATS)
+        for (auto const& s : stripes_)
+        {
+            for (std::size_t i = 0; i != histogram_stats::bucket_count; ++i)
+            {
+                auto const n = s.buckets[i].load(std::memory_order_relaxed);
+                h.buckets[i] += n;
+                h.count += n;
+            }
+            h.sum_ns += s.sum_ns.load(std::memory_order_relaxed);
+        }
+#endif // TINYLOG_ENABLE_STATS
+    }
+
+#if defined(TINYLOG_ENABLE_STATS)
+private:
+    static std::size_t bucket_of(std::uint64_t ns)
+    {
+        std::size_t i = 0;
+        for (; ns != 0 && i != histogram_stats::bucket_count - 1; ns >>= 1)
+        {
+            ++i;
+        }
+        return i;
+    }
+
+    struct stripe
+    {
+        std::atomic<std::uint64_t> buckets[histogram_stats::bucket_count];
+        std::atomic<std::uint64_t> sum_ns;
+        char pad_[cache_line_size];
+    };
+
+    stripe stripes_[stats_stripes] = {};
+#endif // TINYLOG_ENABLE_STATS
+};
+
+// Highest value seen.
+class stats_max
+{
+public:
+    void update(std::uint64_t v)
+    {
+        auto cur = value_.load(std::memory_order_relaxed);
+        while (v > cur
+               && !value_.compare_exchange_weak(cur, v
+                                                , std::memory_order_relaxed))
+        {
+        }
+    }
+
+    std::uint64_t load() const
+    {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> value_{ 0 };
+};
+
+struct sink_counters
+{
+    stats_counter records;
+    stats_counter bytes;
+    stats_counter rotations;
+    stats_counter failed;
+    stats_histogram format_time;
+    stats_histogram lock_wait;
+};
+
+// Lock m, the time waiting for it goes to h.
+template <class mutexT>
+void timed_lock(mutexT& m, stats_histogram& h)
+{
+#if defined(TINYLOG_ENABLE_STATS)
+    if (m.try_lock())
+    {
+        h.record(0);
+        return ;
+    }
+    auto const start = stats_now();
+    m.lock();
+    h.record_since(start);
+#else
+    (void)h;
+    m.lock();
+#endif // TINYLOG_ENABLE_STATS
+}
+
+}  // namespace detail
+
+/*****************************************************************************/
+/* Log Sink:
+ *   - console_sink
+ *   - file_sink
+ *   - u8_file_sink
+ *   - buffered_file_sink
+ *   - rotating_file_sink
+ *   - mmap_file_sink
+ *   - binary_file_sink
+ *   - msvc_sink
+ *   - sharded_sink (@see Sharded Sink)
+ */
+
+#if defined(TINYLOG_USE_SINGLE_THREAD)
+using mutex_t = detail::null_mutex;
+#else
+using mutex_t = std::mutex;
+#endif
+
+namespace sink
+{
+
+template <class charT>
+class basic_sink_base
+{
+public:
+    using char_type = charT;
+    using string_t  = std::basic_string<char_type>;
+
+    virtual ~basic_sink_base() = default;
+
+public:
+    explicit operator bool() const
+    {
+        return is_open();
+    }
+    bool operator!() const
+    {
+        return !is_open();
+    }
+
+    void set_level(level lvl)
+    {
+        lvl_ = lvl;
+    }
+    level get_level() const
+    {
+        return lvl_;
+    }
+
+    void enable_verbose(bool enable)
+    {
+        verbose_ = enable;
+    }
+    bool is_verbose() const
+    {
+        return verbose_;
+    }
+
+    virtual bool is_open() const = 0;
+    virtual void consume(basic_record<char_type> const& r) = 0;
+    virtual void consume(basic_record_d<char_type> const& r) = 0;
+
+    // Sinks with the same non-null key format a record to the same message,
+    // so the logger formats it once by format() and hands it to each of
+    // them by consume_formatted(), the last one may modify it.
+    virtual void const* format_key() const
+    {
+        return nullptr;
+    }
+
+    virtual void format(basic_record<char_type> const& /*r*/, string_t& /*s*/)
+    {}
+
+    virtual void format(basic_record_d<char_type> const& /*r*/
+                        , string_t& /*s*/)
+    {}
+
+    virtual void consume_formatted(level /*lvl*/, string_t& /*msg*/
+                                   , bool /*last*/)
+    {}
+
+    // Sinks may write records of a batch at once.
+    virtual void consume_batch(basic_record_span<char_type> const& records)
+    {
+        for (auto const& it : records)
+        {
+            if (it.detailed)
+            {
+                consume(static_cast<basic_record_d<char_type> const&>(
+                            *it.record));
+                continue;
+            }
+            consume(*it.record);
+        }
+    }
+
+    // Write buffered messages out.
+    virtual void flush()
+    {}
+
+    // @see TINYLOG_ENABLE_STATS
+    sink_stats stats() const
+    {
+        sink_stats s;
+        s.records   = counters_.records.load();
+        s.bytes     = counters_.bytes.load();
+        s.rotations = counters_.rotations.load();
+        s.failed    = counters_.failed.load();
+        counters_.format_time.load(s.format_time);
+        counters_.lock_wait.load(s.lock_wait);
+        return s;
+    }
+
+protected:
+    detail::sink_counters& counters()
+    {
+        return counters_;
+    }
+
+private:
+    level lvl_      = level::trace;
+    bool verbose_   = false;
+    detail::sink_counters counters_;
+};
+
+template <class charT, class layoutT = default_layout
+          , class mutexT = mutex_t
+          , class formatterT = formatter<charT, layoutT>>
+class basic_sink : public basic_sink_base<charT>
+{
+public:
+    using base      = basic_sink_base<charT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+    void consume(basic_record<char_type> const& r) override final
+    {
+        if (base::get_level() > r.lvl)
+        {
+            return ;
+        }
+        detail::scratch_string<char_type> scratch;
+        auto& msg = scratch.get();
+        format_to(r, msg, std::is_same<formatterT
+                                       , formatter<charT, layoutT>>());
+        write(r.lvl, msg);
+    }
+
+    void consume(basic_record_d<char_type> const& r) override final
+    {
+        if (base::get_level() > r.lvl)
+        {
+            return ;
+        }
+        detail::scratch_string<char_type> scratch;
+        auto& msg = scratch.get();
+        format_to(r, msg, std::is_same<formatterT
+                                       , formatter<charT, layoutT>>());
+        write(r.lvl, msg);
+    }
+
+    void const* format_key() const override final
+    {
+        using key = detail::layout_key<char_type, layoutT>;
+        using shareable = std::integral_constant<bool
+            , is_stateless_layout<layoutT>::value
+              && std::is_same<formatterT, formatter<charT, layoutT>>::value>;
+        return shareable::value ? &key::value[base::is_verbose() ? 1 : 0]
+                                : nullptr;
+    }
+
+    void format(basic_record<char_type> const& r, string_t& s) override final
+    {
+        format_to(r, s, std::is_same<formatterT, formatter<charT, layoutT>>());
+    }
+
+    void format(basic_record_d<char_type> const& r
+                , string_t& s) override final
+    {
+        format_to(r, s, std::is_same<formatterT, formatter<charT, layoutT>>());
+    }
+
+    // Hooks may modify the message, write a copy unless no other sink is
+    // handed it after.
+    void consume_formatted(level lvl, string_t& msg, bool last) override final
+    {
+        if (base::get_level() > lvl)
+        {
+            return ;
+        }
+        if (last)
+        {
+            write(lvl, msg);
+            return ;
+        }
+        detail::scratch_string<char_type> scratch;
+        auto& s = scratch.get();
+        s.assign(msg);
+        write(lvl, s);
+    }
+
+    void flush() override final
+    {
+        std::lock_guard<mutexT> lock(mtx_);
+        flushing();
+    }
+
+private:
+    // Built-in formatter reuses capacity of s.
+    template <class recordT>
+    void format_to(recordT const& r, string_t& s, std::true_type)
+    {
+        auto const start = detail::stats_now();
+        fmt_.format(r, base::is_verbose(), s);
+        base::counters().format_time.record_since(start);
+    }
+
+    template <class recordT>
+    void format_to(recordT const& r, string_t& s, std::false_type)
+    {
+        auto const start = detail::stats_now();
+        s = fmt_.format(r, base::is_verbose());
+        base::counters().format_time.record_since(start);
+    }
+
+    void write(level lvl, string_t& msg, std::size_t records = 1)
+    {
+        before_write(lvl, msg);
+        {
+            detail::timed_lock(mtx_, base::counters().lock_wait);
+            std::lock_guard<mutexT> lock(mtx_, std::adopt_lock);
+
+            before_writing(lvl, msg);
+            writing(lvl, msg);
+            after_writing(lvl, msg);
+        }
+        auto& counters = base::counters();
+        counters.records.add(records);
+        counters.bytes.add(msg.size() * sizeof(char_type));
+        after_write(lvl, msg);
+    }
+
+protected:
+    // Format records into one message and write it at once, flush policy
+    // of the sink sees the highest level of them.
+    void write_batch(basic_record_span<char_type> const& records)
+    {
+        detail::scratch_string<char_type> scratch;
+        auto& batch = scratch.get();
+        batch.clear();
+
+        // Used between formatting and appending only, a nested batch
+        // can't clobber it.
+        static thread_local string_t msg;
+        auto lvl = level::trace;
+        std::size_t count = 0;
+        for (auto const& it : records)
+        {
+            auto const& r = *it.record;
+            if (base::get_level() > r.lvl)
+            {
+                continue;
+            }
+            ++count;
+            if (it.detailed)
+            {
+                format_to(static_cast<basic_record_d<char_type> const&>(r)
+                          , msg, std::is_same<formatterT
+                                              , formatter<charT, layoutT>>());
+            }
+            else
+            {
+                format_to(r, msg, std::is_same<formatterT
+                                               , formatter<charT, layoutT>>());
+            }
+            batch.append(msg);
+            lvl = (std::max)(lvl, r.lvl);
+        }
+
+        if (!batch.empty())
+        {
+            write(lvl, batch, count);
+        }
+    }
+
+    virtual void before_write(level /*lvl*/, string_t& /*msg*/)
+    {}
+
+    virtual void before_writing(level /*lvl*/, string_t& /*msg*/)
+    {}
+
+    virtual void writing(level /*lvl*/, string_t& /*msg*/) = 0;
+
+    virtual void after_writing(level /*lvl*/, string_t& /*msg*/)
+    {}
+
+    virtual void after_write(level /*lvl*/, string_t& /*msg*/)
+    {}
+
+    // Called with the sink locked.
+    virtual void flushing()
+    {}
+
+private:
+    mutexT mtx_;
+    formatterT fmt_;
+};
+
+//----------------|
+// Console Sink   |
+//----------------|
+
+template <class charT, class layoutT = default_layout
+          , class mutexT = mutex_t
+          , class formatterT = formatter<charT, layoutT>>
+class basic_console_sink
+    : public basic_sink<charT, layoutT, mutexT, formatterT>
+{
+public:
+    using base      = basic_sink<charT, layoutT, mutexT, formatterT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+    bool is_open() const override final
+    {
+        return true;
+    }
+
+#if defined(TINYLOG_DISABLE_CONSOLE_COLOR)
+
+protected:
+    void writing(level /*lvl*/, string_t& msg) override final
+    {
+        write_text(msg);
+    }
+
+#else // Enable colors.
+
+public:
+    void enable_color(bool enable = true)
+    {
+        enable_color_ = enable;
+    }
+
+protected:
+#if !defined(TINYLOG_WINDOWS_API)
+
+    // Each line is wrapped in escapes of the level, the record is written
+    // at once.
+    void writing(level lvl, string_t& msg) override final
+    {
+        if (!enable_color_)
+        {
+            write_text(msg);
+            return ;
+        }
+
+        using escapes_t = detail::basic_console_escapes<char_type>;
+        auto const& escapes = escapes_t::get();
+        auto const& beg = escapes.begin(lvl);
+        auto const& end = escapes.end();
+
+        auto const d = line_sep<char_type>();
+        colored_.clear();
+        for (typename string_t::size_type p = 0, q = 0
+             ; q != string_t::npos; q = ++p)
+        {
+            p = msg.find(d, q);
+            auto const n = (p == string_t::npos ? msg.size() : p) - q;
+            if (n != 0)
+            {
+                colored_ += beg;
+                colored_.append(msg, q, n);
+                colored_ += end;
+            }
+            if (p == string_t::npos)
+            {
+                break;
+            }
+            colored_ += d;
+        }
+        write_text(colored_);
+    }
+
+#else
+
+    void writing(level lvl, string_t& msg) override final
+    {
+        auto d = line_sep<char_type>();
+        for (typename string_t::size_type p = 0, q = 0
+             ; q != string_t::npos; q = ++p)
+        {
+            if ((p = msg.find(d, q)) == string_t::npos)
+            {
+                write_line(lvl, msg.substr(q));
+                break;
+            }
+            write_line(lvl, msg.substr(q, p - q));
+            write_line_sep<char_type>();
+        }
+    }
+
+#endif  // TINYLOG_WINDOWS_API
+
+private:
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, char>::value
+                                        , int>::type = 0>
+    lineCharT line_sep() const
+    {
+        return '\n';
+    }
+
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
+                                        , int>::type = 0>
+    lineCharT line_sep() const
+    {
+        return L'\n';
+    }
+
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, char>::value
+                                        , int>::type = 0>
+    void write_line(level lvl, std::basic_string<lineCharT> const& line) const
+    {
+        if (enable_color_)
+        {
+            std::printf("%s", style_beg(lvl).c_str());
+            std::printf("%s", line.c_str());
+            std::printf("%s", style_end().c_str());
+            return ;
+        }
+        std::printf("%s", line.c_str());
+    }
+
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
+                                        , int>::type = 0>
+    void write_line(level lvl, std::basic_string<lineCharT> const& line) const
+    {
+        if (enable_color_)
+        {
+            std::wprintf(L"%ls", style_beg(lvl).c_str());
+            std::wprintf(L"%ls", line.c_str());
+            std::wprintf(L"%ls", style_end().c_str());
+            return ;
+        }
+        std::wprintf(L"%ls", line.c_str());
+    }
+
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, char>::value
+                                        , int>::type = 0>
+    void write_line_sep() const
+    {
+        std::printf("%c", line_sep<lineCharT>());
+    }
+
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
+                                        , int>::type = 0>
+    void write_line_sep() const
+    {
+        std::wprintf(L"%lc", line_sep<lineCharT>());
+    }
+
+private:
+    string_t style_beg(level lvl) const
+    {
+        using namespace detail;
+
+        string_t color_text;
+        switch (lvl)
+        {
+        case level::trace:
+            style(color_text, foreground::white);
+            break;
+        case level::debug:
+            style(color_text, foreground::cyan);
+            break;
+        case level::info:
+            style(color_text, foreground::green);
+            break;
+        case level::warn:
+            style(color_text, foreground::yellow);
+            style(color_text, emphasize::bold);
+            break;
+        case level::error:
+            style(color_text, foreground::red);
+            style(color_text, emphasize::bold);
+            break;
+        case level::fatal:
+            style(color_text, foreground::red);
+            style(color_text, background::white);
+            style(color_text, emphasize::bold);
+            break;
+        default:
+            break;
+        }
+        return color_text;
+    }
+
+    string_t style_end() const
+    {
+        string_t color_text;
+        detail::style(color_text);
+        return color_text;
+    }
+
+private:
+    bool enable_color_ = true;
+    string_t colored_;
+
+#endif // TINYLOG_DISABLE_CONSOLE_COLOR
+
+private:
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, char>::value
+                                        , int>::type = 0>
+    void write_text(std::basic_string<lineCharT> const& text) const
+    {
+        std::fwrite(text.data(), 1, text.size(), stdout);
+    }
+
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
+                                        , int>::type = 0>
+    void write_text(std::basic_string<lineCharT> const& text) const
+    {
+        std::fputws(text.c_str(), stdout);
+    }
+};
+
+using console_sink  = basic_console_sink<char>;
+using wconsole_sink = basic_console_sink<wchar_t>;
+
+//----------------|
+// File Sink      |
+//----------------|
+
+// When a buffered file sink writes its buffer out to file.
+struct flush_policy
+{
+    // Write buffer of the file, flush once this many characters are
+    // pending. 0: flush every record.
+    std::size_t buffer_size = 64 * 1024;
+
+    // Flush pending messages periodically. 0: never.
+    std::chrono::milliseconds interval = std::chrono::milliseconds(1000);
+
+    // Flush at once on records of this level or above.
+    level flush_level = level::error;
+};
+
+template <class charT, class layoutT = default_layout
+          , class mutexT = mutex_t
+          , class formatterT = formatter<charT, layoutT>>
+class basic_file_sink
+    : public basic_sink<charT, layoutT, mutexT, formatterT>
+{
+public:
+    using base      = basic_sink<charT, layoutT, mutexT, formatterT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+    static constexpr std::uintmax_t default_max_file_size
+    = 10 * 1024 * 1024;  // 10 MB
+    static constexpr std::uintmax_t npos
+    = (std::numeric_limits<std::uintmax_t>::max)();
+
+public:
+    explicit basic_file_sink(char const* filename
+                             , std::uintmax_t max_file_size
+                             = default_max_file_size
+                             , std::ios_base::openmode mode
+                             = std::ios_base::app
+                             , std::locale const& loc = std::locale(""))
+        : basic_file_sink(filename, max_file_size, mode, loc
+                          , unbuffered())
+    {
+    }
+
+    bool is_open() const override final
+    {
+        return ostrm_ ? true : false;
+    }
+
+    // One write for the batch.
+    void consume_batch(basic_record_span<char_type> const& records)
+        override final
+    {
+        base::write_batch(records);
+    }
+
+protected:
+    explicit basic_file_sink(char const* filename
+                             , std::uintmax_t max_file_size
+                             , std::ios_base::openmode mode
+                             , std::locale const& loc
+                             , flush_policy const& policy)
+        : filename_(filename), max_file_size_(max_file_size)
+        , policy_(policy)
+    {
+        if (policy_.buffer_size != 0)
+        {
+            buffer_.reset(new char_type[policy_.buffer_size]);
+        }
+        ostrm_.imbue(loc);
+        open(mode);
+    }
+
+    void before_writing(level /*lvl*/, string_t& msg) override final
+    {
+        if (!need_rotate(file_size_, msg.size()))
+        {
+            return ;
+        }
+
+        ostrm_.close();
+        backup(filename_);
+        ostrm_.clear();
+        open(std::ios_base::out);
+        base::counters().rotations.add();
+    }
+
+    // Whether to rotate before writing n characters.
+    virtual bool need_rotate(std::uintmax_t file_size, std::size_t n)
+    {
+        return file_size + n >= max_file_size_;
+    }
+
+    // Move the closed file away, a new one is opened after.
+    virtual void backup(std::string const& filename)
+    {
+        try
+        {
+            ::tinylog::detail::file_rename(filename, filename + ".bak");
+        }
+        catch (...)
+        {
+            // TODO: Ignore backup file failed.
+        }
+    }
+
+    void writing(level lvl, string_t& msg) override final
+    {
+        if (!is_open())
+        {
+            return;
+        }
+        ostrm_.write(msg.data(), msg.size());
+        file_size_ += msg.size();
+        pending_ += msg.size();
+        if (pending_ >= policy_.buffer_size || lvl >= policy_.flush_level)
+        {
+            flushing();
+        }
+    }
+
+    void flushing() override final
+    {
+        if (pending_ != 0)
+        {
+            ostrm_.flush();
+            pending_ = 0;
+        }
+    }
+
+    flush_policy const& get_flush_policy() const
+    {
+        return policy_;
+    }
+
+private:
+    static flush_policy unbuffered()
+    {
+        flush_policy policy;
+        policy.buffer_size = 0;
+        policy.interval = std::chrono::milliseconds(0);
+        return policy;
+    }
+
+    // File size is counted in characters written, it is approximate for
+    // wide characters converted by the imbued locale.
+    void open(std::ios_base::openmode mode)
+    {
+        if (buffer_)
+        {
+            ostrm_.rdbuf()->pubsetbuf(buffer_.get(), policy_.buffer_size);
+        }
+        ostrm_.open(filename_, mode);
+        ostrm_.seekp(0, std::ios_base::end);
+
+        auto const pos = ostrm_.tellp();
+        file_size_ = pos > 0 ? static_cast<std::uintmax_t>(pos) : 0;
+        pending_ = 0;
+    }
+
+private:
+    std::string filename_;
+    std::uintmax_t max_file_size_ = npos;
+    flush_policy policy_;
+    std::unique_ptr<char_type[]> buffer_;
+    std::basic_ofstream<charT> ostrm_;
+    std::uintmax_t file_size_ = 0;
+    std::size_t pending_ = 0;
+};
+
+template <class charT, class layoutT, class mutexT, class formatterT>
+constexpr std::uintmax_t
+basic_file_sink<charT, layoutT, mutexT, formatterT>::default_max_file_size;
+
+template <class charT, class layoutT, class mutexT, class formatterT>
+constexpr std::uintmax_t
+basic_file_sink<charT, layoutT, mutexT, formatterT>::npos;
+
+using file_sink = basic_file_sink<char>;
+using wfile_sink= basic_file_sink<wchar_t>;
+
+//--------------------|
+// Buffered File Sink |
+//--------------------|
+
+// Write file through a buffer, instead of flushing every record.
+//
+// e.g.
+//   sink::flush_policy policy;
+//   policy.buffer_size = 256 * 1024;
+//   policy.interval    = std::chrono::milliseconds(200);
+//   policy.flush_level = level::warn;
+//   inst->create_sink<sink::buffered_file_sink>("d:\\default.log", policy);
+//
+// @attention Interval flushing runs on a timer thread, it is disabled if
+//            mutexT is detail::null_mutex.
+template <class charT, class layoutT = default_layout
+          , class mutexT = mutex_t
+          , class formatterT = formatter<charT, layoutT>>
+class basic_buffered_file_sink
+    : public basic_file_sink<charT, layoutT, mutexT, formatterT>
+{
+public:
+    using base      = basic_file_sink<charT, layoutT, mutexT, formatterT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+public:
+    explicit basic_buffered_file_sink(char const* filename
+                                      , flush_policy const& policy
+                                      = flush_policy()
+                                      , std::uintmax_t max_file_size
+                                      = base::default_max_file_size
+                                      , std::ios_base::openmode mode
+                                      = std::ios_base::app
+                                      , std::locale const& loc
+                                      = std::locale(""))
+        : base(filename, max_file_size, mode, loc, policy)
+    {
+        auto const interval = policy.interval;
+        if (interval.count() > 0
+            && !std::is_same<mutexT, detail::null_mutex>::value)
+        {
+            timer_ = std::thread([this, interval]() { run(interval); });
+        }
+    }
+
+    ~basic_buffered_file_sink()
+    {
+        {
+            std::lock_guard<std::mutex> lock(timer_mtx_);
+            stop_ = true;
+        }
+        timer_cv_.notify_all();
+        if (timer_.joinable())
+        {
+            timer_.join();
+        }
+        base::flush();
+    }
+
+private:
+    void run(std::chrono::milliseconds interval)
+    {
+        std::unique_lock<std::mutex> lock(timer_mtx_);
+        while (!timer_cv_.wait_for(lock, interval, [this]() { return stop_; }))
+        {
+            lock.unlock();
+            base::flush();
+            lock.lock();
+        }
+    }
+
+private:
+    std::mutex timer_mtx_;
+    std::condition_variable timer_cv_;
+    bool stop_ = false;
+    std::thread timer_;
+};
+
+using buffered_file_sink  = basic_buffered_file_sink<char>;
+using wbuffered_file_sink = basic_buffered_file_sink<wchar_t>;
+
+//--------------------|
+// Rotating File Sink |
+//--------------------|
+
+enum class rotation_period : std::uint8_t
+{
+    none, hourly, daily
+};
+
+enum class backup_naming : std::uint8_t
+{
+    numbered,   // <filename>.1 (newest) ... <filename>.N
+    timestamp   // <filename>.YYYYmmdd-HHMMSS-uuuuuu
+};
+
+struct rotation_policy
+{
+    // Rotate before the file grows beyond this size.
+    std::uintmax_t max_file_size = 10 * 1024 * 1024;  // 10 MB
+
+    // Rotate at the start of each local hour or day as well.
+    rotation_period period = rotation_period::none;
+
+    // Backups beyond are removed.
+    std::size_t max_backups = 5;
+
+    backup_naming naming = backup_naming::numbered;
+
+    // Optional, compress file `from` to `to` (i.e. from + extension) and
+    // return true on success, e.g. by zlib or zstd.
+    std::string compressed_extension = ".gz";
+    std::function<bool(std::string const& from, std::string const& to)>
+    compress;
+};
+
+// Keep a number of backups, rotate by size or time.
+//
+// The logging thread only renames the full file to a staging name and
+// opens a new one, naming, compression and pruning of backups run on a
+// background thread.
+//
+// e.g.
+//   sink::rotation_policy policy;
+//   policy.period   = sink::rotation_period::daily;
+//   policy.compress = [](std::string const& from, std::string const& to)
+//                     {
+//                         return gzip(from, to);
+//                     };
+//   inst->create_sink<sink::rotating_file_sink>("d:\\default.log", policy);
+template <class charT, class layoutT = default_layout
+          , class mutexT = mutex_t
+          , class formatterT = formatter<charT, layoutT>>
+class basic_rotating_file_sink
+    : public basic_file_sink<charT, layoutT, mutexT, formatterT>
+{
+public:
+    using base      = basic_file_sink<charT, layoutT, mutexT, formatterT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+public:
+    explicit basic_rotating_file_sink(char const* filename
+                                      , rotation_policy const& policy
+                                      = rotation_policy()
+                                      , std::ios_base::openmode mode
+                                      = std::ios_base::app
+                                      , std::locale const& loc
+                                      = std::locale(""))
+        : base(filename, policy.max_file_size, mode, loc)
+        , filename_(filename), policy_(policy)
+        , next_rotation_(next_rotation(std::time(nullptr)))
+    {
+        queue_leftovers();
+        worker_ = std::thread([this]() { run(); });
+    }
+
+    ~basic_rotating_file_sink()
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobs_mtx_);
+            stop_ = true;
+        }
+        jobs_cv_.notify_all();
+        worker_.join();
+    }
+
+protected:
+    bool need_rotate(std::uintmax_t file_size, std::size_t n) override final
+    {
+        if (base::need_rotate(file_size, n))
+        {
+            return true;
+        }
+        if (policy_.period == rotation_period::none)
+        {
+            return false;
+        }
+
+        auto const now = std::time(nullptr);
+        if (now < next_rotation_)
+        {
+            return false;
+        }
+        next_rotation_ = next_rotation(now);
+        return file_size != 0;
+    }
+
+    void backup(std::string const& filename) override final
+    {
+        auto const tv = detail::curr_time();
+        next_rotation_ = next_rotation(tv.tv_sec);
+
+        // Unique across runs, leftovers of a previous one aren't replaced.
+        auto stamp = timestamp(tv);
+        auto staging = filename + staging_infix + stamp + '.'
+                       + std::to_string(detail::process_id()) + '.'
+                       + std::to_string(++staged_);
+        try
+        {
+            ::tinylog::detail::file_rename(filename, staging);
+        }
+        catch (...)
+        {
+            // Logging goes on in a new file as with a failed backup of
+            // rotating_file_sink, the old one is lost.
+            return ;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(jobs_mtx_);
+            jobs_.push_back({ std::move(staging), std::move(stamp) });
+        }
+        jobs_cv_.notify_one();
+    }
+
+private:
+    struct job
+    {
+        std::string staging;
+        std::string stamp;  // of timestamp naming
+    };
+
+    // .rotating.YYYYmmdd-HHMMSS-uuuuuu.<pid>.<n>
+    static constexpr char const* staging_infix = ".rotating.";
+    static constexpr std::size_t stamp_size = 22;
+
+    // Staging files of a previous run, e.g. killed before they were
+    // processed, are queued in the order they were staged.
+    void queue_leftovers()
+    {
+        auto const sep = filename_.find_last_of("/\\");
+        auto const dir = sep == std::string::npos ? std::string(".")
+                         : filename_.substr(0, sep);
+        auto const prefix = (sep == std::string::npos ? filename_
+                             : filename_.substr(sep + 1)) + staging_infix;
+
+        std::vector<std::string> names;
+        for (auto& name : detail::list_files(dir))
+        {
+            if (name.size() > prefix.size()
+                && name.compare(0, prefix.size(), prefix) == 0)
+            {
+                names.emplace_back(std::move(name));
+            }
+        }
+        std::sort(names.begin(), names.end());
+
+        for (auto const& name : names)
+        {
+            auto stamp = name.substr(prefix.size(), stamp_size);
+            if (stamp.size() != stamp_size || stamp[8] != '-'
+                || stamp[15] != '-')
+            {
+                stamp = timestamp(detail::curr_time());
+            }
+            auto path = sep == std::string::npos ? name
+                        : dir + filename_[sep] + name;
+            jobs_.push_back({ std::move(path), std::move(stamp) });
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(jobs_mtx_);
+        for (;;)
+        {
+            jobs_cv_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+            if (jobs_.empty())
+            {
+                return ;
+            }
+
+            auto j = std::move(jobs_.front());
+            jobs_.pop_front();
+            lock.unlock();
+            try
+            {
+                process(j);
+            }
+            catch (...)
+            {
+                // The staging file stays, it is picked up again on the
+                // next start.
+            }
+            lock.lock();
+        }
+    }
+
+    void process(job const& j)
+    {
+        auto path = j.staging;
+        std::string ext;
+        if (policy_.compress)
+        {
+            auto const to = path + policy_.compressed_extension;
+            if (policy_.compress(path, to))
+            {
+                std::remove(path.c_str());
+                path = to;
+                ext = policy_.compressed_extension;
+            }
+        }
+
+        if (policy_.max_backups == 0)
+        {
+            std::remove(path.c_str());
+            return ;
+        }
+
+        if (policy_.naming == backup_naming::numbered)
+        {
+            shift_backups();
+            std::rename(path.c_str(), numbered(1, ext).c_str());
+            return ;
+        }
+        std::rename(path.c_str(), (filename_ + '.' + j.stamp
+                                   + ext).c_str());
+        prune_backups();
+    }
+
+    // <filename>.i --> <filename>.i+1, with or without compressed extension.
+    void shift_backups()
+    {
+        auto const n = policy_.max_backups;
+        std::string const exts[] = { std::string()
+                                     , policy_.compressed_extension };
+        for (auto const& ext : exts)
+        {
+            std::remove(numbered(n, ext).c_str());
+            for (auto i = n - 1; i != 0; --i)
+            {
+                std::rename(numbered(i, ext).c_str()
+                            , numbered(i + 1, ext).c_str());
+            }
+        }
+    }
+
+    std::string numbered(std::size_t i, std::string const& ext) const
+    {
+        return filename_ + '.' + std::to_string(i) + ext;
+    }
+
+    // Backups sort by name in time order.
+    void prune_backups()
+    {
+        auto const sep = filename_.find_last_of("/\\");
+        auto const dir = sep == std::string::npos ? std::string(".")
+                         : filename_.substr(0, sep);
+        auto const prefix = (sep == std::string::npos ? filename_
+                             : filename_.substr(sep + 1)) + '.';
+
+        std::vector<std::string> backups;
+        for (auto& name : detail::list_files(dir))
+        {
+            if (name.size() > prefix.size()
+                && name.compare(0, prefix.size(), prefix) == 0
+                && std::isdigit(static_cast<unsigned char>(name[prefix.size()])))
+            {
+                backups.emplace_back(std::move(name));
+            }
+        }
+        if (backups.size() <= policy_.max_backups)
+        {
+            return ;
+        }
+
+        std::sort(backups.begin(), backups.end());
+        auto const excess = backups.size() - policy_.max_backups;
+        for (std::size_t i = 0; i != excess; ++i)
+        {
+            auto const path = sep == std::string::npos ? backups[i]
+                              : dir + filename_[sep] + backups[i];
+            std::remove(path.c_str());
+        }
+    }
+
+    static std::string timestamp(detail::time_value const& tv)
+    {
+        struct tm ti;
+        detail::local_time(tv.tv_sec, ti);
+
+        char text[32];
+        auto const n = std::strftime(text, sizeof(text), "%Y%m%d-%H%M%S", &ti);
+        std::snprintf(text + n, sizeof(text) - n, "-%06u"
+                      , static_cast<unsigned>(tv.tv_usec));
+        return text;
+    }
+
+    std::time_t next_rotation(std::time_t now) const
+    {
+        if (policy_.period == rotation_period::none)
+        {
+            return (std::numeric_limits<std::time_t>::max)();
+        }
+
+        struct tm ti;
+        detail::local_time(now, ti);
+        ti.tm_sec = 0;
+        ti.tm_min = 0;
+        if (policy_.period == rotation_period::hourly)
+        {
+            ti.tm_hour += 1;
+        }
+        else
+        {
+            ti.tm_hour = 0;
+            ti.tm_mday += 1;
+        }
+        ti.tm_isdst = -1;
+        return std::mktime(&ti);
+    }
+
+private:
+    std::string filename_;
+    rotation_policy policy_;
+    std::time_t next_rotation_;
+    std::size_t staged_ = 0;
+
+    std::mutex jobs_mtx_;
+    std::condition_variable jobs_cv_;
+    std::deque<job> jobs_;
+    bool stop_ = false;
+    std::thread worker_;
+};
+
+using rotating_file_sink  = basic_rotating_file_sink<char>;
+using wrotating_file_sink = basic_rotating_file_sink<wchar_t>;
+
+//----------------|
+// Mmap File Sink |
+//----------------|
+
+#if defined(TINYLOG_POSIX_API)
+
+// Copy messages into a mapped segment of the file, threads reserve space by
+// an atomic offset and write without a lock. The page cache writes the
+// file out, flush() only starts it.
+//
+// A segment is mapped from the page holding the end of the file, when it
+// is full, the next one is mapped from the end of the written data. The
+// unused tail is truncated when the sink is closed.
+//
+// @attention The file ends with zeros if the process is killed.
+template <class charT, class layoutT = default_layout
+          , class mutexT = detail::null_mutex
+          , class formatterT = formatter<charT, layoutT>>
+class basic_mmap_file_sink
+    : public basic_sink<charT, layoutT, mutexT, formatterT>
+{
+public:
+    using base      = basic_sink<charT, layoutT, mutexT, formatterT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+    static constexpr std::uintmax_t default_max_file_size
+    = 256 * 1024 * 1024;  // 256 MB
+    static constexpr std::size_t default_segment_size
+    = 64 * 1024 * 1024;  // 64 MB
+    static constexpr std::uintmax_t npos
+    = (std::numeric_limits<std::uintmax_t>::max)();
+
+public:
+    explicit basic_mmap_file_sink(char const* filename
+                                  , std::uintmax_t max_file_size
+                                  = default_max_file_size
+                                  , std::size_t segment_size
+                                  = default_segment_size
+                                  , std::ios_base::openmode mode
+                                  = std::ios_base::app)
+        : filename_(filename), max_file_size_(max_file_size)
+        , segment_size_(segment_size)
+    {
+        auto const trunc = (mode & std::ios_base::trunc)
+                           || !(mode & std::ios_base::app);
+        open(trunc);
+    }
+
+    ~basic_mmap_file_sink()
+    {
+        close();
+    }
+
+    bool is_open() const override final
+    {
+        return current_.load(std::memory_order_acquire) ? true : false;
+    }
+
+    void consume_batch(basic_record_span<char_type> const& records)
+        override final
+    {
+        base::write_batch(records);
+    }
+
+protected:
+    void writing(level /*lvl*/, string_t& msg) override final
+    {
+        write_bytes(msg);
+    }
+
+    void flushing() override final
+    {
+        // Pinned as a writer, the segment is not unmapped until released.
+        auto const seg = current_.load(std::memory_order_acquire);
+        if (seg)
+        {
+            seg->writers.fetch_add(1u);
+            if (!seg->retired.load())
+            {
+                ::msync(seg->base, seg->length, MS_ASYNC);
+            }
+            seg->writers.fetch_sub(1u, std::memory_order_release);
+        }
+    }
+
+private:
+    struct segment
+    {
+        char* base = nullptr;
+        std::size_t length = 0;     // mapped
+        std::size_t limit = 0;      // usable
+        std::uintmax_t offset = 0;  // in file
+        std::atomic<std::size_t> reserved{ 0 };
+        std::atomic<std::size_t> writers{ 0 };
+        std::atomic<bool> retired{ false };
+    };
+
+    void write_bytes(std::string const& msg)
+    {
+        append(msg.data(), msg.size());
+    }
+
+    void write_bytes(std::wstring const& msg)
+    {
+        std::string bytes;
+        string_traits<>::convert(bytes, msg);
+        append(bytes.data(), bytes.size());
+    }
+
+    void append(char const* p, std::size_t n)
+    {
+        for (;;)
+        {
+            auto const seg = current_.load(std::memory_order_acquire);
+            if (!seg)
+            {
+                return ;
+            }
+
+            seg->writers.fetch_add(1u);
+            auto const pos = seg->reserved.fetch_add(n);
+            if (pos + n <= seg->limit)
+            {
+                std::memcpy(seg->base + pos, p, n);
+                seg->writers.fetch_sub(1u, std::memory_order_release);
+                return ;
+            }
+            seg->writers.fetch_sub(1u, std::memory_order_release);
+
+            if (pos <= seg->limit)
+            {
+                // The reservation crossing the limit switches segment.
+                next_segment(seg, pos, n);
+                continue;
+            }
+            while (current_.load(std::memory_order_acquire) == seg)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void next_segment(segment* seg, std::size_t used, std::size_t n)
+    {
+        seg->retired.store(true);
+        while (seg->writers.load(std::memory_order_acquire) != 0)
+        {
+            std::this_thread::yield();
+        }
+
+        auto const file_size = seg->offset + used;
+        ::munmap(seg->base, seg->length);
+        seg->base = nullptr;
+
+        if (file_size != 0 && file_size + n > max_file_size_)
+        {
+            rotate(file_size);
+            current_.store(fd_ != -1 ? map(0, n) : nullptr
+                           , std::memory_order_release);
+            return ;
+        }
+        current_.store(map(file_size, n), std::memory_order_release);
+    }
+
+    void rotate(std::uintmax_t file_size)
+    {
+        ::ftruncate(fd_, static_cast<off_t>(file_size));
+        ::close(fd_);
+        fd_ = -1;
+        try
+        {
+            ::tinylog::detail::file_rename(filename_, filename_ + ".bak");
+        }
+        catch (...)
+        {
+            // Logging goes on in a new file as with rotating_file_sink,
+            // the old one is lost.
+        }
+        fd_ = ::open(filename_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        base::counters().rotations.add();
+    }
+
+    // Map a segment for writing from the end of file, room for n bytes
+    // at least.
+    segment* map(std::uintmax_t file_size, std::size_t n)
+    {
+        auto const page = static_cast<std::uintmax_t>(::sysconf(_SC_PAGESIZE));
+        auto const offset = file_size / page * page;
+        auto const head = static_cast<std::size_t>(file_size - offset);
+
+        std::uintmax_t limit = (std::max)(segment_size_, head + n);
+        if (max_file_size_ != npos && offset < max_file_size_)
+        {
+            limit = (std::min)(limit, (std::max)(max_file_size_ - offset
+                                                 , std::uintmax_t(head + n)));
+        }
+        auto const length = (limit + page - 1) / page * page;
+
+        if (::ftruncate(fd_, static_cast<off_t>(offset + length)) != 0)
+        {
+            return nullptr;
+        }
+        auto const base = ::mmap(nullptr, static_cast<std::size_t>(length)
+                                 , PROT_READ | PROT_WRITE, MAP_SHARED
+                                 , fd_, static_cast<off_t>(offset));
+        if (base == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        // Kept until closed, a thread may still hold a retired one.
+        segments_.emplace_back(new segment);
+        auto const seg = segments_.back().get();
+        seg->base = static_cast<char*>(base);
+        seg->length = static_cast<std::size_t>(length);
+        seg->limit = static_cast<std::size_t>(limit);
+        seg->offset = offset;
+        seg->reserved.store(head);
+        return seg;
+    }
+
+    void open(bool trunc)
+    {
+        fd_ = ::open(filename_.c_str()
+                     , O_RDWR | O_CREAT | (trunc ? O_TRUNC : 0), 0644);
+        if (fd_ == -1)
+        {
+            return ;
+        }
+
+        struct stat st;
+        std::uintmax_t file_size = 0;
+        if (::fstat(fd_, &st) == 0)
+        {
+            file_size = static_cast<std::uintmax_t>(st.st_size);
+        }
+        current_.store(map(file_size, 0), std::memory_order_release);
+    }
+
+    void close()
+    {
+        auto const seg = current_.exchange(nullptr);
+        if (seg)
+        {
+            seg->retired.store(true);
+            while (seg->writers.load(std::memory_order_acquire) != 0)
+            {
+                std::this_thread::yield();
+            }
+            auto const used = (std::min)(seg->reserved.load(), seg->limit);
+            ::munmap(seg->base, seg->length);
+            ::ftruncate(fd_, static_cast<off_t>(seg->offset + used));
+        }
+        if (fd_ != -1)
+        {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+private:
+    std::string filename_;
+    std::uintmax_t max_file_size_ = npos;
+    std::size_t segment_size_ = default_segment_size;
+    int fd_ = -1;
+    std::atomic<segment*> current_{ nullptr };
+    std::vector<std::unique_ptr<segment>> segments_;
+};
+
+template <class charT, class layoutT, class mutexT, class formatterT>
+constexpr std::uintmax_t
+basic_mmap_file_sink<charT, layoutT, mutexT
+                     , formatterT>::default_max_file_size;
+
+template <class charT, class layoutT, class mutexT, class formatterT>
+constexpr std::size_t
+basic_mmap_file_sink<charT, layoutT, mutexT
+                     , formatterT>::default_segment_size;
+
+template <class charT, class layoutT, class mutexT, class formatterT>
+constexpr std::uintmax_t
+basic_mmap_file_sink<charT, layoutT, mutexT, formatterT>::npos;
+
+using mmap_file_sink  = basic_mmap_file_sink<char>;
+using wmmap_file_sink = basic_mmap_file_sink<wchar_t>;
+
+#endif // TINYLOG_POSIX_API
+
+//----------------|
+// U8 File Sink   |
+//----------------|
+
+template <class charT, class layoutT = default_layout
+          , class mutexT = mutex_t
+          , class formatterT = formatter<charT, layoutT>>
+class basic_u8_file_sink
+    : public basic_file_sink<charT, layoutT, mutexT, formatterT>
+{
+public:
+    using base      = basic_file_sink<charT, layoutT, mutexT, formatterT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+public:
+    explicit basic_u8_file_sink(char const* filename
+                                , std::uintmax_t max_file_size
+                                = base::default_max_file_size
+                                , std::ios_base::openmode mode
+                                = std::ios_base::app
+                                , std::locale const& loc
+                                = std::locale(std::locale("")
+                                              , new std::codecvt_utf8<wchar_t>))
+        : base(filename, max_file_size, mode, loc)
+    {
+    }
+
+protected:
+    void before_write(level /*lvl*/, string_t& msg) override final
+    {
+        to_utf8(msg);
+    }
+
+private:
+    // Convert only if string_t is narrow type, the stream of unicode
+    // sinks encodes by its codecvt_utf8 facet.
+    static void to_utf8(std::basic_string<wchar_t>& /*msg*/)
+    {
+    }
+
+    static void to_utf8(std::basic_string<char>& msg)
+    {
+        using constructor = detail::utf8_constructor<char>;
+        if (constructor::is_utf8_already(msg))
+        {
+            return ;
+        }
+
+        std::string converted;
+        string_traits<u8string>::convert(converted, msg);
+        msg.swap(converted);
+    }
+};
+
+using u8_file_sink = basic_u8_file_sink<char>;
+using wu8_file_sink = basic_u8_file_sink<wchar_t>;
+
+//----------------|
+// Binary Sink    |
+//----------------|
+
+// Write records as a compact binary stream, [w]lfmt records as format id
+// and raw arguments, others as text. Decode by binary_log_reader or the
+// tinylog_decode tool.
+//
+// A new session starts once too many threads or call sites were seen, so
+// the tables of time deltas and format ids stay bounded.
+//
+// @see Binary Log
+template <class charT, class mutexT = mutex_t>
+class basic_binary_file_sink : public basic_sink_base<charT>
+{
+public:
+    using base      = basic_sink_base<charT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+public:
+    explicit basic_binary_file_sink(char const* filename
+                                    , std::ios_base::openmode mode
+                                    = std::ios_base::app)
+    {
+        ostrm_.rdbuf()->pubsetbuf(buffer_, sizeof(buffer_));
+        ostrm_.open(filename, mode | std::ios_base::out
+                              | std::ios_base::binary);
+        if (ostrm_.is_open())
+        {
+            start_session();
+        }
+    }
+
+    bool is_open() const override final
+    {
+        return ostrm_.is_open();
+    }
+
+    void consume(basic_record<char_type> const& r) override final
+    {
+        consume_impl(r);
+    }
+
+    void consume(basic_record_d<char_type> const& r) override final
+    {
+        consume_impl(r);
+    }
+
+    void flush() override final
+    {
+        std::lock_guard<mutexT> lock(mtx_);
+        ostrm_.flush();
+    }
+
+private:
+    template <class recordT>
+    void consume_impl(recordT const& r)
+    {
+        if (base::get_level() > r.lvl)
+        {
+            return ;
+        }
+
+        detail::timed_lock(mtx_, base::counters().lock_wait);
+        std::lock_guard<mutexT> lock(mtx_, std::adopt_lock);
+        base::counters().records.add();
+        if (last_time_.size() >= max_threads
+            || format_ids_.size() >= max_formats)
+        {
+            start_session();
+        }
+        body_.clear();
+        auto const lvl = static_cast<std::uint8_t>(r.lvl)
+                         | (base::is_verbose() ? detail::binary_verbose : 0);
+        body_.push_back(static_cast<char>(lvl));
+        detail::put_varint(body_, r.id);
+
+        auto& last = last_time_[r.id];
+        auto const usec = detail::time_usec(r.tv);
+        detail::put_varint(body_, detail::zigzag(usec - last));
+        last = usec;
+
+        if (r.payload)
+        {
+            auto const& p = *r.payload;
+            detail::put_varint(body_, format_id(*p.site));
+            detail::put_varint(body_, p.arg_count);
+            for (std::size_t i = 0; i != p.arg_count; ++i)
+            {
+                detail::put_fmt_arg(body_, p.args[i]);
+            }
+            detail::put_kv_fields(body_, r.fields);
+            write_frame(detail::binary_frame::record);
+            return ;
+        }
+
+        detail::put_string(body_, r.message);
+        put_location(r);
+        detail::put_kv_fields(body_, r.fields);
+        write_frame(detail::binary_frame::text);
+    }
+
+    void put_location(basic_record<char_type> const& /*r*/)
+    {
+        detail::put_varint(body_, 0);
+        detail::put_varint(body_, 0);
+        detail::put_varint(body_, 0);
+    }
+
+    void put_location(basic_record_d<char_type> const& r)
+    {
+        detail::put_string(body_, r.file_name());
+        detail::put_varint(body_, r.line_number());
+        detail::put_string(body_, r.func_name());
+    }
+
+    // Format ids and timestamps start over.
+    void start_session()
+    {
+        format_ids_.clear();
+        last_time_.clear();
+        ostrm_.write(detail::binary_magic, sizeof(detail::binary_magic) - 1);
+        ostrm_.put(static_cast<char>(detail::binary_version));
+        base::counters().bytes.add(sizeof(detail::binary_magic));
+    }
+
+    // Id of the call site, written to the dictionary on first use.
+    std::uint64_t format_id(detail::basic_fmt_site<char_type> const& site)
+    {
+        auto const it = format_ids_.find(&site);
+        if (it != format_ids_.end())
+        {
+            return it->second;
+        }
+
+        auto const id = static_cast<std::uint64_t>(format_ids_.size() + 1);
+        std::string frame;
+        detail::put_varint(frame, id);
+        detail::put_varint(frame, site.loc.line);
+        detail::put_string(frame, site.fmt);
+        detail::put_string(frame, site.loc.file);
+        detail::put_string(frame, site.loc.func);
+        write_frame(detail::binary_frame::format, frame);
+
+        format_ids_.emplace(&site, id);
+        return id;
+    }
+
+    void write_frame(detail::binary_frame type)
+    {
+        write_frame(type, body_);
+    }
+
+    void write_frame(detail::binary_frame type, std::string const& body)
+    {
+        char head[1 + 10];
+        std::string size;
+        detail::put_varint(size, body.size());
+        head[0] = static_cast<char>(type);
+        std::memcpy(head + 1, size.data(), size.size());
+        ostrm_.write(head, static_cast<std::streamsize>(1 + size.size()));
+        ostrm_.write(body.data(), static_cast<std::streamsize>(body.size()));
+        base::counters().bytes.add(1 + size.size() + body.size());
+    }
+
+private:
+    static constexpr std::size_t max_threads = 1024;
+    static constexpr std::size_t max_formats = 64 * 1024;
+
+    mutexT mtx_;
+    std::ofstream ostrm_;
+    char buffer_[64 * 1024];
+    std::string body_;
+    std::unordered_map<void const*, std::uint64_t> format_ids_;
+    std::unordered_map<std::uintmax_t, std::int64_t> last_time_;
+};
+
+using binary_file_sink  = basic_binary_file_sink<char>;
+using wbinary_file_sink = basic_binary_file_sink<wchar_t>;
+
+//----------------|
+// MSVC Sink      |
+//----------------|
+
+#if defined(TINYLOG_WINDOWS_API)
+
+template <class charT, class layoutT = default_layout
+          , class mutexT = mutex_t
+          , class formatterT = formatter<charT, layoutT>>
+class basic_msvc_sink
+    : public basic_sink<charT, layoutT, mutexT, formatterT>
+{
+public:
+    using base      = basic_sink<charT, layoutT, mutexT, formatterT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+public:
+    bool is_open() const override final
+    {
+        return true;
+    }
+
+protected:
+    void writing(level /*lvl*/, string_t& msg) override final
+    {
+        writing_impl(msg);
+    }
+
+private:
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, char>::value
+                                        , int>::type = 0>
+    void writing_impl(std::basic_string<lineCharT> const& line) const
+    {
+        ::OutputDebugStringA(line.c_str());
+    }
+
+    template <class lineCharT
+              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
+                                        , int>::type = 0>
+    void writing_impl(std::basic_string<lineCharT> const& line) const
+    {
+        ::OutputDebugStringW(line.c_str());
+    }
+};
+
+using msvc_sink = basic_msvc_sink<char>;
+using wmsvc_sink= basic_msvc_sink<wchar_t>;
+
+#endif  // TINYLOG_WINDOWS_API
+
+}  // namespace sink
+
+/*****************************************************************************/
+/* Sink Adapter: Adapt narrow and unicode charactor. */
+
+namespace detail
+{
+
+// Call site converted to the other char type, kept for the process
+// lifetime as converted records refer to it.
+template <class charT>
+struct converted_location : public basic_source_location<charT>
+{
+    std::basic_string<charT> file_storage;
+};
+
+// Call site of loc in charT, converted once per call site.
+template <class charT, class fromCharT>
+basic_source_location<charT> const*
+convert_location(basic_source_location<fromCharT> const& loc)
+{
+    using location_t = converted_location<charT>;
+    using cache_t    = std::unordered_map<void const*, location_t const*>;
+
+    // Look up sites seen by this thread without locking.
+    static thread_local cache_t local;
+    auto const it = local.find(&loc);
+    if (it != local.end())
+    {
+        return it->second;
+    }
+
+    static std::mutex mtx;
+    static std::unordered_map<void const*
+                              , std::unique_ptr<location_t>> converted;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    auto& p = converted[&loc];
+    if (!p)
+    {
+        std::unique_ptr<location_t> l(new location_t);
+        if (loc.file)
+        {
+            string_traits<>::convert(l->file_storage
+                                     , std::basic_string<fromCharT>(loc.file));
+        }
+        l->file = loc.file ? l->file_storage.c_str() : nullptr;
+        l->line = loc.line;
+        string_traits<>::convert(l->func, loc.func);
+        p = std::move(l);
+    }
+    local.emplace(&loc, p.get());
+    return p.get();
+}
+
+// Convert record to the other char type, payload is dropped.
+template <class charT, class fromCharT>
+void convert_record(basic_record<fromCharT> const& from
+                    , basic_record<charT>& to)
+{
+    to.tv  = from.tv;
+    to.lvl = from.lvl;
+    to.id  = from.id;
+    string_traits<>::convert(to.message, from.message);
+    to.payload = nullptr;
+    to.stamp = from.stamp;
+    to.fields.assign(from.fields);
+}
+
+template <class charT, class fromCharT>
+void convert_record(basic_record_d<fromCharT> const& from
+                    , basic_record_d<charT>& to)
+{
+    convert_record(static_cast<basic_record<fromCharT> const&>(from)
+                   , static_cast<basic_record<charT>&>(to));
+    if (from.location)
+    {
+        to.location = convert_location<charT>(*from.location);
+        to.file.clear();
+        to.line = 0;
+        to.func.clear();
+        return ;
+    }
+
+    to.location = nullptr;
+    string_traits<>::convert(to.file, from.file);
+    to.line = from.line;
+    string_traits<>::convert(to.func, from.func);
+}
+
+// Messages formatted for a record and the record converted to the other
+// char type, shared by the sinks of a logger.
+class formatted_text
+{
+public:
+    template <class charT>
+    struct entry
+    {
+        void const* key = nullptr;
+        std::basic_string<charT> msg;
+    };
+
+public:
+    // A sink will be handed the message of key.
+    void expect(void const* key)
+    {
+        if (!key)
+        {
+            return ;
+        }
+        for (auto& u : users_)
+        {
+            if (u.first == key)
+            {
+                ++u.second;
+                return ;
+            }
+        }
+        users_.emplace_back(key, 1u);
+    }
+
+    // Return true if no other sink expects the message of key, the caller
+    // may modify it then.
+    bool release(void const* key)
+    {
+        for (auto& u : users_)
+        {
+            if (u.first == key && u.second != 0)
+            {
+                return --u.second == 0;
+            }
+        }
+        return false;
+    }
+
+    // Formatted message of key, format it by fmt if not yet.
+    template <class charT, class formatT>
+    std::basic_string<charT>& get(void const* key, formatT&& fmt)
+    {
+        auto& entries = select(static_cast<charT const*>(nullptr));
+        for (auto& e : entries)
+        {
+            if (e.key == key)
+            {
+                return e.msg;
+            }
+        }
+
+        auto& e = entries[next_++ % max_entries];
+        e.key = nullptr;
+        fmt(e.msg);
+        e.key = key;
+        return e.msg;
+    }
+
+    // Record r in charT, convert it if not yet.
+    template <class charT, class fromCharT>
+    basic_record<charT> const& converted(basic_record<fromCharT> const& r)
+    {
+        auto& c = converted_of(static_cast<charT const*>(nullptr));
+        if (!c.ready)
+        {
+            convert_record(r, static_cast<basic_record<charT>&>(c.record));
+            c.ready = true;
+        }
+        return c.record;
+    }
+
+    template <class charT, class fromCharT>
+    basic_record_d<charT> const& converted(basic_record_d<fromCharT> const& r)
+    {
+        auto& c = converted_of(static_cast<charT const*>(nullptr));
+        if (!c.ready)
+        {
+            convert_record(r, c.record);
+            c.ready = true;
+        }
+        return c.record;
+    }
+
+    // Forget messages and records of the last record, buffers are kept.
+    void reset()
+    {
+        for (auto& e : narrow_)
+        {
+            e.key = nullptr;
+        }
+        for (auto& e : wide_)
+        {
+            e.key = nullptr;
+        }
+        next_ = 0;
+        users_.clear();
+        narrow_record_.ready = false;
+        wide_record_.ready = false;
+    }
+
+private:
+    static constexpr std::size_t max_entries = 4;
+
+    template <class charT>
+    struct converted_entry
+    {
+        bool ready = false;
+        basic_record_d<charT> record;
+    };
+
+    entry<char> (&select(char const*))[max_entries]
+    {
+        return narrow_;
+    }
+
+    entry<wchar_t> (&select(wchar_t const*))[max_entries]
+    {
+        return wide_;
+    }
+
+    converted_entry<char>& converted_of(char const*)
+    {
+        return narrow_record_;
+    }
+
+    converted_entry<wchar_t>& converted_of(wchar_t const*)
+    {
+        return wide_record_;
+    }
+
+private:
+    entry<char> narrow_[max_entries];
+    entry<wchar_t> wide_[max_entries];
+    std::size_t next_ = 0;
+    std::vector<std::pair<void const*, std::size_t>> users_;
+
+    converted_entry<char> narrow_record_;
+    converted_entry<wchar_t> wide_record_;
+};
+
+// Thread local formatted_text of a dispatch, falls back to a local one
+// when already in use (i.e. a sink logs while writing).
+class scratch_text
+{
+public:
+    scratch_text() : owner_(!busy())
+    {
+        busy() = true;
+    }
+
+    ~scratch_text()
+    {
+        if (owner_)
+        {
+            busy() = false;
+        }
+    }
+
+    scratch_text(scratch_text const&) = delete;
+    scratch_text& operator=(scratch_text const&) = delete;
+
+    formatted_text& get()
+    {
+        if (!owner_)
+        {
+            local_.reset(new formatted_text);
+            return *local_;
+        }
+        auto& text = shared();
+        text.reset();
+        return text;
+    }
+
+private:
+    static bool& busy()
+    {
+        static thread_local bool b = false;
+        return b;
+    }
+
+    static formatted_text& shared()
+    {
+        static thread_local formatted_text text;
+        return text;
+    }
+
+private:
+    bool owner_;
+    std::unique_ptr<formatted_text> local_;
+};
+
+// Batch of records converted to the other char type, shared by the sinks
+// of a logger.
+template <class charT>
+class converted_batch
+{
+public:
+    using span_t = basic_record_span<charT>;
+
+    // Records in charT, convert them if not yet.
+    template <class fromCharT>
+    span_t const& get(basic_record_span<fromCharT> const& from)
+    {
+        if (ready_)
+        {
+            return span_;
+        }
+
+        // Sized first, items point into the records.
+        records_.resize(from.size);
+        items_.clear();
+        std::size_t i = 0;
+        for (auto const& it : from)
+        {
+            auto& to = records_[i++];
+            if (it.detailed)
+            {
+                convert_record(static_cast<basic_record_d<fromCharT> const&>(
+                                   *it.record), to);
+            }
+            else
+            {
+                convert_record(*it.record
+                               , static_cast<basic_record<charT>&>(to));
+            }
+            items_.push_back({ &to, it.detailed });
+        }
+
+        span_ = span_t{ items_.data(), items_.size() };
+        ready_ = true;
+        return span_;
+    }
+
+    // Drop records converted, for the next batch.
+    void reset()
+    {
+        ready_ = false;
+    }
+
+private:
+    bool ready_ = false;
+    std::vector<basic_record_d<charT>> records_;
+    std::vector<typename span_t::item> items_;
+    span_t span_{ nullptr, 0 };
+};
+
+struct sink_adapter_base
+{
+    explicit operator bool() const
+    {
+        return is_open();
+    }
+
+    bool operator!() const
+    {
+        return !is_open();
+    }
+
+    virtual bool is_open() const = 0;
+
+    virtual void consume(basic_record<char> const& r) = 0;
+    virtual void consume(basic_record<wchar_t> const& r) = 0;
+
+    virtual void consume(basic_record_d<char> const& r) = 0;
+    virtual void consume(basic_record_d<wchar_t> const& r) = 0;
+
+    // Sink level passes.
+    virtual bool accept(level lvl) const = 0;
+
+    // Key of the message the sink shares, nullptr if none.
+    virtual void const* format_key() const = 0;
+
+    // Reuse message formatted by other sinks if possible.
+    virtual void consume(basic_record<char> const& r
+                         , formatted_text& text) = 0;
+    virtual void consume(basic_record<wchar_t> const& r
+                         , formatted_text& text) = 0;
+
+    virtual void consume(basic_record_d<char> const& r
+                         , formatted_text& text) = 0;
+    virtual void consume(basic_record_d<wchar_t> const& r
+                         , formatted_text& text) = 0;
+
+    // Reuse records converted for other sinks if possible.
+    virtual void consume_batch(basic_record_span<char> const& records
+                               , converted_batch<wchar_t>& converted) = 0;
+    virtual void consume_batch(basic_record_span<wchar_t> const& records
+                               , converted_batch<char>& converted) = 0;
+
+    virtual void flush() = 0;
+};
+
+template <class charT>
+struct basic_sink_adapter : public sink_adapter_base
+{
+    using char_type   = typename std::conditional<
+        std::is_same<charT, char>::value, char, wchar_t>::type;
+    using extern_type = typename std::conditional<
+        !std::is_same<charT, char>::value, char , wchar_t>::type;
+
+    using string_t    = std::basic_string<char_type>;
+    using sink_t      = std::shared_ptr<sink::basic_sink_base<char_type>>;
+
+public:
+    explicit basic_sink_adapter(sink_t sk) : sink_(sk)
+    {
+    }
+
+public:
+    bool is_open() const override final
+    {
+        return sink_ && sink_->is_open();
+    }
+
+    void consume(basic_record<char_type> const& r) override
+    {
+        sink_->consume(r);
+    }
+    void consume(basic_record<extern_type> const& r) override
+    {
+        basic_record<char_type> converted;
+        convert_record(r, converted);
+        sink_->consume(converted);
+    }
+
+    void consume(basic_record_d<char_type> const& r) override
+    {
+        sink_->consume(r);
+    }
+    void consume(basic_record_d<extern_type> const& r) override
+    {
+        basic_record_d<char_type> converted;
+        convert_record(r, converted);
+        sink_->consume(converted);
+    }
+
+    bool accept(level lvl) const override
+    {
+        return lvl >= sink_->get_level();
+    }
+
+    void const* format_key() const override
+    {
+        return sink_->format_key();
+    }
+
+    void consume_batch(basic_record_span<char_type> const& records
+                       , converted_batch<extern_type>& /*converted*/) override
+    {
+        sink_->consume_batch(records);
+    }
+    void consume_batch(basic_record_span<extern_type> const& records
+                       , converted_batch<char_type>& converted) override
+    {
+        sink_->consume_batch(converted.get(records));
+    }
+
+    void flush() override
+    {
+        sink_->flush();
+    }
+
+    void consume(basic_record<char_type> const& r
+                 , formatted_text& text) override
+    {
+        consume_impl(r, text);
+    }
+    void consume(basic_record<extern_type> const& r
+                 , formatted_text& text) override
+    {
+        consume_impl(text.converted<char_type>(r), text);
+    }
+
+    void consume(basic_record_d<char_type> const& r
+                 , formatted_text& text) override
+    {
+        consume_impl(r, text);
+    }
+    void consume(basic_record_d<extern_type> const& r
+                 , formatted_text& text) override
+    {
+        consume_impl(text.converted<char_type>(r), text);
+    }
+
+private:
+    template <class recordT>
+    void consume_impl(recordT const& r, formatted_text& text)
+    {
+        auto const key = sink_->format_key();
+        if (!key)
+        {
+            consume(r);
+            return ;
+        }
+
+        auto& msg = text.get<char_type>(key, [&](string_t& s)
+                                         {
+                                             sink_->format(r, s);
+                                         });
+        sink_->consume_formatted(r.lvl, msg, text.release(key));
+    }
+
+private:
+    sink_t sink_;
+};
+
+}  // namesapce detail
+
+/*****************************************************************************/
+/* Async Queue: Hand records over to background threads. */
+
+// What to do when the queue of an async logger is full.
+enum class overflow_policy : std::uint8_t
+{
+    block,          // wait until a worker thread frees a slot
+    drop_newest,    // discard the record being pushed
+    drop_oldest     // discard the oldest queued record
+};
+
+namespace detail
+{
+
+template <class recordT>
+struct record_kind;
+
+// Holds one record of any char type, so that a single queue carries both
+// narrow and unicode records.
+class record_entry
+{
+public:
+    enum class kind : std::uint8_t
+    {
+        none, narrow, narrow_d, wide, wide_d
+    };
+
+    record_entry() = default;
+
+    record_entry(record_entry&& other)
+    {
+        *this = std::move(other);
+    }
+
+    record_entry& operator=(record_entry&& other)
+    {
+        if (this == &other)
+        {
+            return *this;
+        }
+
+        switch (other.kind_)
+        {
+        case kind::narrow:
+            assign(std::move(other.get<basic_record<char>>()));
+            break;
+        case kind::narrow_d:
+            assign(std::move(other.get<basic_record_d<char>>()));
+            break;
+        case kind::wide:
+            assign(std::move(other.get<basic_record<wchar_t>>()));
+            break;
+        case kind::wide_d:
+            assign(std::move(other.get<basic_record_d<wchar_t>>()));
+            break;
+        default:
+            reset();
+            break;
+        }
+        return *this;
+    }
+
+    record_entry(record_entry const&) = delete;
+    record_entry& operator=(record_entry const&) = delete;
+
+    ~record_entry()
+    {
+        reset();
+    }
+
+    // A record of the same kind held is reused, moving a record in swaps
+    // their strings so buffers go around instead of being freed.
+    template <class recordT>
+    void assign(recordT&& r)
+    {
+        using record_t = typename std::decay<recordT>::type;
+
+        if (kind_ == record_kind<record_t>::value)
+        {
+            reuse<record_t>(get<record_t>(), std::forward<recordT>(r));
+            return ;
+        }
+
+        reset();
+        ::new (static_cast<void*>(&storage_)) record_t(std::forward<recordT>(r));
+        kind_ = record_kind<record_t>::value;
+    }
+
+    // Free the record held if its message buffer is larger than
+    // max_retained characters, otherwise keep it for reuse.
+    void trim(std::size_t max_retained)
+    {
+        std::size_t capacity = 0;
+        switch (kind_)
+        {
+        case kind::narrow:
+        case kind::narrow_d:
+            capacity = get<basic_record<char>>().message.capacity();
+            break;
+        case kind::wide:
+        case kind::wide_d:
+            capacity = get<basic_record<wchar_t>>().message.capacity();
+            break;
+        default:
+            break;
+        }
+        if (capacity > max_retained)
+        {
+            reset();
+        }
+    }
+
+    void reset()
+    {
+        switch (kind_)
+        {
+        case kind::narrow:
+            destroy<basic_record<char>>();
+            break;
+        case kind::narrow_d:
+            destroy<basic_record_d<char>>();
+            break;
+        case kind::wide:
+            destroy<basic_record<wchar_t>>();
+            break;
+        case kind::wide_d:
+            destroy<basic_record_d<wchar_t>>();
+            break;
+        default:
+            break;
+        }
+        kind_ = kind::none;
+    }
+
+    kind get_kind() const
+    {
+        return kind_;
+    }
+
+    // Call visitor with the record it holds.
+    template <class visitorT>
+    void visit(visitorT&& visitor) const
+    {
+        visit_impl(*this, visitor);
+    }
+
+    template <class visitorT>
+    void visit(visitorT&& visitor)
+    {
+        visit_impl(*this, visitor);
+    }
+
+private:
+    template <class entryT, class visitorT>
+    static void visit_impl(entryT& e, visitorT& visitor)
+    {
+        switch (e.kind_)
+        {
+        case kind::narrow:
+            visitor(e.template get<basic_record<char>>());
+            break;
+        case kind::narrow_d:
+            visitor(e.template get<basic_record_d<char>>());
+            break;
+        case kind::wide:
+            visitor(e.template get<basic_record<wchar_t>>());
+            break;
+        case kind::wide_d:
+            visitor(e.template get<basic_record_d<wchar_t>>());
+            break;
+        default:
+            break;
+        }
+    }
+
+    template <class recordT>
+    recordT& get()
+    {
+        return *reinterpret_cast<recordT*>(&storage_);
+    }
+
+    template <class recordT>
+    recordT const& get() const
+    {
+        return *reinterpret_cast<recordT const*>(&storage_);
+    }
+
+    template <class recordT>
+    void destroy()
+    {
+        get<recordT>().~recordT();
+    }
+
+    template <class recordT>
+    static void reuse(recordT& to, recordT const& from)
+    {
+        to = from;
+    }
+
+    template <class recordT>
+    static void reuse(recordT& to, recordT&& from)
+    {
+        exchange(to, from);
+    }
+
+    template <class charT>
+    static void exchange(basic_record<charT>& to, basic_record<charT>& from)
+    {
+        to.tv = from.tv;
+        to.lvl = from.lvl;
+        to.id = from.id;
+        to.message.swap(from.message);
+        to.payload = from.payload;
+        to.stamp = from.stamp;
+        to.fields.swap(from.fields);
+    }
+
+    template <class charT>
+    static void exchange(basic_record_d<charT>& to
+                         , basic_record_d<charT>& from)
+    {
+        exchange(static_cast<basic_record<charT>&>(to)
+                 , static_cast<basic_record<charT>&>(from));
+        to.file.swap(from.file);
+        to.line = from.line;
+        to.func.swap(from.func);
+        to.location = from.location;
+    }
+
+private:
+    using storage_t = typename std::aligned_union<0
+                                                  , basic_record_d<char>
+                                                  , basic_record_d<wchar_t>
+                                                  >::type;
+    storage_t storage_;
+    kind kind_ = kind::none;
+};
+
+template <>
+struct record_kind<basic_record<char>>
+    : std::integral_constant<record_entry::kind, record_entry::kind::narrow>
+{};
+
+template <>
+struct record_kind<basic_record_d<char>>
+    : std::integral_constant<record_entry::kind, record_entry::kind::narrow_d>
+{};
+
+template <>
+struct record_kind<basic_record<wchar_t>>
+    : std::integral_constant<record_entry::kind, record_entry::kind::wide>
+{};
+
+template <>
+struct record_kind<basic_record_d<wchar_t>>
+    : std::integral_constant<record_entry::kind, record_entry::kind::wide_d>
+{};
+
+// Collect records of charT held by entries into items of a span.
+template <class charT>
+struct span_collector
+{
+    using item = typename basic_record_span<charT>::item;
+
+    void operator()(basic_record<charT> const& r) const
+    {
+        items.push_back(item{ &r, false });
+    }
+
+    void operator()(basic_record_d<charT> const& r) const
+    {
+        items.push_back(item{ &r, true });
+    }
+
+    template <class recordT>
+    void operator()(recordT const& /*r*/) const
+    {
+    }
 
-#endif  // TINYLOG_WINDOWS_API
+    std::vector<item>& items;
 };
 
-enum class emphasize
+// Bounded multi-producer multi-consumer queue, producers and consumers never
+// block each other.
+//
+// @see http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+template <class T>
+class bounded_queue
 {
-#if defined(TINYLOG_WINDOWS_API)
+public:
+    // Capacity is rounded up to a power of two.
+    explicit bounded_queue(std::size_t capacity)
+        : mask_(round_up(capacity) - 1)
+        , cells_(new cell[mask_ + 1])
+    {
+        for (std::size_t i = 0; i != mask_ + 1; ++i)
+        {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+        dequeue_pos_.store(0, std::memory_order_relaxed);
+    }
 
-    normal      = 0
-    , bold      = FOREGROUND_INTENSITY
+    bounded_queue(bounded_queue const&) = delete;
+    bounded_queue& operator=(bounded_queue const&) = delete;
 
-#else
+    std::size_t capacity() const
+    {
+        return mask_ + 1;
+    }
 
-    normal      = 22
-    , bold      = 1
+    // Approximate number of queued elements.
+    std::size_t size() const
+    {
+        auto const tail = dequeue_pos_.load(std::memory_order_relaxed);
+        auto const head = enqueue_pos_.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
 
-#endif  // TINYLOG_WINDOWS_API
-};
+    bool empty() const
+    {
+        auto const pos = dequeue_pos_.load(std::memory_order_relaxed);
+        auto const seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+        return seq != pos + 1;
+    }
 
-struct rgb
-{
-    foreground fg;
-    background bg;
-    emphasize  em;
-};
+    // Element is moved only if pushing succeeds.
+    bool try_push(T&& v)
+    {
+        cell* c = nullptr;
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            c = &cells_[pos & mask_];
+            auto const seq = c->seq.load(std::memory_order_acquire);
+            auto const dif = static_cast<std::intptr_t>(seq)
+                - static_cast<std::intptr_t>(pos);
+            if (dif == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
 
-template <class charT>
-struct basic_style_impl
-{
-    using char_type     = charT;
-    using string_t      = std::basic_string<char_type>;
+        c->data = std::move(v);
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
 
-    static rgb curr_rgb(bool raw = false)
+    bool try_pop(T& v)
     {
-#if defined(TINYLOG_WINDOWS_API)
+        cell* c = nullptr;
+        auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            c = &cells_[pos & mask_];
+            auto const seq = c->seq.load(std::memory_order_acquire);
+            auto const dif = static_cast<std::intptr_t>(seq)
+                - static_cast<std::intptr_t>(pos + 1);
+            if (dif == 0)
+            {
+                if (dequeue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
 
-        CONSOLE_SCREEN_BUFFER_INFO info;
-        auto handle = ::GetStdHandle(STD_OUTPUT_HANDLE);
-        ::GetConsoleScreenBufferInfo(handle, &info);
+        v = std::move(c->data);
+        c->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
 
-        auto fg = static_cast<foreground>(info.wAttributes & 0x07);
-        auto bg = static_cast<background>(info.wAttributes & 0x70);
-        auto em = static_cast<emphasize>(info.wAttributes & 0x08);
+private:
+    static std::size_t round_up(std::size_t n)
+    {
+        std::size_t r = 2;
+        while (r < n)
+        {
+            r <<= 1;
+        }
+        return r;
+    }
 
-#else
+private:
+    struct cell
+    {
+        std::atomic<std::size_t> seq;
+        T data;
+    };
 
-        auto fg = raw ? static_cast<foreground>(39) : curr_.fg;
-        auto bg = raw ? static_cast<background>(49) : curr_.bg;
-        auto em = raw ? static_cast<emphasize>(22) : curr_.em;
+    std::size_t const mask_;
+    std::unique_ptr<cell[]> const cells_;
 
-#endif  // TINYLOG_WINDOWS_API
+    // Keep producers and consumers on different cache lines.
+    char pad0_[cache_line_size];
+    std::atomic<std::size_t> enqueue_pos_;
+    char pad1_[cache_line_size - sizeof(std::atomic<std::size_t>)];
+    std::atomic<std::size_t> dequeue_pos_;
+    char pad2_[cache_line_size - sizeof(std::atomic<std::size_t>)];
+};
 
-        if (raw)
+// Drain queued records on background threads, a batch at a time.
+class async_worker
+{
+public:
+    using handler_t = std::function<void(record_entry* entries
+                                         , std::size_t n)>;
+
+    static constexpr std::size_t max_batch = 64;
+
+    // Larger message buffer is not kept by a record popped.
+    static constexpr std::size_t max_retained = 64 * 1024;
+
+public:
+    explicit async_worker(handler_t handler
+                          , std::size_t queue_capacity
+                          , overflow_policy policy
+                          , std::size_t thread_count)
+        : handler_(std::move(handler))
+        , queue_(queue_capacity)
+        , policy_(policy)
+    {
+        if (thread_count == 0)
         {
-            // nothing to do.
+            thread_count = 1;
         }
-        else if (reset_)
+        for (std::size_t i = 0; i != thread_count; ++i)
         {
-            reset_ = false;
+            threads_.emplace_back(&async_worker::run, this);
         }
+    }
 
-        return { fg, bg, em };
+    async_worker(async_worker const&) = delete;
+    async_worker& operator=(async_worker const&) = delete;
+
+    // Queued records are written before the threads exit.
+    ~async_worker()
+    {
+        stop_.store(true, std::memory_order_seq_cst);
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            work_cv_.notify_all();
+        }
+        for (auto& t : threads_)
+        {
+            if (t.joinable())
+            {
+                t.join();
+            }
+        }
     }
 
-    static rgb curr_rgb_raw()
+public:
+    // Return false if the record is dropped.
+    bool push(record_entry&& e)
     {
-        bool raw = true;
-        return curr_rgb(raw);
+        enqueued_.fetch_add(1, std::memory_order_relaxed);
+        for (std::size_t spin = 0; !queue_.try_push(std::move(e)); ++spin)
+        {
+            if (policy_ == overflow_policy::drop_newest)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                mark_processed();
+                return false;
+            }
+
+            notify_worker();
+            if (policy_ == overflow_policy::drop_oldest)
+            {
+                record_entry oldest;
+                if (queue_.try_pop(oldest))
+                {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    mark_processed();
+                }
+                continue;
+            }
+
+            // overflow_policy::block
+            if (spin < 64)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+#if defined(TINYLOG_ENABLE_STATS)
+        high_water_.update(queue_.size());
+#endif // TINYLOG_ENABLE_STATS
+        notify_worker();
+        return true;
     }
 
-    static string_t set_rgb(rgb const& c)
+    // Wait until all records pushed before are handled.
+    void flush()
     {
-#if defined(TINYLOG_WINDOWS_API)
+        auto const target = enqueued_.load(std::memory_order_acquire);
 
-        CONSOLE_SCREEN_BUFFER_INFO info;
-        auto handle = ::GetStdHandle(STD_OUTPUT_HANDLE);
-        ::GetConsoleScreenBufferInfo(handle, &info);
+        std::unique_lock<std::mutex> lock(mtx_);
+        flushers_.fetch_add(1, std::memory_order_seq_cst);
+        work_cv_.notify_all();
+        while (processed_.load(std::memory_order_acquire) < target)
+        {
+            done_cv_.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        flushers_.fetch_sub(1, std::memory_order_relaxed);
+    }
 
-        info.wAttributes &= 0xFF80;
-        using attr_t    = decltype(info.wAttributes);
-        auto fg         = static_cast<attr_t>(c.fg);
-        auto bg         = (info.wAttributes & 0x70) | static_cast<attr_t>(c.bg);
-        auto em         = static_cast<attr_t>(c.em);
+    std::uint64_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
 
-        info.wAttributes |= fg;
-        info.wAttributes |= bg;
-        info.wAttributes |= em;
-        ::SetConsoleTextAttribute(handle, info.wAttributes);
-        return string_t();
+    // Records of batches a sink threw on.
+    std::uint64_t failed() const
+    {
+        return failed_.load(std::memory_order_relaxed);
+    }
 
-#else
+    // Most records queued at once, @see TINYLOG_ENABLE_STATS.
+    std::uint64_t high_water() const
+    {
+        return high_water_.load();
+    }
 
-        curr_ = c;
+    std::size_t capacity() const
+    {
+        return queue_.capacity();
+    }
 
-        std::basic_ostringstream<char_type> oss;
-        auto calc = [&oss](std::size_t n)
-                    {
-                        oss << oss.widen('\033') << oss.widen('[')
-                            << n << oss.widen('m');
-                    };
-        calc(static_cast<std::size_t>(curr_.fg));
-        calc(static_cast<std::size_t>(curr_.bg));
-        calc(static_cast<std::size_t>(curr_.em));
+private:
+    void run()
+    {
+        std::vector<record_entry> batch(max_batch);
+        for (;;)
+        {
+            std::size_t n = 0;
+            while (n != max_batch && queue_.try_pop(batch[n]))
+            {
+                ++n;
+            }
+            if (n != 0)
+            {
+                handle(batch.data(), n);
+                continue;
+            }
+            if (stop_.load(std::memory_order_acquire) && queue_.empty())
+            {
+                break;
+            }
+            wait_for_work();
+        }
+    }
 
-        return oss.str();
+    void handle(record_entry* entries, std::size_t n)
+    {
+        try
+        {
+            handler_(entries, n);
+        }
+        catch (...)
+        {
+            // A throwing sink must not stop the worker, the batch is
+            // counted and logging goes on.
+            failed_.fetch_add(n, std::memory_order_relaxed);
+        }
+        // Records are kept for reuse by the next ones popped.
+        for (std::size_t i = 0; i != n; ++i)
+        {
+            entries[i].trim(max_retained);
+        }
+        mark_processed(n);
+    }
 
-#endif  // TINYLOG_WINDOWS_API
+    void mark_processed(std::uint64_t n = 1)
+    {
+        processed_.fetch_add(n, std::memory_order_release);
+        if (flushers_.load(std::memory_order_seq_cst) != 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            done_cv_.notify_all();
+        }
     }
 
-    static string_t set_rgb_raw()
+    void wait_for_work()
     {
-        reset_ = true;
-        return set_rgb(default_);
+        std::unique_lock<std::mutex> lock(mtx_);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        if (queue_.empty() && !stop_.load(std::memory_order_acquire))
+        {
+            // Timeout only guards against a missed notification.
+            work_cv_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void notify_worker()
+    {
+        // Pairs with sleepers_ increment in wait_for_work().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) != 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            work_cv_.notify_one();
+        }
     }
 
 private:
-    static rgb default_;
-    static bool reset_;
-    static rgb curr_;
+    handler_t handler_;
+    bounded_queue<record_entry> queue_;
+    overflow_policy const policy_;
+
+    std::atomic<std::uint64_t> enqueued_{0};
+    std::atomic<std::uint64_t> processed_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> failed_{0};
+    stats_max high_water_;
+
+    std::atomic<std::size_t> sleepers_{0};
+    std::atomic<std::size_t> flushers_{0};
+    std::atomic<bool> stop_{false};
+
+    std::mutex mtx_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::vector<std::thread> threads_;
 };
 
-template <class charT>
-rgb basic_style_impl<charT>::default_ = basic_style_impl<charT>::curr_rgb_raw();
-
-template <class charT>
-bool basic_style_impl<charT>::reset_ = true;
-
-template <class charT>
-rgb basic_style_impl<charT>::curr_ = basic_style_impl<charT>::curr_rgb_raw();
+}  // namespace detail
 
-template <class charT>
-void style(std::basic_string<charT>& color, foreground fg)
-{
-    using impl  = basic_style_impl<charT>;
-    auto curr   = impl::curr_rgb();
-    curr.fg     = fg;
-    color       = impl::set_rgb(curr);
-}
+/*****************************************************************************/
+/* Sharded Sink: Per-thread shards merged into one sink. */
 
-template <class charT>
-void style(std::basic_string<charT>& color, background bg)
+namespace detail
 {
-    using impl  = basic_style_impl<charT>;
-    auto curr   = impl::curr_rgb();
-    curr.bg     = bg;
-    color       = impl::set_rgb(curr);
-}
 
-template <class charT>
-void style(std::basic_string<charT>& color, emphasize em)
+struct payload_dropper
 {
-    using impl  = basic_style_impl<charT>;
-    auto curr   = impl::curr_rgb();
-    curr.em     = em;
-    color       = impl::set_rgb(curr);
-}
+    template <class recordT>
+    void operator()(recordT& r) const
+    {
+        r.payload = nullptr;
+    }
+};
 
-template <class charT>
-void style(std::basic_string<charT>& color)
+// Queued record and its time in microseconds, the key of merging.
+struct timed_entry
 {
-    using impl  = basic_style_impl<charT>;
-    color       = impl::set_rgb_raw();
-}
-
-}  // namespace detail
-
-/*****************************************************************************/
-/* Log Sink:
- *   - console_sink
- *   - file_sink
- *   - u8_file_sink
- *   - msvc_sink
- */
-
-#if defined(TINYLOG_USE_SINGLE_THREAD)
-using mutex_t = detail::null_mutex;
-#else
-using mutex_t = std::mutex;
-#endif
+    // Buffers held are reused, the payload doesn't outlive the call.
+    template <class recordT>
+    void assign(recordT const& r)
+    {
+        usec = time_usec(r.tv);
+        entry.assign(r);
+        entry.visit(payload_dropper{});
+    }
+
+    std::int64_t usec = 0;
+    record_entry entry;
+};
+
+}  // namespace detail
 
 namespace sink
 {
 
-template <class charT>
-class basic_sink_base
+struct shard_policy
 {
-public:
-    using char_type = charT;
-    using string_t  = std::basic_string<char_type>;
+    // Thread of id N appends to shard N % shard_count.
+    std::size_t shard_count = 8;
 
-    virtual ~basic_sink_base() = default;
+    // Records a shard holds, the thread merges shards itself if full.
+    std::size_t shard_capacity = 1024;
+
+    // Merge shards into the sink periodically, 0 to merge on flush only.
+    std::chrono::milliseconds interval = std::chrono::milliseconds(10);
+};
+
+// Let threads log to one sink without queuing on its mutex. Each thread
+// appends to its own lock-free shard, shards are merged into the sink in
+// time order by a combiner thread, on flush, or by a thread that finds
+// its shard full.
+//
+// Records of one merge are sorted by time, a record queued behind a merge
+// may still be written after later ones of other threads.
+//
+// e.g.
+//   auto fsk = std::make_shared<sink::file_sink>("d:\\default.log");
+//   inst->create_sink<sink::sharded_sink>(fsk);
+//
+// @attention The combiner thread is disabled if mutexT is
+//            detail::null_mutex.
+template <class charT, class mutexT = mutex_t>
+class basic_sharded_sink : public basic_sink_base<charT>
+{
+public:
+    using base      = basic_sink_base<charT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+    using sink_t    = std::shared_ptr<basic_sink_base<char_type>>;
 
 public:
-    explicit operator bool() const
+    explicit basic_sharded_sink(sink_t sk
+                                , shard_policy const& policy = shard_policy())
+        : sink_(std::move(sk))
     {
-        return is_open();
+        assert(sink_ && "sink instance point must exists");
+
+        auto const count = policy.shard_count ? policy.shard_count : 1;
+        for (std::size_t i = 0; i != count; ++i)
+        {
+            shards_.emplace_back(new shard_t(policy.shard_capacity));
+        }
+
+        auto const interval = policy.interval;
+        if (interval.count() > 0
+            && !std::is_same<mutexT, detail::null_mutex>::value)
+        {
+            combiner_ = std::thread([this, interval]() { run(interval); });
+        }
     }
-    bool operator!() const
+
+    ~basic_sharded_sink()
     {
-        return !is_open();
+        {
+            std::lock_guard<std::mutex> lock(timer_mtx_);
+            stop_ = true;
+        }
+        timer_cv_.notify_all();
+        if (combiner_.joinable())
+        {
+            combiner_.join();
+        }
+        flush();
     }
 
-    void set_level(level lvl)
+    sink_t const& get_sink() const
     {
-        lvl_ = lvl;
+        return sink_;
     }
-    level get_level() const
+
+    bool is_open() const override final
     {
-        return lvl_;
+        return sink_->is_open();
     }
 
-    void enable_verbose(bool enable)
+    void consume(basic_record<char_type> const& r) override final
     {
-        verbose_ = enable;
+        consume_impl(r);
     }
-    bool is_verbose() const
+
+    void consume(basic_record_d<char_type> const& r) override final
     {
-        return verbose_;
+        consume_impl(r);
     }
 
-    virtual bool is_open() const = 0;
-    virtual void consume(basic_record<char_type> const& r) = 0;
-    virtual void consume(basic_record_d<char_type> const& r) = 0;
+    void flush() override final
+    {
+        combine();
+        sink_->flush();
+    }
 
 private:
-    level lvl_      = level::trace;
-    bool verbose_   = false;
-};
+    using shard_t = detail::bounded_queue<detail::timed_entry>;
 
-template <class charT, class layoutT = default_layout
-          , class mutexT = mutex_t
-          , class formatterT = formatter<charT, layoutT>>
-class basic_sink : public basic_sink_base<charT>
-{
-public:
-    using base      = basic_sink_base<charT>;
-    using char_type = typename base::char_type;
-    using string_t  = typename base::string_t;
+    static constexpr std::size_t max_retained = 64 * 1024;
 
-    void consume(basic_record<char_type> const& r) override final
+    template <class recordT>
+    void consume_impl(recordT const& r)
     {
-        auto msg = fmt_.format(r, base::is_verbose());
-        write(r.lvl, msg);
-    }
+        if (base::get_level() > r.lvl)
+        {
+            return ;
+        }
 
-    void consume(basic_record_d<char_type> const& r) override final
-    {
-        auto msg = fmt_.format(r, base::is_verbose());
-        write(r.lvl, msg);
+        // Buffers of e go around the shard and come back to the thread,
+        // the merge doesn't free them.
+        static thread_local detail::timed_entry e;
+        e.assign(r);
+
+        auto& shard = *shards_[r.id % shards_.size()];
+        while (!shard.try_push(std::move(e)))
+        {
+            combine();
+        }
     }
 
-private:
-    void write(level lvl, string_t& msg)
+    // Write queued records of all shards in time order.
+    void combine()
     {
-        if (base::get_level() > lvl)
+        std::lock_guard<mutexT> lock(combine_mtx_);
+
+        // Records are popped into the ones kept from the last merge.
+        std::size_t n = 0;
+        order_.clear();
+        for (auto& shard : shards_)
         {
-            return ;
+            for (;;)
+            {
+                if (n == batch_.size())
+                {
+                    batch_.emplace_back();
+                }
+                if (!shard->try_pop(batch_[n]))
+                {
+                    break;
+                }
+                order_.emplace_back(batch_[n].usec, n);
+                ++n;
+            }
         }
 
-        before_write(lvl, msg);
+        // Shards are in order already, stable keeps them so.
+        std::stable_sort(order_.begin(), order_.end()
+                         , [](std::pair<std::int64_t, std::size_t> const& a
+                              , std::pair<std::int64_t, std::size_t> const& b)
+                         {
+                             return a.first < b.first;
+                         });
+
+        items_.clear();
+        detail::span_collector<char_type> const collect{ items_ };
+        for (auto const& o : order_)
         {
-            std::lock_guard<mutexT> lock(mtx_);
+            batch_[o.second].entry.visit(collect);
+        }
 
-            before_writing(lvl, msg);
-            writing(lvl, msg);
-            after_writing(lvl, msg);
+        try
+        {
+            sink_->consume_batch(basic_record_span<char_type>{
+                                     items_.data(), items_.size() });
+        }
+        catch (...)
+        {
+            // The merge is counted and dropped, the next one goes on.
+            base::counters().failed.add(items_.size());
+        }
+        items_.clear();
+        for (std::size_t i = 0; i != n; ++i)
+        {
+            batch_[i].entry.trim(max_retained);
         }
-        after_write(lvl, msg);
     }
 
-protected:
-    virtual void before_write(level /*lvl*/, string_t& /*msg*/)
-    {}
+    void run(std::chrono::milliseconds interval)
+    {
+        std::unique_lock<std::mutex> lock(timer_mtx_);
+        while (!timer_cv_.wait_for(lock, interval, [this]() { return stop_; }))
+        {
+            lock.unlock();
+            combine();
+            lock.lock();
+        }
+    }
 
-    virtual void before_writing(level /*lvl*/, string_t& /*msg*/)
-    {}
+private:
+    sink_t sink_;
+    std::vector<std::unique_ptr<shard_t>> shards_;
 
-    virtual void writing(level /*lvl*/, string_t& /*msg*/) = 0;
+    mutexT combine_mtx_;
+    std::vector<detail::timed_entry> batch_;
+    std::vector<std::pair<std::int64_t, std::size_t>> order_;
+    std::vector<typename basic_record_span<char_type>::item> items_;
 
-    virtual void after_writing(level /*lvl*/, string_t& /*msg*/)
-    {}
+    std::mutex timer_mtx_;
+    std::condition_variable timer_cv_;
+    bool stop_ = false;
+    std::thread combiner_;
+};
 
-    virtual void after_write(level /*lvl*/, string_t& /*msg*/)
-    {}
+using sharded_sink  = basic_sharded_sink<char>;
+using wsharded_sink = basic_sharded_sink<wchar_t>;
 
-private:
-    mutexT mtx_;
-    formatterT fmt_;
-};
+}  // namespace sink
 
-//----------------|
-// Console Sink   |
-//----------------|
+/*****************************************************************************/
+/* Deferred Logging: Format [w]lfmt statements on a background thread. */
 
-template <class charT, class layoutT = default_layout
-          , class mutexT = mutex_t
-          , class formatterT = formatter<charT, layoutT>>
-class basic_console_sink
-    : public basic_sink<charT, layoutT, mutexT, formatterT>
+// The calling thread only copies the static call site, the timestamp and
+// the arguments (trivially copyable values and string bodies) into a ring
+// buffer of its own. A background thread formats and writes the records.
+
+namespace detail
+{
+
+// Entry of a deferred ring, followed by fmt_arg<charT>[arg_count] and the
+// bodies of strings and copied values.
+struct deferred_header
+{
+    static constexpr std::uint32_t padding = 0xffffffffu;
+
+    std::uint32_t size;       // bytes of the entry
+    std::uint32_t arg_count;  // padding: skip to begin of ring
+    void const* site;         // basic_fmt_site<charT>
+    std::int64_t time;        // ticks of clock
+    clock_source clock;
+    level lvl;
+    bool wide;
+};
+
+// Ring of variable sized entries, written by one thread and read by one
+// thread. An entry never wraps around the end of the ring.
+class deferred_ring
 {
 public:
-    using base      = basic_sink<charT, layoutT, mutexT, formatterT>;
-    using char_type = typename base::char_type;
-    using string_t  = typename base::string_t;
+    static constexpr std::size_t alignment = alignof(deferred_header);
 
-    bool is_open() const override final
+    explicit deferred_ring(std::size_t capacity, std::uintmax_t thrd_id)
+        : mask_(round_up(capacity) - 1)
+        , buffer_(new unsigned char[mask_ + 1])
+        , thrd_id_(thrd_id)
     {
-        return true;
     }
 
-#if defined(TINYLOG_DISABLE_CONSOLE_COLOR)
+    deferred_ring(deferred_ring const&) = delete;
+    deferred_ring& operator=(deferred_ring const&) = delete;
 
-protected:
-    void writing(level lvl, string_t& msg) override final
+    std::size_t capacity() const
     {
-        write_line(lvl, msg);
+        return mask_ + 1;
     }
 
-private:
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, char>::value
-                                        , int>::type = 0>
-    void write_line(level /*lvl*/
-                    , std::basic_string<lineCharT> const& line) const
+    std::uintmax_t thread_id() const
     {
-        std::printf("%s", line.c_str());
+        return thrd_id_;
     }
 
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
-                                        , int>::type = 0>
-    void write_line(level /*lvl*/
-                    , std::basic_string<lineCharT> const& line) const
+    // Producer: n bytes (aligned) of contiguous space, nullptr if full.
+    unsigned char* try_reserve(std::size_t n)
     {
-        std::wprintf(L"%ls", line.c_str());
-    }
+        auto pos = head_.load(std::memory_order_relaxed);
+        auto const contiguous = capacity() - (pos & mask_);
+        auto const needed = contiguous < n ? contiguous + n : n;
+        if (needed > capacity() - (pos - tail_cache_))
+        {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (needed > capacity() - (pos - tail_cache_))
+            {
+                return nullptr;
+            }
+        }
 
-#else // Enable colors.
+        if (contiguous < n)
+        {
+            auto h = reinterpret_cast<deferred_header*>(
+                buffer_.get() + (pos & mask_));
+            h->size = static_cast<std::uint32_t>(contiguous);
+            h->arg_count = deferred_header::padding;
+            pos += contiguous;
+        }
+        reserved_ = pos;
+        return buffer_.get() + (pos & mask_);
+    }
 
-public:
-    void enable_color(bool enable = true)
+    void commit(std::size_t n)
     {
-        enable_color_ = enable;
+        head_.store(reserved_ + n, std::memory_order_release);
     }
 
-protected:
-    void writing(level lvl, string_t& msg) override final
+    // Consumer: next entry, nullptr if empty.
+    deferred_header* front()
     {
-        auto d = line_sep<char_type>();
-        for (typename string_t::size_type p = 0, q = 0
-             ; q != string_t::npos; q = ++p)
+        for (;;)
         {
-            if ((p = msg.find(d, q)) == string_t::npos)
+            auto const pos = tail_.load(std::memory_order_relaxed);
+            if (pos == head_cache_)
             {
-                write_line(lvl, msg.substr(q));
-                break;
+                head_cache_ = head_.load(std::memory_order_acquire);
+                if (pos == head_cache_)
+                {
+                    return nullptr;
+                }
             }
-            write_line(lvl, msg.substr(q, p - q));
-            write_line_sep<char_type>();
+
+            auto h = reinterpret_cast<deferred_header*>(
+                buffer_.get() + (pos & mask_));
+            if (h->arg_count != deferred_header::padding)
+            {
+                return h;
+            }
+            tail_.store(pos + h->size, std::memory_order_release);
         }
     }
 
-private:
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, char>::value
-                                        , int>::type = 0>
-    lineCharT line_sep() const
+    void pop(deferred_header const* h)
     {
-        return '\n';
+        auto const pos = tail_.load(std::memory_order_relaxed);
+        tail_.store(pos + h->size, std::memory_order_release);
     }
 
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
-                                        , int>::type = 0>
-    lineCharT line_sep() const
+    // Bytes written so far, and bytes read so far.
+    std::size_t written() const
     {
-        return L'\n';
+        return head_.load(std::memory_order_acquire);
     }
 
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, char>::value
-                                        , int>::type = 0>
-    void write_line(level lvl, std::basic_string<lineCharT> const& line) const
+    std::size_t consumed() const
     {
-        if (enable_color_)
+        return tail_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return consumed() == written();
+    }
+
+    // Producer thread exited, or the worker is gone.
+    void close()
+    {
+        closed_.store(true, std::memory_order_release);
+    }
+
+    bool closed() const
+    {
+        return closed_.load(std::memory_order_acquire);
+    }
+
+private:
+    static std::size_t round_up(std::size_t n)
+    {
+        std::size_t r = 4096;
+        while (r < n)
         {
-            std::printf("%s", style_beg(lvl).c_str());
-            std::printf("%s", line.c_str());
-            std::printf("%s", style_end().c_str());
-            return ;
+            r <<= 1;
         }
-        std::printf("%s", line.c_str());
+        return r;
+    }
+
+private:
+    std::size_t const mask_;
+    std::unique_ptr<unsigned char[]> const buffer_;
+    std::uintmax_t const thrd_id_;
+    std::atomic<bool> closed_{false};
+
+    char pad0_[cache_line_size];
+    std::atomic<std::size_t> head_{0};
+    std::size_t tail_cache_ = 0;
+    std::size_t reserved_ = 0;
+    char pad1_[cache_line_size];
+    std::atomic<std::size_t> tail_{0};
+    std::size_t head_cache_ = 0;
+    char pad2_[cache_line_size];
+};
+
+// Value copied into the ring, written by operator<< on the worker thread.
+template <class charT, class T, class U = typename std::decay<T>::type>
+struct is_deferred_copyable
+    : std::integral_constant<bool
+    , fmt_kind_of<charT, T>::value != fmt_kind::custom
+      || (std::is_trivially_copyable<U>::value && !std::is_pointer<U>::value
+          && alignof(U) <= deferred_ring::alignment)>
+{
+};
+
+template <class charT, class... Args>
+struct is_deferred_encodable;
+
+template <class charT>
+struct is_deferred_encodable<charT> : std::true_type
+{
+};
+
+template <class charT, class T, class... Args>
+struct is_deferred_encodable<charT, T, Args...>
+    : std::integral_constant<bool
+    , is_deferred_copyable<charT, T>::value
+      && is_deferred_encodable<charT, Args...>::value>
+{
+};
+
+// Bytes copied into the ring for a custom argument.
+template <class charT, class T, class U = typename std::decay<T>::type>
+struct deferred_copy_size
+    : std::integral_constant<std::size_t
+    , fmt_kind_of<charT, T>::value == fmt_kind::custom ? sizeof(U) : 0>
+{
+};
+
+constexpr std::size_t deferred_align(std::size_t n)
+{
+    return (n + deferred_ring::alignment - 1)
+           & ~(deferred_ring::alignment - 1);
+}
+
+// Rings of the calling thread, one per deferred worker.
+class deferred_thread_rings
+{
+public:
+    struct slot
+    {
+        std::uint64_t owner;
+        std::shared_ptr<deferred_ring> ring;
+    };
+
+    ~deferred_thread_rings()
+    {
+        for (auto& s : slots)
+        {
+            s.ring->close();
+        }
+    }
+
+    static deferred_thread_rings& local()
+    {
+        static thread_local deferred_thread_rings rings;
+        return rings;
+    }
+
+    std::vector<slot> slots;
+};
+
+// Unique id of a deferred worker, never reused.
+inline std::uint64_t next_deferred_id()
+{
+    static std::atomic<std::uint64_t> id(0u);
+    return ++id;
+}
+
+// Format deferred records on a background thread, handlerT is called with
+// the record.
+template <class handlerT>
+class deferred_worker
+{
+public:
+    // Producers wake a sleeping worker up, the timeout only guards
+    // against a missed notification.
+    static constexpr std::chrono::milliseconds idle_interval
+    = std::chrono::milliseconds(100);
+
+public:
+    explicit deferred_worker(handlerT handler, std::size_t ring_capacity
+                             , overflow_policy policy)
+        : handler_(handler), ring_capacity_(ring_capacity)
+        , policy_(policy), id_(next_deferred_id())
+    {
+        thread_ = std::thread(&deferred_worker::run, this);
     }
 
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
-                                        , int>::type = 0>
-    void write_line(level lvl, std::basic_string<lineCharT> const& line) const
+    deferred_worker(deferred_worker const&) = delete;
+    deferred_worker& operator=(deferred_worker const&) = delete;
+
+    // Pending records are written before the thread exits.
+    ~deferred_worker()
     {
-        if (enable_color_)
+        stop_.store(true, std::memory_order_release);
         {
-            std::wprintf(L"%ls", style_beg(lvl).c_str());
-            std::wprintf(L"%ls", line.c_str());
-            std::wprintf(L"%ls", style_end().c_str());
-            return ;
+            std::lock_guard<std::mutex> lock(mtx_);
+            work_cv_.notify_all();
+        }
+        if (thread_.joinable())
+        {
+            thread_.join();
         }
-        std::wprintf(L"%ls", line.c_str());
-    }
 
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, char>::value
-                                        , int>::type = 0>
-    void write_line_sep() const
-    {
-        std::printf("%c", line_sep<lineCharT>());
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (auto& r : rings_)
+        {
+            r->close();
+        }
     }
 
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
-                                        , int>::type = 0>
-    void write_line_sep() const
+public:
+    // Return false if the arguments can't be deferred, the caller formats
+    // the record itself.
+    template <class charT, class... Args>
+    bool push(level lvl, clock_source clock
+              , basic_fmt_site<charT> const& site, Args const&... args)
     {
-        std::wprintf(L"%lc", line_sep<lineCharT>());
+        return push_impl(lvl, clock, site
+                         , is_deferred_encodable<charT, Args...>(), args...);
     }
 
-private:
-    string_t style_beg(level lvl) const
+    // Wait until records pushed before are written.
+    void flush()
     {
-        using namespace detail;
+        std::vector<std::pair<std::shared_ptr<deferred_ring>, std::size_t>>
+            targets;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            for (auto& r : rings_)
+            {
+                targets.emplace_back(r, r->written());
+            }
+        }
 
-        string_t color_text;
-        switch (lvl)
+        std::unique_lock<std::mutex> lock(mtx_);
+        flushers_.fetch_add(1, std::memory_order_seq_cst);
+        work_cv_.notify_all();
+        for (auto& t : targets)
         {
-        case level::trace:
-            style(color_text, foreground::white);
-            break;
-        case level::debug:
-            style(color_text, foreground::cyan);
-            break;
-        case level::info:
-            style(color_text, foreground::green);
-            break;
-        case level::warn:
-            style(color_text, foreground::yellow);
-            style(color_text, emphasize::bold);
-            break;
-        case level::error:
-            style(color_text, foreground::red);
-            style(color_text, emphasize::bold);
-            break;
-        case level::fatal:
-            style(color_text, foreground::red);
-            style(color_text, background::white);
-            style(color_text, emphasize::bold);
-            break;
-        default:
-            break;
+            while (t.first->consumed() < t.second
+                   && thread_.get_id() != std::this_thread::get_id())
+            {
+                done_cv_.wait_for(lock, idle_interval);
+            }
         }
-        return color_text;
+        flushers_.fetch_sub(1, std::memory_order_relaxed);
     }
 
-    string_t style_end() const
+    std::uint64_t dropped() const
     {
-        string_t color_text;
-        detail::style(color_text);
-        return color_text;
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    // Records a sink threw on.
+    std::uint64_t failed() const
+    {
+        return failed_.load(std::memory_order_relaxed);
     }
 
 private:
-    bool enable_color_ = true;
+    template <class charT, class... Args>
+    bool push_impl(level, clock_source, basic_fmt_site<charT> const&
+                   , std::false_type, Args const&...)
+    {
+        return false;
+    }
 
-#endif // TINYLOG_DISABLE_CONSOLE_COLOR
+    template <class charT, class... Args>
+    bool push_impl(level lvl, clock_source clock
+                   , basic_fmt_site<charT> const& site
+                   , std::true_type, Args const&... args)
+    {
+        using arg_t = fmt_arg<charT>;
 
-};
+        auto const time = read_clock(clock);
 
-using console_sink  = basic_console_sink<char>;
-using wconsole_sink = basic_console_sink<wchar_t>;
+        // One more element, arrays of size zero are not allowed.
+        arg_t fmt_args[sizeof...(Args) + 1] = { make_fmt_arg<charT>(args)... };
+        std::size_t const copy_sizes[sizeof...(Args) + 1] = {
+            deferred_copy_size<charT, Args>::value...
+        };
 
-//----------------|
-// File Sink      |
-//----------------|
+        auto size = deferred_align(sizeof(deferred_header)
+                                   + sizeof(arg_t) * sizeof...(Args));
+        for (std::size_t i = 0; i != sizeof...(Args); ++i)
+        {
+            if (fmt_args[i].kind == fmt_kind::string)
+            {
+                size += deferred_align(fmt_args[i].s.size * sizeof(charT));
+            }
+            size += deferred_align(copy_sizes[i]);
+        }
 
-template <class charT, class layoutT = default_layout
-          , class mutexT = mutex_t
-          , class formatterT = formatter<charT, layoutT>>
-class basic_file_sink
-    : public basic_sink<charT, layoutT, mutexT, formatterT>
-{
-public:
-    using base      = basic_sink<charT, layoutT, mutexT, formatterT>;
-    using char_type = typename base::char_type;
-    using string_t  = typename base::string_t;
+        auto ring = local_ring();
+        if (size > ring->capacity() / 4)
+        {
+            return false;
+        }
 
-    static constexpr std::uintmax_t default_max_file_size
-    = 10 * 1024 * 1024;  // 10 MB
-    static constexpr std::uintmax_t npos
-    = (std::numeric_limits<std::uintmax_t>::max)();
+        auto p = reserve(ring, size);
+        if (!p)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
 
-public:
-    explicit basic_file_sink(char const* filename
-                             , std::uintmax_t max_file_size
-                             = default_max_file_size
-                             , std::ios_base::openmode mode
-                             = std::ios_base::app
-                             , std::locale const& loc = std::locale(""))
-        : filename_(filename), max_file_size_(max_file_size)
-        , ostrm_(filename, mode)
-    {
-        ostrm_.imbue(loc);
+        auto h = reinterpret_cast<deferred_header*>(p);
+        h->size = static_cast<std::uint32_t>(size);
+        h->arg_count = static_cast<std::uint32_t>(sizeof...(Args));
+        h->site = &site;
+        h->time = time.ticks;
+        h->clock = time.clock;
+        h->lvl = lvl;
+        h->wide = std::is_same<charT, wchar_t>::value;
+
+        // String bodies and values are copied behind the arguments, the
+        // arguments point to them.
+        auto a = reinterpret_cast<arg_t*>(h + 1);
+        auto body = p + deferred_align(sizeof(deferred_header)
+                                       + sizeof(arg_t) * sizeof...(Args));
+        for (std::size_t i = 0; i != sizeof...(Args); ++i)
+        {
+            a[i] = fmt_args[i];
+            if (a[i].kind == fmt_kind::string && a[i].s.data)
+            {
+                auto const n = a[i].s.size * sizeof(charT);
+                std::memcpy(body, a[i].s.data, n);
+                a[i].s.data = reinterpret_cast<charT const*>(body);
+                body += deferred_align(n);
+            }
+            else if (copy_sizes[i] != 0)
+            {
+                std::memcpy(body, a[i].custom.obj, copy_sizes[i]);
+                a[i].custom.obj = body;
+                body += deferred_align(copy_sizes[i]);
+            }
+        }
+        ring->commit(size);
+        notify_worker();
+        return true;
     }
 
-    bool is_open() const override final
+    // Space of the entry, nullptr if it is dropped.
+    unsigned char* reserve(deferred_ring* ring, std::size_t size)
     {
-        return ostrm_ ? true : false;
+        for (std::size_t spin = 0; true; ++spin)
+        {
+            if (auto p = ring->try_reserve(size))
+            {
+                return p;
+            }
+
+            // The producer can't discard queued entries of a single
+            // producer ring, drop_oldest discards the newest.
+            if (policy_ != overflow_policy::block)
+            {
+                return nullptr;
+            }
+
+            if (spin == 0)
+            {
+                notify_worker();
+            }
+            if (spin < 64)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
     }
 
-protected:
-    void before_writing(level /*lvl*/, string_t& msg) override final
+    // Ring of the calling thread, registered on first use.
+    deferred_ring* local_ring()
     {
-        std::uintmax_t const curr_file_size = ostrm_.tellp();
-        if (curr_file_size + msg.size() < max_file_size_)
+        auto& slots = deferred_thread_rings::local().slots;
+        for (auto& s : slots)
         {
-            return ;
+            if (s.owner == id_)
+            {
+                return s.ring.get();
+            }
         }
 
-        ostrm_.close();
-        try
-        {
-            ::tinylog::detail::file_rename(filename_, filename_ + ".bak");
-        }
-        catch (...)
+        // Forget rings of destroyed workers.
+        slots.erase(std::remove_if(slots.begin(), slots.end()
+                                   , [](deferred_thread_rings::slot const& s)
+                                   {
+                                       return s.ring->closed();
+                                   })
+                    , slots.end());
+
+        auto ring = std::make_shared<deferred_ring>(ring_capacity_
+                                                    , curr_thrd_id());
         {
-            // TODO: Ignore backup file failed.
+            std::lock_guard<std::mutex> lock(mtx_);
+            rings_.push_back(ring);
+            rings_version_.fetch_add(1, std::memory_order_release);
         }
-        ostrm_.clear();
-        ostrm_.open(filename_, std::ios_base::out);
+        slots.push_back({ id_, ring });
+        return ring.get();
     }
 
-    void writing(level /*lvl*/, string_t& msg) override final
+    void run()
     {
-        if (!is_open())
+        std::vector<std::shared_ptr<deferred_ring>> rings;
+        std::size_t version = 0;
+        for (;;)
         {
-            return;
-        }
-        ostrm_.seekp(0, std::ios_base::end);
-        ostrm_.write(msg.data(), msg.size());
-        ostrm_.flush();
-    }
+            if (version != rings_version_.load(std::memory_order_acquire))
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                version = rings_version_.load(std::memory_order_relaxed);
+                rings = rings_;
+            }
 
-private:
-    std::string filename_;
-    std::uintmax_t max_file_size_ = npos;
-    std::basic_ofstream<charT> ostrm_;
-};
+            auto const handled = drain(rings);
+            if (flushers_.load(std::memory_order_seq_cst) != 0)
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                done_cv_.notify_all();
+            }
+            if (handled != 0)
+            {
+                continue;
+            }
 
-using file_sink = basic_file_sink<char>;
-using wfile_sink= basic_file_sink<wchar_t>;
+            if (stop_.load(std::memory_order_acquire))
+            {
+                // Rings registered before stop are drained.
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (version == rings_version_.load(std::memory_order_relaxed))
+                {
+                    break;
+                }
+                continue;
+            }
+            remove_closed(rings);
+            wait_for_work(rings, version);
+        }
+    }
 
-//----------------|
-// U8 File Sink   |
-//----------------|
+    void wait_for_work(std::vector<std::shared_ptr<deferred_ring>> const& rings
+                       , std::size_t version)
+    {
+        auto const empty = [](std::shared_ptr<deferred_ring> const& r)
+                           {
+                               return r->empty();
+                           };
 
-template <class charT, class layoutT = default_layout
-          , class mutexT = mutex_t
-          , class formatterT = formatter<charT, layoutT>>
-class basic_u8_file_sink
-    : public basic_file_sink<charT, layoutT, mutexT, formatterT>
-{
-public:
-    using base      = basic_file_sink<charT, layoutT, mutexT, formatterT>;
-    using char_type = typename base::char_type;
-    using string_t  = typename base::string_t;
+        std::unique_lock<std::mutex> lock(mtx_);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        if (flushers_.load(std::memory_order_seq_cst) == 0
+            && !stop_.load(std::memory_order_acquire)
+            && version == rings_version_.load(std::memory_order_relaxed)
+            && std::all_of(rings.begin(), rings.end(), empty))
+        {
+            // Timeout only guards against a missed notification.
+            work_cv_.wait_for(lock, idle_interval);
+        }
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
 
-public:
-    explicit basic_u8_file_sink(char const* filename
-                                , std::uintmax_t max_file_size
-                                = base::default_max_file_size
-                                , std::ios_base::openmode mode
-                                = std::ios_base::app
-                                , std::locale const& loc
-                                = std::locale(std::locale("")
-                                              , new std::codecvt_utf8<wchar_t>))
-        : base(filename, max_file_size, mode, loc)
+    void notify_worker()
     {
+        // Pairs with sleepers_ increment in wait_for_work().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) != 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            work_cv_.notify_one();
+        }
     }
 
-protected:
-    void before_write(level /*lvl*/, string_t& msg) override final
+    // Handle records in timestamp order across threads, return how many.
+    std::size_t drain(std::vector<std::shared_ptr<deferred_ring>>& rings)
     {
-        // Convert only if string_t is narrow type.
-        string_t const from = msg;
-        string_traits<u8string>::convert(msg, from);
+        static constexpr std::size_t max_batch = 1024;
+
+        std::size_t n = 0;
+        for (; n != max_batch; ++n)
+        {
+            deferred_ring* ring = nullptr;
+            deferred_header* h = nullptr;
+            for (auto& r : rings)
+            {
+                auto const front = r->front();
+                if (front && (!h || front->time < h->time))
+                {
+                    ring = r.get();
+                    h = front;
+                }
+            }
+            if (!h)
+            {
+                break;
+            }
+
+            try
+            {
+                if (h->wide)
+                {
+                    handle<wchar_t>(*ring, *h);
+                }
+                else
+                {
+                    handle<char>(*ring, *h);
+                }
+            }
+            catch (...)
+            {
+                // A throwing sink must not stop the worker, the record is
+                // counted and logging goes on.
+                failed_.fetch_add(1, std::memory_order_relaxed);
+            }
+            ring->pop(h);
+        }
+        return n;
     }
-};
 
-using u8_file_sink = basic_u8_file_sink<char>;
-using wu8_file_sink = basic_u8_file_sink<wchar_t>;
+    // Drop rings of exited threads once they are drained.
+    void remove_closed(std::vector<std::shared_ptr<deferred_ring>>& rings)
+    {
+        auto const pred = [](std::shared_ptr<deferred_ring> const& r)
+                          {
+                              return r->closed() && r->empty();
+                          };
+        if (std::none_of(rings.begin(), rings.end(), pred))
+        {
+            return ;
+        }
 
-//----------------|
-// MSVC Sink      |
-//----------------|
+        std::lock_guard<std::mutex> lock(mtx_);
+        rings_.erase(std::remove_if(rings_.begin(), rings_.end(), pred)
+                     , rings_.end());
+        rings = rings_;
+    }
 
-#if defined(TINYLOG_WINDOWS_API)
+    template <class charT>
+    void handle(deferred_ring const& ring, deferred_header& h)
+    {
+        auto const& site = *static_cast<basic_fmt_site<charT> const*>(h.site);
+        auto const args = reinterpret_cast<fmt_arg<charT> const*>(&h + 1);
+        basic_fmt_payload<charT> const payload = { &site, args, h.arg_count };
+        raw_time time;
+        time.ticks = h.time;
+        time.clock = h.clock;
+        auto const tv = to_time_value(time);
 
-template <class charT, class layoutT = default_layout
-          , class mutexT = mutex_t
-          , class formatterT = formatter<charT, layoutT>>
-class basic_msvc_sink
-    : public basic_sink<charT, layoutT, mutexT, formatterT>
-{
-public:
-    using base      = basic_sink<charT, layoutT, mutexT, formatterT>;
-    using char_type = typename base::char_type;
-    using string_t  = typename base::string_t;
+        auto fill = [&](basic_record<charT>& r)
+                    {
+                        r.tv  = tv;
+                        r.lvl = h.lvl;
+                        r.id  = ring.thread_id();
+                        r.message.clear();
+                        vformat(r.message, site.fmt, args, h.arg_count);
+                        r.payload = &payload;
+                    };
 
-public:
-    bool is_open() const override final
+        if (site.loc.file)
+        {
+            auto& r = record_d(static_cast<charT const*>(nullptr));
+            fill(r);
+            r.location = &site.loc;
+            handler_(static_cast<basic_record_d<charT> const&>(r));
+        }
+        else
+        {
+            auto& r = record(static_cast<charT const*>(nullptr));
+            fill(r);
+            handler_(static_cast<basic_record<charT> const&>(r));
+        }
+    }
+
+    // Records of the worker thread, their buffers are reused.
+    basic_record<char>& record(char const*)
     {
-        return true;
+        return narrow_;
     }
 
-protected:
-    void writing(level /*lvl*/, string_t& msg) override final
+    basic_record<wchar_t>& record(wchar_t const*)
     {
-        writing_impl(msg);
+        return wide_;
     }
 
-private:
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, char>::value
-                                        , int>::type = 0>
-    void writing_impl(std::basic_string<lineCharT> const& line) const
+    basic_record_d<char>& record_d(char const*)
     {
-        ::OutputDebugStringA(line.c_str());
+        return narrow_d_;
     }
 
-    template <class lineCharT
-              , typename std::enable_if<std::is_same<lineCharT, wchar_t>::value
-                                        , int>::type = 0>
-    void writing_impl(std::basic_string<lineCharT> const& line) const
+    basic_record_d<wchar_t>& record_d(wchar_t const*)
     {
-        ::OutputDebugStringW(line.c_str());
+        return wide_d_;
     }
-};
 
-using msvc_sink = basic_msvc_sink<char>;
-using wmsvc_sink= basic_msvc_sink<wchar_t>;
+private:
+    handlerT handler_;
+    std::size_t const ring_capacity_;
+    overflow_policy const policy_;
+    std::uint64_t const id_;
+
+    std::vector<std::shared_ptr<deferred_ring>> rings_;
+    std::atomic<std::size_t> rings_version_{0};
+
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> failed_{0};
+    std::atomic<std::size_t> sleepers_{0};
+    std::atomic<std::size_t> flushers_{0};
+    std::atomic<bool> stop_{false};
+
+    basic_record<char> narrow_;
+    basic_record<wchar_t> wide_;
+    basic_record_d<char> narrow_d_;
+    basic_record_d<wchar_t> wide_d_;
+
+    std::mutex mtx_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::thread thread_;
+};
 
-#endif  // TINYLOG_WINDOWS_API
+template <class handlerT>
+constexpr std::chrono::milliseconds deferred_worker<handlerT>::idle_interval;
 
-}  // namespace sink
+}  // namespace detail
 
 /*****************************************************************************/
-/* Sink Adapter: Adapt narrow and unicode charactor. */
+/* Logger. */
 
 namespace detail
 {
 
-struct sink_adapter_base
+// Moved whenever loggers of the registry or a level filtering statements
+// change, call sites keep what they resolved until then.
+inline std::atomic<std::size_t>& filter_epoch()
 {
-    explicit operator bool() const
-    {
-        return is_open();
-    }
-
-    bool operator!() const
-    {
-        return !is_open();
-    }
-
-    virtual bool is_open() const = 0;
-
-    virtual void consume(basic_record<char> const& r) = 0;
-    virtual void consume(basic_record<wchar_t> const& r) = 0;
-
-    virtual void consume(basic_record_d<char> const& r) = 0;
-    virtual void consume(basic_record_d<wchar_t> const& r) = 0;
-};
+    static std::atomic<std::size_t> epoch(1u);
+    return epoch;
+}
 
-template <class charT>
-struct basic_sink_adapter : public sink_adapter_base
+inline void bump_filter_epoch()
 {
-    using char_type   = typename std::conditional<
-        std::is_same<charT, char>::value, char, wchar_t>::type;
-    using extern_type = typename std::conditional<
-        !std::is_same<charT, char>::value, char , wchar_t>::type;
-
-    using string_t    = std::basic_string<char_type>;
-    using sink_t      = std::shared_ptr<sink::basic_sink_base<char_type>>;
+    filter_epoch().fetch_add(1u, std::memory_order_release);
+}
 
+// Ring of the last records kept unformatted, slots keep their strings so
+// a record is copied without allocation once the ring is warm.
+class backtrace_ring
+{
 public:
-    explicit basic_sink_adapter(sink_t sk) : sink_(sk)
-    {
-    }
+    explicit backtrace_ring(std::size_t capacity)
+        : slots_(capacity ? capacity : 1)
+    {}
 
-public:
-    bool is_open() const override final
+    // Keep r, overwrite the oldest record if the ring is full.
+    template <class recordT>
+    void push(recordT const& r)
     {
-        return sink_ && sink_->is_open();
+        std::lock_guard<mutex_t> lock(mtx_);
+        auto const n = slots_.size();
+        auto& s = slots_[(head_ + size_) % n];
+        if (size_ == n)
+        {
+            head_ = (head_ + 1) % n;
+        }
+        else
+        {
+            ++size_;
+        }
+        s.assign(r);
     }
 
-    void consume(basic_record<char_type> const& r) override
-    {
-        sink_->consume(r);
-    }
-    void consume(basic_record<extern_type> const& r) override
+    // Hand records kept to visitor, oldest first, and forget them. The
+    // records are taken out of the ring first, visitor may log again.
+    template <class visitorT>
+    void drain(visitorT&& visitor)
     {
-        using record_t = basic_record<char_type>;
+        std::vector<slot> taken;
+        std::size_t head = 0;
+        std::size_t size = 0;
+        {
+            std::lock_guard<mutex_t> lock(mtx_);
+            if (size_ == 0)
+            {
+                return ;
+            }
+            taken.swap(slots_);
+            slots_.swap(spare_);
+            slots_.resize(taken.size());
+            std::swap(head, head_);
+            std::swap(size, size_);
+        }
 
-        string_t m;
-        string_traits<>::convert(m, r.message);
+        for (std::size_t i = 0; i != size; ++i)
+        {
+            taken[(head + i) % taken.size()].visit(visitor);
+        }
 
-        record_t to(r.tv, r.lvl, r.id, m);
-        sink_->consume(to);
+        // Slots keep their strings for the next drain.
+        std::lock_guard<mutex_t> lock(mtx_);
+        if (spare_.empty())
+        {
+            spare_.swap(taken);
+        }
     }
 
-    void consume(basic_record_d<char_type> const& r) override
-    {
-        sink_->consume(r);
-    }
-    void consume(basic_record_d<extern_type> const& r) override
+private:
+    struct slot
     {
-        using record_t = basic_record_d<char_type>;
+        using kind = record_entry::kind;
 
-        string_t m;
-        string_traits<>::convert(m, r.message);
+        void assign(basic_record<char> const& r)
+        {
+            static_cast<basic_record<char>&>(narrow) = r;
+            narrow.payload = nullptr;
+            k = kind::narrow;
+        }
 
-        string_t fn;
-        string_traits<>::convert(fn, r.file);
+        void assign(basic_record_d<char> const& r)
+        {
+            narrow = r;
+            narrow.payload = nullptr;
+            k = kind::narrow_d;
+        }
 
-        string_t fun;
-        string_traits<>::convert(fun, r.func);
+        void assign(basic_record<wchar_t> const& r)
+        {
+            static_cast<basic_record<wchar_t>&>(wide) = r;
+            wide.payload = nullptr;
+            k = kind::wide;
+        }
 
-        record_t to(r.tv, r.lvl, r.id, m, fn, r.line, fun);
-        sink_->consume(to);
-    }
+        void assign(basic_record_d<wchar_t> const& r)
+        {
+            wide = r;
+            wide.payload = nullptr;
+            k = kind::wide_d;
+        }
+
+        template <class visitorT>
+        void visit(visitorT&& visitor)
+        {
+            switch (k)
+            {
+            case kind::narrow:
+                visitor(static_cast<basic_record<char>&>(narrow));
+                break;
+            case kind::narrow_d:
+                visitor(narrow);
+                break;
+            case kind::wide:
+                visitor(static_cast<basic_record<wchar_t>&>(wide));
+                break;
+            case kind::wide_d:
+                visitor(wide);
+                break;
+            default:
+                break;
+            }
+        }
+
+        kind k = kind::none;
+        basic_record_d<char> narrow;
+        basic_record_d<wchar_t> wide;
+    };
 
 private:
-    sink_t sink_;
+    mutex_t mtx_;
+    std::vector<slot> slots_;
+    std::vector<slot> spare_;
+    std::size_t head_ = 0;
+    std::size_t size_ = 0;
 };
 
-}  // namesapce detail
-
-/*****************************************************************************/
-/* Logger. */
+}  // namespace detail
 
 class logger
 {
@@ -2169,12 +9170,38 @@ public:
     //   trace < debug < info < warn < error < fatal
     void set_level(level lvl)
     {
-        lvl_ = lvl;
+        lvl_.store(lvl, std::memory_order_relaxed);
+        detail::bump_filter_epoch();
     }
 
     level get_level() const
     {
-        return lvl_;
+        return lvl_.load(std::memory_order_relaxed);
+    }
+
+    // Lowest level consume() passes, a backtrace may keep records below
+    // the level of the logger.
+    level threshold() const
+    {
+        return (std::min)(get_level()
+                          , backtrace_lvl_.load(std::memory_order_relaxed));
+    }
+
+    // Clock of record timestamps, TINYLOG_CLOCK_SOURCE by default.
+    //
+    // e.g.
+    //   inst->enable_async();
+    //   inst->set_clock(clock_source::tsc);
+    //
+    // @see clock_source
+    void set_clock(clock_source clock)
+    {
+        clock_.store(start_clock(clock), std::memory_order_relaxed);
+    }
+
+    clock_source get_clock() const
+    {
+        return clock_.load(std::memory_order_relaxed);
     }
 
     // Setup log sink.
@@ -2192,35 +9219,355 @@ public:
         return add_sink(sk);
     }
 
-    template <class sinkT, class charT = typename sinkT::char_type>
-    std::shared_ptr<sinkT> add_sink(std::shared_ptr<sinkT> sk)
+    template <class sinkT, class charT = typename sinkT::char_type>
+    std::shared_ptr<sinkT> add_sink(std::shared_ptr<sinkT> sk)
+    {
+        using char_type = charT;
+        assert(sk && "sink instance point must exists");
+        auto ska = std::make_shared<detail::basic_sink_adapter<char_type>>(sk);
+        sink_adapters_.emplace_back(ska);
+        return sk;
+    }
+
+    // Hand records over to background threads instead of writing them on
+    // the calling thread. Sinks must be set up before logging starts.
+    //
+    // @attention Records may be reordered when thread_count > 1.
+    void enable_async(std::size_t queue_capacity = default_queue_capacity
+                      , overflow_policy policy = overflow_policy::block
+                      , std::size_t thread_count = 1)
+    {
+        async_.reset();
+        auto handler = [this](detail::record_entry* entries
+                              , std::size_t n)
+                       {
+                           dispatch_batch(entries, n);
+                       };
+        async_.reset(new detail::async_worker(handler, queue_capacity
+                                              , policy, thread_count));
+    }
+
+    bool is_async() const
+    {
+        return async_ ? true : false;
+    }
+
+    // Format [w]lfmt statements on a background thread, the calling thread
+    // only copies the arguments into a ring buffer of its own (buffer_size
+    // bytes per thread). Other statements are written as before. Sinks must
+    // be set up before logging starts.
+    //
+    // Arguments which are not trivially copyable (besides strings) can't be
+    // deferred, such statements are formatted on the calling thread.
+    //
+    // @attention Records of different threads are written in timestamp
+    //            order only as far as they are pending together.
+    void enable_deferred(std::size_t buffer_size
+                         = default_deferred_buffer_size
+                         , overflow_policy policy = overflow_policy::block)
+    {
+        deferred_.reset();
+        deferred_.reset(new deferred_worker_t(dispatcher{ *this }
+                                              , buffer_size, policy));
+    }
+
+    bool is_deferred() const
+    {
+        return deferred_ ? true : false;
+    }
+
+    // Store a [w]lfmt statement for the background thread, return false if
+    // the caller has to format it.
+    template <class charT, class... Args>
+    bool defer(level lvl, detail::basic_fmt_site<charT> const& site
+               , Args const&... args)
+    {
+        if (!deferred_ || !deferred_->push(lvl, get_clock(), site, args...))
+        {
+            return false;
+        }
+        emitted_.add();
+        return true;
+    }
+
+    // Number of records discarded because the async queue (or the deferred
+    // buffer) was full.
+    std::uint64_t dropped() const
+    {
+        return (async_ ? async_->dropped() : 0)
+               + (deferred_ ? deferred_->dropped() : 0);
+    }
+
+    // Number of records the async or deferred worker failed to write
+    // because a sink threw.
+    std::uint64_t failed() const
+    {
+        return (async_ ? async_->failed() : 0)
+               + (deferred_ ? deferred_->failed() : 0);
+    }
+
+    // @see TINYLOG_ENABLE_STATS
+    logger_stats stats() const
+    {
+        logger_stats s;
+        s.emitted  = emitted_.load();
+        s.filtered = filtered_.load();
+        s.dropped  = dropped();
+        s.failed   = failed();
+        s.queue_high_water = async_ ? async_->high_water() : 0;
+        return s;
+    }
+
+    // Block until records pushed before are written, then flush sinks.
+    void flush()
+    {
+        if (deferred_)
+        {
+            deferred_->flush();
+        }
+        if (async_)
+        {
+            async_->flush();
+        }
+        for (auto& sk_adapter : sink_adapters_)
+        {
+            if (*sk_adapter)
+            {
+                sk_adapter->flush();
+            }
+        }
+    }
+
+    // Keep the last capacity records of lvl or above which are below the
+    // level of the logger in memory, unformatted. They are written to the
+    // sinks before an error or fatal record, or by dump_backtrace. Set up
+    // before logging starts, it may be enabled or disabled while logging
+    // too. A statement still using a replaced ring keeps it alive.
+    //
+    // e.g.
+    //   inst->set_level(level::info);
+    //   inst->enable_backtrace(256, level::debug);
+    void enable_backtrace(std::size_t capacity, level lvl = level::trace)
+    {
+        std::atomic_store(&backtrace_
+                          , std::make_shared<detail::backtrace_ring>(capacity));
+        backtrace_lvl_.store(lvl, std::memory_order_release);
+        detail::bump_filter_epoch();
+    }
+
+    void disable_backtrace()
+    {
+        backtrace_lvl_.store(no_backtrace, std::memory_order_relaxed);
+        std::atomic_store(&backtrace_, backtrace_ptr());
+        detail::bump_filter_epoch();
+    }
+
+    bool is_backtrace() const
+    {
+        return std::atomic_load(&backtrace_) ? true : false;
+    }
+
+    // Write records kept by the backtrace to the sinks, oldest first.
+    void dump_backtrace()
+    {
+        if (auto const bt = std::atomic_load(&backtrace_))
+        {
+            bt->drain(writer{ *this });
+        }
+    }
+
+    bool consume(level lvl) const
+    {
+        if (lvl >= get_level()
+            || lvl >= backtrace_lvl_.load(std::memory_order_relaxed))
+        {
+            return true;
+        }
+        filtered_.add();
+        return false;
+    }
+
+    // A call site filtered a statement by the cached threshold().
+    void note_filtered() const
+    {
+        filtered_.add();
+    }
+
+    template <class recordT>
+    void push_record(recordT&& r)
+    {
+        if (!pass_backtrace(r))
+        {
+            return ;
+        }
+        write_record(std::forward<recordT>(r));
+    }
+
+private:
+    using backtrace_ptr = std::shared_ptr<detail::backtrace_ring>;
+
+    // Keep r in the backtrace if it is below the level, dump the backtrace
+    // before an error. The ring is only loaded while a backtrace is on.
+    //
+    // @return false if r is kept only.
+    template <class recordT>
+    bool pass_backtrace(recordT const& r)
+    {
+        if (backtrace_lvl_.load(std::memory_order_acquire) == no_backtrace)
+        {
+            return true;
+        }
+        auto const bt = std::atomic_load(&backtrace_);
+        if (!bt)
+        {
+            return true;
+        }
+        if (r.lvl < get_level())
+        {
+            bt->push(r);
+            return false;
+        }
+        if (r.lvl >= level::error)
+        {
+            bt->drain(writer{ *this });
+        }
+        return true;
+    }
+
+    template <class recordT>
+    void write_record(recordT&& r)
+    {
+        emitted_.add();
+        if (async_)
+        {
+            // Buffers of r go around the queue and come back to the
+            // thread, the worker doesn't free them.
+            static thread_local detail::record_entry e;
+            e.assign(std::forward<recordT>(r));
+            async_->push(std::move(e));
+            return ;
+        }
+        detail::resolve_time(r);
+        dispatch(r);
+    }
+
+    // Sinks sharing a layout are handed the message formatted once, the
+    // last of them takes it without a copy.
+    template <class recordT>
+    void dispatch(recordT const& r)
+    {
+        detail::scratch_text scratch;
+        auto& text = scratch.get();
+        for (auto& sk_adapter : sink_adapters_)
+        {
+            if (*sk_adapter && sk_adapter->accept(r.lvl))
+            {
+                text.expect(sk_adapter->format_key());
+            }
+        }
+        for (auto& sk_adapter : sink_adapters_)
+        {
+            if (!*sk_adapter)
+            {
+                // TODO: Log sink is invalid.
+                continue;
+            }
+            if (!sk_adapter->accept(r.lvl))
+            {
+                continue;
+            }
+            sk_adapter->consume(r, text);
+        }
+    }
+
+    // Runs of narrow and unicode records are handed to sinks as batches,
+    // in the order they were queued.
+    void dispatch_batch(detail::record_entry* entries, std::size_t n)
     {
-        using char_type = charT;
-        assert(sk && "sink instance point must exists");
-        auto ska = std::make_shared<detail::basic_sink_adapter<char_type>>(sk);
-        sink_adapters_.emplace_back(ska);
-        return sk;
-    }
+        using kind = detail::record_entry::kind;
 
-    bool consume(level lvl) const
-    {
-        return lvl >= get_level();
+        // Kept by each worker thread, batches don't allocate once warm.
+        static thread_local std::vector<basic_record_span<char>::item> narrow;
+        static thread_local std::vector<basic_record_span<wchar_t>::item> wide;
+        detail::span_collector<char> const to_narrow{ narrow };
+        detail::span_collector<wchar_t> const to_wide{ wide };
+
+        // Converted once for all sinks of the other char type.
+        static thread_local detail::converted_batch<wchar_t> narrow_converted;
+        static thread_local detail::converted_batch<char> wide_converted;
+
+        for (std::size_t i = 0; i != n; ++i)
+        {
+            auto const k = entries[i].get_kind();
+            auto const is_wide = k == kind::wide || k == kind::wide_d;
+            if (is_wide && !narrow.empty())
+            {
+                dispatch_span(narrow, narrow_converted);
+            }
+            else if (!is_wide && !wide.empty())
+            {
+                dispatch_span(wide, wide_converted);
+            }
+            entries[i].visit(detail::time_resolver());
+            entries[i].visit(to_narrow);
+            entries[i].visit(to_wide);
+        }
+        dispatch_span(narrow, narrow_converted);
+        dispatch_span(wide, wide_converted);
     }
 
-    template <class recordT>
-    void push_record(recordT const& r)
+    template <class itemT, class convertedT>
+    void dispatch_span(std::vector<itemT>& items, convertedT& converted)
     {
+        if (items.empty())
+        {
+            return ;
+        }
+
+        using record_t = typename std::remove_pointer<
+            decltype(itemT::record)>::type;
+        using span_t   = basic_record_span<typename record_t::char_type>;
+
+        span_t const records{ items.data(), items.size() };
         for (auto& sk_adapter : sink_adapters_)
         {
             if (!*sk_adapter)
             {
-                // TODO: Log sink is invalid.
+                // Skipped as by dispatch().
                 continue;
             }
-            sk_adapter->consume(r);
+            sk_adapter->consume_batch(records, converted);
         }
+        converted.reset();
+        items.clear();
     }
 
+    struct dispatcher
+    {
+        template <class recordT>
+        void operator()(recordT const& r) const
+        {
+            if (!self.pass_backtrace(r))
+            {
+                return ;
+            }
+            self.dispatch(r);
+        }
+
+        logger& self;
+    };
+
+    struct writer
+    {
+        template <class recordT>
+        void operator()(recordT& r) const
+        {
+            self.write_record(r);
+        }
+
+        logger& self;
+    };
+
 public:
     // Generate log title message string.
     static std::string title(std::string const& text = "TinyLog")
@@ -2235,10 +9582,39 @@ public:
         return gen_title(text, TINYLOG_TITILE_CHARW);
     }
 
+public:
+    static constexpr std::size_t default_queue_capacity = 8192;
+    static constexpr std::size_t default_deferred_buffer_size = 256 * 1024;
+
 private:
+    using deferred_worker_t = detail::deferred_worker<dispatcher>;
+
+    static constexpr level no_backtrace = static_cast<level>(level::fatal + 1);
+
+    // Calibrate tsc before logging rather than on the first record.
+    static clock_source start_clock(clock_source clock)
+    {
+        if (clock == clock_source::tsc)
+        {
+            detail::tsc_clock::instance().start();
+        }
+        return clock;
+    }
+
     string_t name_;
-    level lvl_ = level::trace;
+    std::atomic<level> lvl_{level::trace};
+    std::atomic<clock_source> clock_{start_clock(TINYLOG_CLOCK_SOURCE)};
     std::vector<sink_adapter_t> sink_adapters_;
+
+    std::atomic<level> backtrace_lvl_{no_backtrace};
+    backtrace_ptr backtrace_;
+
+    detail::stats_counter emitted_;
+    mutable detail::stats_counter filtered_;
+
+    // Destroyed first, queued records are written while sinks still exist.
+    std::unique_ptr<detail::async_worker> async_;
+    std::unique_ptr<deferred_worker_t> deferred_;
 };
 
 /*****************************************************************************/
@@ -2268,6 +9644,7 @@ public:
     using xstring_t     = std::basic_string<extern_type>;
     using logger_t      = logger;
     using logger_ptr    = std::shared_ptr<logger_t>;
+    using logger_map    = std::unordered_map<string_t, logger_ptr>;
 
 public:
     static registry_impl& instance()
@@ -2296,8 +9673,25 @@ public:
 public:
     void set_level(level lvl)
     {
-        std::lock_guard<mutex_type> lock(mtx_);
-        lvl_ = lvl;
+        lvl_.store(lvl, std::memory_order_relaxed);
+        bump_filter_epoch();
+    }
+
+    level get_level() const
+    {
+        return lvl_.load(std::memory_order_relaxed);
+    }
+
+    bool consume(level lvl) const
+    {
+        return lvl >= get_level();
+    }
+
+    // Moved whenever a logger is created, added or erased, or a level
+    // changes.
+    std::size_t generation() const
+    {
+        return filter_epoch().load(std::memory_order_acquire);
     }
 
     logger_ptr create_logger(string_t const& logger_name)
@@ -2305,7 +9699,7 @@ public:
         std::lock_guard<mutex_type> lock(mtx_);
         throw_if_exists(logger_name);
         auto p = std::make_shared<logger_t>(logger_name);
-        loggers_[logger_name] = p;
+        update([&](logger_map& loggers) { loggers[logger_name] = p; });
         return p;
     }
 
@@ -2325,29 +9719,86 @@ public:
 #endif
     }
 
+    logger_ptr create_async_logger(string_t const& logger_name
+                                   , std::size_t queue_capacity
+                                   = logger_t::default_queue_capacity
+                                   , overflow_policy policy
+                                   = overflow_policy::block
+                                   , std::size_t thread_count = 1)
+    {
+        auto p = create_logger(logger_name);
+        p->enable_async(queue_capacity, policy, thread_count);
+        return p;
+    }
+
+    logger_ptr create_async_logger(xstring_t const& logger_name
+                                   , std::size_t queue_capacity
+                                   = logger_t::default_queue_capacity
+                                   , overflow_policy policy
+                                   = overflow_policy::block
+                                   , std::size_t thread_count = 1)
+    {
+        string_t name;
+        string_traits<>::convert(name, logger_name);
+        return create_async_logger(name, queue_capacity
+                                   , policy, thread_count);
+    }
+
+    logger_ptr create_async_logger(std::size_t queue_capacity
+                                   = logger_t::default_queue_capacity
+                                   , overflow_policy policy
+                                   = overflow_policy::block
+                                   , std::size_t thread_count = 1)
+    {
+#if defined(TINYLOG_WINDOWS_API)
+        return create_async_logger(TINYLOG_DEFAULTW, queue_capacity
+                                   , policy, thread_count);
+#else
+        return create_async_logger(TINYLOG_DEFAULT, queue_capacity
+                                   , policy, thread_count);
+#endif
+    }
+
     logger_ptr add_logger(logger_ptr inst)
     {
         assert(inst && "logger instance point must exists");
         auto const name = cvt(inst->name());
         std::lock_guard<mutex_type> lock(mtx_);
         throw_if_exists(name);
-        loggers_[name] = inst;
+        update([&](logger_map& loggers) { loggers[name] = inst; });
         return inst;
     }
 
 public:
-    logger_ptr get_logger(string_t const& logger_name
-                          , level filter_lvl = level::trace)
+    // Readers never lock, they look up the latest published snapshot.
+    logger_ptr find_logger(string_t const& logger_name) const
     {
-        std::lock_guard<mutex_type> lock(mtx_);
-        auto found = loggers_.find(logger_name);
-        if (found != loggers_.cend() && lvl_ <= filter_lvl)
+        auto const loggers = std::atomic_load(&loggers_);
+        auto found = loggers->find(logger_name);
+        if (found != loggers->cend())
         {
             return found->second;
         }
         return nullptr;
     }
 
+    logger_ptr find_logger(xstring_t const& logger_name) const
+    {
+        string_t name;
+        string_traits<>::convert(name, logger_name);
+        return find_logger(name);
+    }
+
+    logger_ptr get_logger(string_t const& logger_name
+                          , level filter_lvl = level::trace)
+    {
+        if (!consume(filter_lvl))
+        {
+            return nullptr;
+        }
+        return find_logger(logger_name);
+    }
+
     logger_ptr get_logger(xstring_t const& logger_name
                           , level filter_lvl = level::trace)
     {
@@ -2366,10 +9817,12 @@ public:
     }
 
 public:
+    // Call sites which cached the logger release it on the next statement
+    // of their thread.
     void erase_logger(string_t const& logger_name)
     {
         std::lock_guard<mutex_type> lock(mtx_);
-        loggers_.erase(logger_name);
+        update([&](logger_map& loggers) { loggers.erase(logger_name); });
     }
 
     void erase_logger(xstring_t const& logger_name)
@@ -2391,7 +9844,7 @@ public:
     void erase_all_logger()
     {
         std::lock_guard<mutex_type> lock(mtx_);
-        loggers_.clear();
+        update([](logger_map& loggers) { loggers.clear(); });
     }
 
     registry_impl() = default;
@@ -2410,9 +9863,20 @@ private:
         return s;
     }
 
+    // Copy on write, must be called with mtx_ held.
+    template <class updateT>
+    void update(updateT&& fn)
+    {
+        auto loggers = std::make_shared<logger_map>(*loggers_);
+        fn(*loggers);
+        std::atomic_store(&loggers_
+                          , std::shared_ptr<logger_map const>(loggers));
+        bump_filter_epoch();
+    }
+
     void throw_if_exists(string_t const& logger_name) const
     {
-        if (loggers_.find(logger_name) != loggers_.cend())
+        if (loggers_->find(logger_name) != loggers_->cend())
         {
             std::string name;
             string_traits<>::convert(name, logger_name);
@@ -2446,8 +9910,9 @@ private:
 
 private:
     mutable mutex_type mtx_;
-    level lvl_ = level::trace;
-    std::unordered_map<string_t, logger_ptr> loggers_;
+    std::atomic<level> lvl_{level::trace};
+    std::shared_ptr<logger_map const> loggers_
+    = std::make_shared<logger_map const>();
 };
 
 template <class mutexT>
@@ -2488,6 +9953,43 @@ public:
         return impl::instance().create_logger();
     }
 
+    // Create logger whose sinks are written on background threads.
+    //
+    // @see logger::enable_async
+    static logger_ptr create_async_logger(string_t const& logger_name
+                                          , std::size_t queue_capacity
+                                          = logger::default_queue_capacity
+                                          , overflow_policy policy
+                                          = overflow_policy::block
+                                          , std::size_t thread_count = 1)
+    {
+        return impl::instance().create_async_logger(logger_name
+                                                    , queue_capacity
+                                                    , policy, thread_count);
+    }
+
+    static logger_ptr create_async_logger(xstring_t const& logger_name
+                                          , std::size_t queue_capacity
+                                          = logger::default_queue_capacity
+                                          , overflow_policy policy
+                                          = overflow_policy::block
+                                          , std::size_t thread_count = 1)
+    {
+        return impl::instance().create_async_logger(logger_name
+                                                    , queue_capacity
+                                                    , policy, thread_count);
+    }
+
+    static logger_ptr create_async_logger(std::size_t queue_capacity
+                                          = logger::default_queue_capacity
+                                          , overflow_policy policy
+                                          = overflow_policy::block
+                                          , std::size_t thread_count = 1)
+    {
+        return impl::instance().create_async_logger(queue_capacity
+                                                    , policy, thread_count);
+    }
+
     static logger_ptr add_logger(logger_ptr inst)
     {
         return impl::instance().add_logger(inst);
@@ -2522,22 +10024,317 @@ public:
         return impl::instance().erase_logger(logger_name);
     }
 
-    void erase_logger()
+    void erase_logger()
+    {
+        return impl::instance().erase_logger();
+    }
+
+    void erase_all_logger()
+    {
+        return impl::instance().erase_all_logger();
+    }
+};
+
+/*****************************************************************************/
+/* Capture Logging. */
+
+namespace detail
+{
+
+// Logger name known to be a string literal.
+//
+// @see TINYLOG_LITERAL
+template <class charT>
+struct literal_name
+{
+    charT const* str;
+};
+
+template <class charT, std::size_t N>
+constexpr literal_name<charT> make_literal_name(charT const (&s)[N])
+{
+    return literal_name<charT>{ s };
+}
+
+// Call site caches of a thread are linked, the first one seeing the epoch
+// moved releases the loggers all of them hold. Loggers used by statements
+// running on the thread are released when the outermost one ends.
+class logger_cache_base
+{
+public:
+    using logger_ptr = std::shared_ptr<logger>;
+
+public:
+    logger_cache_base()
+    {
+        auto& t = local();
+        next_ = t.head;
+        if (next_)
+        {
+            next_->prev_ = this;
+        }
+        t.head = this;
+    }
+
+    ~logger_cache_base()
+    {
+        auto& t = local();
+        if (prev_)
+        {
+            prev_->next_ = next_;
+        }
+        else
+        {
+            t.head = next_;
+        }
+        if (next_)
+        {
+            next_->prev_ = prev_;
+        }
+    }
+
+    logger_cache_base(logger_cache_base const&) = delete;
+    logger_cache_base& operator=(logger_cache_base const&) = delete;
+
+    static void enter()
+    {
+        ++local().active;
+    }
+
+    static void leave()
+    {
+        auto& t = local();
+        if (--t.active == 0 && !t.retired.empty())
+        {
+            release(t);
+        }
+    }
+
+protected:
+    // Called before resolving from the registry of epoch.
+    void retire(std::size_t epoch)
+    {
+        auto& t = local();
+        if (epoch_ != epoch)
+        {
+            for (auto c = t.head; c; c = c->next_)
+            {
+                if (c->inst_ && c->epoch_ != epoch)
+                {
+                    t.retired.emplace_back(std::move(c->inst_));
+                }
+            }
+        }
+        if (inst_)
+        {
+            t.retired.emplace_back(std::move(inst_));
+        }
+        if (t.active == 0)
+        {
+            release(t);
+        }
+    }
+
+private:
+    struct thread_caches
+    {
+        logger_cache_base* head = nullptr;
+        std::size_t active = 0;
+        std::vector<logger_ptr> retired;
+    };
+
+    static thread_caches& local()
+    {
+        static thread_local thread_caches t;
+        return t;
+    }
+
+    // A logger destroyed may log itself.
+    static void release(thread_caches& t)
+    {
+        std::vector<logger_ptr> retired;
+        retired.swap(t.retired);
+    }
+
+protected:
+    std::size_t epoch_ = 0;
+    logger_ptr inst_;
+
+private:
+    logger_cache_base* prev_ = nullptr;
+    logger_cache_base* next_ = nullptr;
+};
+
+// Logger of a running statement.
+class logger_ref
+{
+public:
+    explicit logger_ref(logger* inst) : inst_(inst)
+    {
+        if (inst_)
+        {
+            logger_cache_base::enter();
+        }
+    }
+
+    ~logger_ref()
+    {
+        reset();
+    }
+
+    logger_ref(logger_ref const&) = delete;
+    logger_ref& operator=(logger_ref const&) = delete;
+
+    logger_ref& operator=(std::nullptr_t)
+    {
+        reset();
+        return *this;
+    }
+
+    operator logger*() const
+    {
+        return inst_;
+    }
+
+private:
+    void reset()
+    {
+        if (inst_)
+        {
+            inst_ = nullptr;
+            logger_cache_base::leave();
+        }
+    }
+
+private:
+    logger* inst_;
+};
+
+// Resolve the logger of a log statement once, instead of looking up the
+// registry on every statement. One instance per call site and thread, so
+// neither a lock nor a shared reference count is touched on the hot path.
+//
+// The lowest level passing the registry and the logger is cached as well,
+// until the epoch moves a filtered statement costs a relaxed load and
+// compares.
+//
+// @see TINYLOG_CALL_SITE_LOGGER
+template <class charT>
+class basic_logger_cache : public logger_cache_base
+{
+public:
+    using char_type  = charT;
+    using string_t   = std::basic_string<char_type>;
+    using logger_t   = logger;
+    using logger_ptr = std::shared_ptr<logger_t>;
+    using registry_t = registry::impl;
+
+public:
+    // Logger instance is used as it is.
+    //
+    // @return nullptr if the statement is filtered.
+    logger_t* get(logger_ptr const& inst, level lvl)
+    {
+        return get(inst.get(), lvl);
+    }
+
+    logger_t* get(logger_t* inst, level lvl)
+    {
+        return inst && inst->consume(lvl) ? inst : nullptr;
+    }
+
+    // String literal: its address identifies the name.
+    logger_t* get(literal_name<char_type> logger_name, level lvl)
+    {
+        if (!is_current() || key_ != logger_name.str)
+        {
+            resolve(logger_name.str);
+            key_ = logger_name.str;
+        }
+        return pass(lvl);
+    }
+
+    // Other names may change between statements, they are compared.
+    template <class nameT>
+    logger_t* get(nameT const& logger_name, level lvl)
+    {
+        if (!is_current() || key_ || !same_name(logger_name))
+        {
+            resolve(logger_name);
+            name_ = logger_name;
+        }
+        return pass(lvl);
+    }
+
+private:
+    bool is_current() const
+    {
+        return epoch_ == filter_epoch().load(std::memory_order_relaxed);
+    }
+
+    // Compared in one pass, the name is usually short.
+    bool same_name(char_type const* logger_name) const
+    {
+        auto p = name_.c_str();
+        for (; *p == *logger_name; ++p, ++logger_name)
+        {
+            if (*p == char_type())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <class nameT>
+    bool same_name(nameT const& logger_name) const
+    {
+        return name_ == logger_name;
+    }
+
+    logger_t* pass(level lvl) const
     {
-        return impl::instance().erase_logger();
+        if (lvl >= threshold_)
+        {
+            return inst_.get();
+        }
+#if defined(TINYLOG_ENABLE_STATS)
+        if (inst_ && lvl >= registry_lvl_)
+        {
+            inst_->note_filtered();
+        }
+#endif // TINYLOG_ENABLE_STATS
+        return nullptr;
     }
 
-    void erase_all_logger()
+    template <class nameT>
+    void resolve(nameT const& logger_name)
     {
-        return impl::instance().erase_all_logger();
+        auto const epoch = filter_epoch().load(std::memory_order_acquire);
+        retire(epoch);
+
+        auto const& reg = registry_t::instance();
+        inst_ = reg.find_logger(string_t(logger_name));
+        epoch_ = epoch;
+        key_ = nullptr;
+        name_.clear();
+
+        registry_lvl_ = reg.get_level();
+        threshold_ = inst_ ? (std::max)(registry_lvl_, inst_->threshold())
+                           : never;
     }
-};
 
-/*****************************************************************************/
-/* Capture Logging. */
+private:
+    static constexpr level never = static_cast<level>(level::fatal + 1);
 
-namespace detail
-{
+    char_type const* key_ = nullptr;
+    string_t name_;
+    level threshold_ = never;
+    level registry_lvl_ = never;
+};
+
+template <class charT>
+constexpr level basic_logger_cache<charT>::never;
 
 template <class charT>
 class basic_dlprintf_base
@@ -2550,13 +10347,20 @@ public:
 
 public:
     explicit basic_dlprintf_base(logger_ptr inst)
+        : holder_(inst), logger_(inst.get())
+    {
+    }
+
+    // Caller keeps logger alive.
+    explicit basic_dlprintf_base(logger_t* inst)
         : logger_(inst)
     {
     }
 
     explicit basic_dlprintf_base(string_t const& logger_name
                                  , level filter_lvl)
-        : logger_(registry::get_logger(logger_name, filter_lvl))
+        : holder_(registry::get_logger(logger_name, filter_lvl))
+        , logger_(holder_.get())
     {
     }
 
@@ -2579,18 +10383,20 @@ public:
 
     virtual bool flush()
     {
-        logger_.reset();
+        logger_ = nullptr;
+        holder_.reset();
         return true;
     }
 
 protected:
-    logger_ptr get_logger()
+    logger_t* get_logger()
     {
         return logger_;
     }
 
 private:
-    logger_ptr logger_;
+    logger_ptr holder_;
+    logger_t* logger_ = nullptr;
 };
 
 template <class charT>
@@ -2611,6 +10417,11 @@ public:
     {
     }
 
+    explicit basic_dlprintf(logger_t* inst, level lvl)
+        : base(inst), record_(lvl)
+    {
+    }
+
     explicit basic_dlprintf(string_t const& logger_name, level lvl)
         : base(logger_name, lvl), record_(lvl)
     {
@@ -2642,7 +10453,7 @@ public:
         auto inst = base::get_logger();
         if (inst)
         {
-            inst->push_record(record_);
+            inst->push_record(std::move(record_));
         }
         return base::flush();
     }
@@ -2675,6 +10486,14 @@ public:
     {
     }
 
+    explicit basic_dlprintf_d(logger_t* inst, level lvl
+                              , string_t const& file
+                              , std::size_t line
+                              , string_t const& func)
+        : base(inst), record_(lvl, file, line, func)
+    {
+    }
+
     explicit basic_dlprintf_d(string_t const& logger_name, level lvl
                               , string_t const& file
                               , std::size_t line
@@ -2683,6 +10502,13 @@ public:
     {
     }
 
+    // Refer to the static call site, nothing is copied.
+    explicit basic_dlprintf_d(logger_t* inst, level lvl
+                              , basic_source_location<char_type> const& loc)
+        : base(inst), record_(lvl, loc)
+    {
+    }
+
     bool operator()(string_t const& fmt)
     {
         record_.message = fmt;
@@ -2709,7 +10535,7 @@ public:
         auto inst = base::get_logger();
         if (inst)
         {
-            inst->push_record(record_);
+            inst->push_record(std::move(record_));
         }
         return base::flush();
     }
@@ -2721,31 +10547,184 @@ private:
 using dlprintf_d_impl  = basic_dlprintf_d<char>;
 using dlwprintf_d_impl = basic_dlprintf_d<wchar_t>;
 
-template<class charT>
-class basic_odlstream_base
-    : public std::basic_ostream<charT>
+// Stream of a [w]lout statement, kv adds a structured field to its
+// record. Fields are written by json_layout and logfmt_layout, appended to
+// the message by default_layout.
+//
+// e.g.
+//   lout(info).kv("user", id).kv("ms", dt) << "login";
+//
+// @attention kv returns the stream, call it before <<.
+template <class charT>
+class basic_record_ostream : public std::basic_ostream<charT>
 {
 public:
     using base      = std::basic_ostream<charT>;
     using char_type = charT;
     using string_t  = std::basic_string<char_type>;
-    using sbuf_t    = std::basic_stringbuf<char_type>;
+    using fields_t  = basic_kv_fields<char_type>;
+
+public:
+    explicit basic_record_ostream(std::basic_streambuf<char_type>* sb
+                                  , fields_t& fields)
+        : base(sb), fields_(fields)
+    {}
+
+    template <class T>
+    basic_record_ostream& kv(char_type const* key, T const& value)
+    {
+        fields_.add(key, std::char_traits<char_type>::length(key), value);
+        return *this;
+    }
+
+    template <class T>
+    basic_record_ostream& kv(string_t const& key, T const& value)
+    {
+        fields_.add(key.data(), key.size(), value);
+        return *this;
+    }
+
+private:
+    fields_t& fields_;
+};
+
+// Record and the stream writing its message, reused by log statements.
+template <class recordT>
+class capture_entry
+{
+public:
+    using record_t  = recordT;
+    using char_type = typename record_t::char_type;
+    using ostream_t = basic_record_ostream<char_type>;
+
+    // Larger message buffer is not kept.
+    static constexpr std::size_t max_retained = 64 * 1024;
+
+public:
+    capture_entry() : strm_(&sbuf_, record_.fields)
+    {
+        sbuf_.attach(&record_.message);
+        fill_ = strm_.fill();
+    }
+
+    capture_entry(capture_entry const&) = delete;
+    capture_entry& operator=(capture_entry const&) = delete;
+
+    record_t& record()
+    {
+        return record_;
+    }
+
+    ostream_t& stream()
+    {
+        return strm_;
+    }
+
+    // Restore the default stream state.
+    void reset()
+    {
+        strm_.clear();
+        strm_.flags(std::ios_base::skipws | std::ios_base::dec);
+        strm_.width(0);
+        strm_.precision(6);
+        strm_.fill(fill_);
+        if (record_.message.capacity() > max_retained)
+        {
+            typename record_t::string_t().swap(record_.message);
+        }
+        record_.message.clear();
+        record_.payload = nullptr;
+        record_.fields.clear();
+    }
+
+private:
+    record_t record_;
+    basic_string_appendbuf<char_type> sbuf_;
+    ostream_t strm_;
+    char_type fill_;
+};
+
+// Thread local free list of capture entries.
+template <class recordT>
+class capture_pool
+{
+public:
+    using entry_t = capture_entry<recordT>;
+    using entry_ptr = std::unique_ptr<entry_t>;
+
+    static constexpr std::size_t max_pooled = 8;
+
+public:
+    static entry_ptr acquire()
+    {
+        auto& entries = free_list();
+        if (entries.empty())
+        {
+            return entry_ptr(new entry_t);
+        }
+        auto e = std::move(entries.back());
+        entries.pop_back();
+        return e;
+    }
+
+    static void release(entry_ptr e)
+    {
+        auto& entries = free_list();
+        if (entries.size() < max_pooled)
+        {
+            e->reset();
+            entries.emplace_back(std::move(e));
+        }
+    }
+
+private:
+    static std::vector<entry_ptr>& free_list()
+    {
+        static thread_local std::vector<entry_ptr> entries;
+        return entries;
+    }
+};
+
+// Borrow a capture entry for the life time of a log statement.
+template <class recordT>
+class basic_odlstream_base
+{
+public:
+    using record_t  = recordT;
+    using char_type = typename record_t::char_type;
+    using string_t  = std::basic_string<char_type>;
+    using ostream_t = basic_record_ostream<char_type>;
+    using pool_t    = capture_pool<record_t>;
     using logger_t  = logger;
     using logger_ptr= std::shared_ptr<logger_t>;
 
 public:
     explicit basic_odlstream_base(logger_ptr inst)
-        : base(&stringbuf_), logger_(inst)
+        : holder_(inst), logger_(inst.get()), entry_(pool_t::acquire())
+    {
+    }
+
+    // Caller keeps logger alive.
+    explicit basic_odlstream_base(logger_t* inst)
+        : logger_(inst), entry_(pool_t::acquire())
     {
     }
 
     explicit basic_odlstream_base(string_t const& logger_name
                                   , level filter_lvl = level::trace)
-        : base(&stringbuf_)
-        , logger_(registry::get_logger(logger_name, filter_lvl))
+        : holder_(registry::get_logger(logger_name, filter_lvl))
+        , logger_(holder_.get()), entry_(pool_t::acquire())
     {
     }
 
+    ~basic_odlstream_base()
+    {
+        pool_t::release(std::move(entry_));
+    }
+
+    basic_odlstream_base(basic_odlstream_base const&) = delete;
+    basic_odlstream_base& operator=(basic_odlstream_base const&) = delete;
+
     explicit operator bool() const
     {
         return is_open();
@@ -2758,76 +10737,95 @@ public:
 
     bool is_open() const
     {
-        return logger_ && logger_->consume(get_level());
+        return logger_ && logger_->consume(entry_->record().lvl);
     }
 
-    virtual level get_level() const = 0;
+    ostream_t& stream()
+    {
+        return entry_->stream();
+    }
 
-    virtual bool flush()
+    // lfmt: format into the message of the record directly. The payload
+    // is attached if sinks are called before it goes out of scope.
+    void format(basic_fmt_payload<char_type> const& payload, bool attach)
+    {
+        auto& r = entry_->record();
+        vformat(r.message, payload.site->fmt, payload.args
+                , payload.arg_count);
+        r.payload = attach ? &payload : nullptr;
+    }
+
+    // Message is written into the record directly, the record is handed
+    // over and keeps its buffer while the logger writes synchronously.
+    bool flush()
     {
-        logger_.reset();
+        if (logger_)
+        {
+            logger_->push_record(std::move(entry_->record()));
+        }
+        logger_ = nullptr;
+        holder_.reset();
         return true;
     }
 
 protected:
-    sbuf_t& get_sbuf()
+    record_t& get_record()
     {
-        return stringbuf_;
+        return entry_->record();
     }
 
-    logger_ptr get_logger()
+    // Only the clock is read, the logger converts the time.
+    void stamp(record_t& r) const
     {
-        return logger_;
+        stamp_record(r, logger_ ? logger_->get_clock() : clock_source::none);
     }
 
 private:
-    sbuf_t stringbuf_;
-    logger_ptr logger_;
+    logger_ptr holder_;
+    logger_t* logger_ = nullptr;
+    typename pool_t::entry_ptr entry_;
 };
 
 template<class charT>
 class basic_odlstream
-    : public basic_odlstream_base<charT>
+    : public basic_odlstream_base<basic_record<charT>>
 {
 public:
-    using base      = basic_odlstream_base<charT>;
+    using base      = basic_odlstream_base<basic_record<charT>>;
     using char_type = typename base::char_type;
     using string_t  = typename base::string_t;
-    using sbuf_t    = typename base::sbuf_t;
-    using record_t  = basic_record<char_type>;
+    using record_t  = typename base::record_t;
     using logger_t  = typename base::logger_t;
     using logger_ptr= typename base::logger_ptr;
 
 public:
     explicit basic_odlstream(logger_ptr inst, level lvl)
-        : base(inst), record_(lvl)
+        : base(inst)
     {
+        init(lvl);
     }
 
-    explicit basic_odlstream(string_t const& logger_name
-                             , level lvl)
-        : base(logger_name, lvl), record_(lvl)
+    explicit basic_odlstream(logger_t* inst, level lvl)
+        : base(inst)
     {
+        init(lvl);
     }
 
-    level get_level() const override
+    explicit basic_odlstream(string_t const& logger_name
+                             , level lvl)
+        : base(logger_name, lvl)
     {
-        return record_.lvl;
+        init(lvl);
     }
 
-    bool flush() override
+private:
+    void init(level lvl)
     {
-        auto inst = base::get_logger();
-        if (inst)
-        {
-            record_.message = base::get_sbuf().str();
-            inst->push_record(record_);
-        }
-        return base::flush();
+        auto& r = base::get_record();
+        base::stamp(r);
+        r.lvl = lvl;
+        r.id  = detail::curr_thrd_id();
     }
-
-private:
-    record_t record_;
 };
 
 using odlstream  = basic_odlstream<char>;
@@ -2835,14 +10833,13 @@ using wodlstream = basic_odlstream<wchar_t>;
 
 template<class charT>
 class basic_odlstream_d
-    : public basic_odlstream_base<charT>
+    : public basic_odlstream_base<basic_record_d<charT>>
 {
 public:
-    using base      = basic_odlstream_base<charT>;
+    using base      = basic_odlstream_base<basic_record_d<charT>>;
     using char_type = typename base::char_type;
     using string_t  = typename base::string_t;
-    using sbuf_t    = typename base::sbuf_t;
-    using record_t  = basic_record_d<char_type>;
+    using record_t  = typename base::record_t;
     using logger_t  = typename base::logger_t;
     using logger_ptr= typename base::logger_ptr;
 
@@ -2852,8 +10849,26 @@ public:
                                , std::size_t line
                                , string_t const& func)
         : base(inst)
-        , record_(lvl, file, line, func)
     {
+        init(lvl, file, line, func);
+    }
+
+    explicit basic_odlstream_d(logger_t* inst, level lvl
+                               , char_type const* file
+                               , std::size_t line
+                               , char_type const* func)
+        : base(inst)
+    {
+        init(lvl, file, line, func);
+    }
+
+    explicit basic_odlstream_d(logger_t* inst, level lvl
+                               , char_type const* file
+                               , std::size_t line
+                               , string_t const& func)
+        : base(inst)
+    {
+        init(lvl, file, line, func);
     }
 
     explicit basic_odlstream_d(string_t const& logger_name
@@ -2862,32 +10877,233 @@ public:
                                , std::size_t line
                                , string_t const& func)
         : base(logger_name, lvl)
-        , record_(lvl, file, line, func)
     {
+        init(lvl, file, line, func);
     }
 
-    level get_level() const override
+    // Refer to the static call site, nothing is copied.
+    explicit basic_odlstream_d(logger_t* inst, level lvl
+                               , basic_source_location<char_type> const& loc)
+        : base(inst)
     {
-        return record_.lvl;
+        auto& r = init(lvl);
+        r.file.clear();
+        r.line = 0;
+        r.func.clear();
+        r.location = &loc;
     }
 
-    bool flush() override
+private:
+    // Assign into kept capacity, instead of constructing strings.
+    template <class fileT, class funcT>
+    void init(level lvl, fileT const& file, std::size_t line
+              , funcT const& func)
     {
-        auto inst = base::get_logger();
-        if (inst)
+        auto& r = init(lvl);
+        r.file.assign(file);
+        r.line = line;
+        r.func.assign(func);
+        r.location = nullptr;
+    }
+
+    record_t& init(level lvl)
+    {
+        auto& r = base::get_record();
+        base::stamp(r);
+        r.lvl  = lvl;
+        r.id   = detail::curr_thrd_id();
+        return r;
+    }
+};
+
+using odlstream_d    = basic_odlstream_d<char>;
+using wodlstream_d   = basic_odlstream_d<wchar_t>;
+
+// Write a [w]lfmt statement, deferred to the background thread if the
+// logger is deferred.
+template <class charT, int err, class... Args>
+void log_format(logger* inst, level lvl, basic_fmt_site<charT> const& site
+                , fmt_guard<err>, Args const&... args)
+{
+    if (inst->is_deferred() && inst->defer(lvl, site, args...))
+    {
+        return ;
+    }
+
+    // One more element, arrays of size zero are not allowed.
+    fmt_arg<charT> const fmt_args[sizeof...(Args) + 1] = {
+        make_fmt_arg<charT>(args)...
+    };
+    basic_fmt_payload<charT> const payload = {
+        &site, fmt_args, sizeof...(Args)
+    };
+
+    // Queued records outlive the arguments.
+    auto const attach = !inst->is_async();
+    if (site.loc.file)
+    {
+        basic_odlstream_d<charT> strm(inst, lvl, site.loc);
+        strm.format(payload, attach);
+        strm.flush();
+    }
+    else
+    {
+        basic_odlstream<charT> strm(inst, lvl);
+        strm.format(payload, attach);
+        strm.flush();
+    }
+}
+
+}  // namespace detail
+
+/*****************************************************************************/
+/* Sampled Logging: Per call site limits of log statements. */
+
+namespace detail
+{
+
+// Result of a sampler suppressing the statement, otherwise samplers return
+// how many statements were suppressed since the last one passed.
+constexpr std::uint64_t sampled_out = static_cast<std::uint64_t>(-1);
+
+inline std::int64_t steady_nsec()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// Pass the first of every n statements.
+class every_n_sampler
+{
+public:
+    explicit every_n_sampler(std::uint64_t n) : n_(n ? n : 1)
+    {}
+
+    std::uint64_t pass()
+    {
+        auto const c = count_.fetch_add(1, std::memory_order_relaxed);
+        if (c % n_ != 0)
         {
-            record_.message = base::get_sbuf().str();
-            inst->push_record(record_);
+            return sampled_out;
         }
-        return base::flush();
+        return c ? n_ - 1 : 0;
     }
 
 private:
-    record_t record_;
+    std::uint64_t const n_;
+    std::atomic<std::uint64_t> count_{ 0 };
 };
 
-using odlstream_d    = basic_odlstream_d<char>;
-using wodlstream_d   = basic_odlstream_d<wchar_t>;
+// Pass the first n statements only.
+class first_n_sampler
+{
+public:
+    explicit first_n_sampler(std::uint64_t n) : n_(n)
+    {}
+
+    std::uint64_t pass()
+    {
+        // Stop counting once over, the counter never wraps.
+        if (count_.load(std::memory_order_relaxed) >= n_)
+        {
+            return sampled_out;
+        }
+        auto const c = count_.fetch_add(1, std::memory_order_relaxed);
+        return c < n_ ? 0 : sampled_out;
+    }
+
+private:
+    std::uint64_t const n_;
+    std::atomic<std::uint64_t> count_{ 0 };
+};
+
+// Pass one statement per interval of ms milliseconds at most.
+class every_ms_sampler
+{
+public:
+    explicit every_ms_sampler(std::int64_t ms) : interval_(ms * 1000000)
+    {}
+
+    std::uint64_t pass()
+    {
+        auto const now = steady_nsec();
+        auto next = next_.load(std::memory_order_relaxed);
+        if (now < next
+            || !next_.compare_exchange_strong(next, now + interval_
+                                              , std::memory_order_relaxed))
+        {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return sampled_out;
+        }
+        return suppressed_.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::int64_t const interval_;
+    std::atomic<std::int64_t> next_{ std::numeric_limits<std::int64_t>::min() };
+    std::atomic<std::uint64_t> suppressed_{ 0 };
+};
+
+// Token bucket of burst tokens refilled at per_sec a second, kept as the
+// time the bucket is full again (GCRA).
+class rate_sampler
+{
+public:
+    explicit rate_sampler(double per_sec, std::uint64_t burst)
+        : interval_(static_cast<std::int64_t>(1e9 / per_sec) + 1)
+        , limit_(interval_ * static_cast<std::int64_t>(burst ? burst : 1))
+    {
+        assert(per_sec > 0 && "rate of statements must be positive");
+    }
+
+    std::uint64_t pass()
+    {
+        auto const now = steady_nsec();
+        auto full = full_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            auto const next = (full > now ? full : now) + interval_;
+            if (next - now > limit_)
+            {
+                suppressed_.fetch_add(1, std::memory_order_relaxed);
+                return sampled_out;
+            }
+            if (full_.compare_exchange_weak(full, next
+                                            , std::memory_order_relaxed))
+            {
+                return suppressed_.exchange(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    std::int64_t const interval_;
+    std::int64_t const limit_;
+    std::atomic<std::int64_t> full_{ 0 };
+    std::atomic<std::uint64_t> suppressed_{ 0 };
+};
+
+// Written before the message of a sampled statement if others of the call
+// site were suppressed.
+struct suppressed_note
+{
+    std::uint64_t count;
+};
+
+template <class charT>
+std::basic_ostream<charT>& operator<<(std::basic_ostream<charT>& out
+                                      , suppressed_note const& note)
+{
+    if (note.count)
+    {
+        out << out.widen('(') << "suppressed"
+            << out.widen(' ') << note.count << out.widen(' ')
+            << (note.count == 1 ? "message" : "messages")
+            << out.widen(')') << out.widen(' ');
+    }
+    return out;
+}
 
 }  // namespace detail
 }  // namespace tinylog
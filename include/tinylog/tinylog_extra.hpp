@@ -10,8 +10,14 @@
  *     std::vector<int> v = { 1, 2, 3, 4, 5 };
  *     std::cout << v << std::endl;
  *
+ *     // Print 10 elements at most: [1, 2 ... (+999998 more)]
+ *     lout(debug) << limit(huge_vector, 10);
+ *
  *     // Print string in hex.
  *     std::cout << hexdump("Bravo! The job has been done well.") << std::endl;
+ *
+ *     // Log a large buffer in hex, one record per 4 KiB.
+ *     lhexdump(debug, buf, len);
  * }
  *
  * ```
@@ -41,7 +47,12 @@
 #ifndef TINYTINYLOG_EXTRA_HPP
 #define TINYTINYLOG_EXTRA_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <iomanip>
+#include <locale>
+#include <ostream>
 #include <sstream>
 #include <string>
 #include <system_error>
@@ -51,6 +62,8 @@
 #include <valarray>
 #include <vector>
 
+#include "tinylog.hpp"
+
 namespace tinylog
 {
 namespace detail
@@ -86,6 +99,7 @@ template <>
 struct delimiters<char>
 {
     static constexpr auto ellipsis      = "...";
+    static constexpr auto more          = "more";
     static constexpr auto space         = ' ';
     static constexpr auto comma         = ',';
     static constexpr auto colon         = ':';
@@ -101,6 +115,7 @@ template <>
 struct delimiters<wchar_t>
 {
     static constexpr auto ellipsis      = L"...";
+    static constexpr auto more          = L"more";
     static constexpr auto space         = L' ';
     static constexpr auto comma         = L',';
     static constexpr auto colon         = L':';
@@ -235,31 +250,336 @@ struct support_free_begin_stl<std::valarray<T>>
 {
 };
 
-// STL containers
-template <bool is_map, class Iterator
-          , class charT, class delimiterT = delimiters<charT>>
-inline void print_sequence(Iterator b, Iterator e
-                           , std::basic_ostream<charT>& out)
+// Elements and characters printed of a container at most, 0: no limit.
+struct print_limits
+{
+    std::size_t max_elems;
+    std::size_t max_chars;
+};
+
+// Bounds of containers printed without limit().
+struct default_print_limits
+{
+    std::atomic<std::size_t> max_elems{ 100 };
+    std::atomic<std::size_t> max_chars{ 64 * 1024 };
+
+    static default_print_limits& instance()
+    {
+        static default_print_limits limits;
+        return limits;
+    }
+
+    print_limits get() const
+    {
+        return { max_elems.load(std::memory_order_relaxed)
+                 , max_chars.load(std::memory_order_relaxed) };
+    }
+};
+
+// size()
+template <class T>
+struct has_size : private sfinae
+{
+private:
+    template <class Container>
+    static true_t& has(decltype(std::declval<Container const&>().size())*);
+
+    template <class Container>
+    static false_t& has(...);
+
+public:
+    static constexpr bool value = sizeof(has<T>(nullptr)) == sizeof(true_t);
+};
+
+constexpr std::size_t unknown_size = static_cast<std::size_t>(-1);
+
+template <class Container>
+std::size_t container_size(Container const& c, std::true_type)
+{
+    return static_cast<std::size_t>(c.size());
+}
+
+template <class Container>
+std::size_t container_size(Container const& /*c*/, std::false_type)
+{
+    return unknown_size;
+}
+
+// String the stream of a record appends to, nullptr for other streams.
+template <class charT>
+std::basic_string<charT>* string_target(std::basic_ostream<charT>& out)
 {
-    constexpr size_t max_print_count = 100u;
+#if defined(__cpp_rtti) || defined(__GXX_RTTI) || defined(_CPPRTTI)
+    auto const sb = dynamic_cast<basic_string_appendbuf<charT>*>(
+                        out.rdbuf());
+    return sb ? sb->str() : nullptr;
+#else
+    (void)out;
+    return nullptr;
+#endif
+}
+
+template <class charT>
+struct string_appender
+{
+    using char_type = charT;
+
+    void push_back(char_type c)
+    {
+        s.push_back(c);
+    }
+
+    std::basic_string<charT>& s;
+};
+
+// Print elements into s, the string os writes to. Integers, floating point
+// numbers and strings are appended as os would write them by default, other
+// elements are written by os.
+template <class charT, class delimiterT = delimiters<charT>>
+class bounded_printer
+{
+public:
+    using ostream_t = std::basic_ostream<charT>;
+    using string_t  = std::basic_string<charT>;
+
+public:
+    bounded_printer(ostream_t& os, string_t& s, print_limits const& limits)
+        : os_(os), s_(s), start_(s.size()), limits_(limits)
+        , plain_(is_plain(os))
+    {
+    }
+
+    // "[a, b ... (+K more)]", K is left out if the size is unknown.
+    template <bool is_map, class Iterator>
+    void sequence(Iterator b, Iterator e, std::size_t size)
+    {
+        auto const max_elems = limits_.max_elems ? limits_.max_elems
+                                                 : unknown_size;
+        std::size_t i = 0;
 
-    out << (is_map ? delimiterT::lbrace : delimiterT::lbracket);
-    for (size_t i = 0; b != e && i < max_print_count; ++i, ++b)
+        s_.push_back(is_map ? delimiterT::lbrace : delimiterT::lbracket);
+        for (; b != e && i != max_elems; ++i, ++b)
+        {
+            if (i > 0)
+            {
+                s_.push_back(delimiterT::comma);
+                s_.push_back(delimiterT::space);
+            }
+            element(*b);
+
+            if (limits_.max_chars != 0
+                && s_.size() - start_ > limits_.max_chars)
+            {
+                s_.resize(start_ + limits_.max_chars);
+                ++i;
+                ++b;
+                break;
+            }
+        }
+        if (b != e)
+        {
+            s_.push_back(delimiterT::space);
+            s_.append(delimiterT::ellipsis);
+            if (size != unknown_size && size > i)
+            {
+                s_.push_back(delimiterT::space);
+                s_.push_back(delimiterT::lparenthese);
+                s_.push_back(charT('+'));
+                string_appender<charT> buf{ s_ };
+                write_uint(buf, size - i);
+                s_.push_back(delimiterT::space);
+                s_.append(delimiterT::more);
+                s_.push_back(delimiterT::rparenthese);
+            }
+        }
+        s_.push_back(is_map ? delimiterT::rbrace : delimiterT::rbracket);
+    }
+
+private:
+    struct stream_tag {};
+    struct int_tag {};
+    struct float_tag {};
+    struct string_tag {};
+
+    template <class T>
+    using tag_of = typename std::conditional<
+        std::is_same<T, string_t>::value, string_tag
+        , typename std::conditional<
+            std::is_floating_point<T>::value
+            && !std::is_same<T, long double>::value, float_tag
+            , typename std::conditional<
+                std::is_integral<T>::value && (sizeof(T) > 1)
+                && !std::is_same<T, bool>::value
+                && !std::is_same<T, wchar_t>::value
+                && !std::is_same<T, char16_t>::value
+                && !std::is_same<T, char32_t>::value, int_tag
+                , stream_tag>::type>::type>::type;
+
+    template <class T>
+    void element(T const& v)
     {
-        if (i > 0)
+        put(v, tag_of<T>());
+    }
+
+    template <class Key, class Value>
+    void element(std::pair<Key, Value> const& p)
+    {
+        element(p.first);
+        s_.push_back(delimiterT::colon);
+        s_.push_back(delimiterT::space);
+        element(p.second);
+    }
+
+    template <class T>
+    void put(T const& v, stream_tag)
+    {
+        os_ << v;
+    }
+
+    void put(string_t const& v, string_tag)
+    {
+        s_.append(v);
+    }
+
+    template <class T>
+    void put(T const& v, int_tag)
+    {
+        if (!plain_)
         {
-            out << delimiterT::comma << delimiterT::space;
+            os_ << v;
+            return ;
         }
-        out << *b;
+        string_appender<charT> buf{ s_ };
+        write_int_value(buf, v, std::is_signed<T>());
+    }
+
+    template <class T>
+    void put(T const& v, float_tag)
+    {
+        if (!plain_)
+        {
+            os_ << v;
+            return ;
+        }
+        char text[64];
+        auto const n = std::snprintf(text, sizeof(text), "%.*g"
+                                     , static_cast<int>(os_.precision())
+                                     , static_cast<double>(v));
+        for (int k = 0; k < n && k < static_cast<int>(sizeof(text)); ++k)
+        {
+            s_.push_back(static_cast<charT>(text[k]));
+        }
+    }
+
+    template <class bufferT, class T>
+    static void write_int_value(bufferT& buf, T v, std::true_type)
+    {
+        write_int(buf, static_cast<long long>(v));
+    }
+
+    template <class bufferT, class T>
+    static void write_int_value(bufferT& buf, T v, std::false_type)
+    {
+        write_uint(buf, static_cast<unsigned long long>(v));
+    }
+
+    // Decimal, default float notation and the classic locale.
+    static bool is_plain(ostream_t& os)
+    {
+        auto const mask = std::ios_base::basefield | std::ios_base::floatfield
+                          | std::ios_base::showpos | std::ios_base::showpoint
+                          | std::ios_base::uppercase;
+        return (os.flags() & mask) == std::ios_base::dec
+               && os.getloc() == std::locale::classic();
     }
-    if (b != e)
+
+private:
+    ostream_t& os_;
+    string_t& s_;
+    std::size_t const start_;
+    print_limits const limits_;
+    bool const plain_;
+};
+
+// STL containers, written straight into the string of a record stream,
+// through a scratch string into other streams.
+template <bool is_map, class Container, class charT>
+inline void print_sequence(Container const& c
+                           , std::basic_ostream<charT>& out
+                           , print_limits const& limits)
+{
+    auto const size = container_size(c, std::integral_constant<bool
+                                             , has_size<Container>::value>());
+    out.width(0);
+
+    if (auto const s = string_target(out))
     {
-        out << delimiterT::space << delimiterT::ellipsis;
+        bounded_printer<charT> p(out, *s, limits);
+        p.template sequence<is_map>(std::begin(c), std::end(c), size);
+        return ;
     }
-    out << (is_map ? delimiterT::rbrace : delimiterT::rbracket);
+
+    std::basic_string<charT> s;
+    basic_string_appendbuf<charT> sbuf;
+    sbuf.attach(&s);
+    std::basic_ostream<charT> os(&sbuf);
+    os.copyfmt(out);
+
+    bounded_printer<charT> p(os, s, limits);
+    p.template sequence<is_map>(std::begin(c), std::end(c), size);
+    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+template <class Container>
+struct limited
+{
+    Container const& c;
+    print_limits limits;
+};
+
+template <class charT, class Container>
+inline std::basic_ostream<charT>&
+operator<<(std::basic_ostream<charT>& out, limited<Container> const& l)
+{
+    print_sequence<has_kv<Container>::value>(l.c, out, l.limits);
+    return out;
 }
 
 } // namespace detail
+
+// Print at most max_elems elements and max_chars characters of a container,
+// the rest is marked by "... (+K more)". Nothing is walked or copied before
+// the statement passes its level, and elements past the limit never are.
+// 0: no limit.
+//
+// e.g.
+//   lout(debug) << limit(huge_map, 10);
+//   lout(debug) << limit(lines, 0, 4096);
+template <class Container>
+detail::limited<Container> limit(Container const& c, std::size_t max_elems
+                                 , std::size_t max_chars)
+{
+    return { c, { max_elems, max_chars } };
+}
+
+// Characters are bounded by the default, @see set_container_limit.
+template <class Container>
+detail::limited<Container> limit(Container const& c, std::size_t max_elems)
+{
+    auto const& defaults = detail::default_print_limits::instance();
+    return limit(c, max_elems
+                 , defaults.max_chars.load(std::memory_order_relaxed));
+}
+
+// Bounds of containers printed without limit(), 100 elements and 64 Ki
+// characters by default. 0: no limit.
+inline void set_container_limit(std::size_t max_elems, std::size_t max_chars)
+{
+    auto& defaults = detail::default_print_limits::instance();
+    defaults.max_elems.store(max_elems, std::memory_order_relaxed);
+    defaults.max_chars.store(max_chars, std::memory_order_relaxed);
+}
+
 } // namespace tinylog
 
 #if !defined(TINYLOG_DISABLE_STL_LOGGING)
@@ -305,8 +625,8 @@ operator<<(std::basic_ostream<charT>& out, Container const& seq)
 {
     using namespace ::tinylog::detail;
 
-    print_sequence<has_kv<Container>::value>(std::begin(seq)
-                                             , std::end(seq), out);
+    print_sequence<has_kv<Container>::value>(
+        seq, out, default_print_limits::instance().get());
     return out;
 }
 
@@ -319,121 +639,357 @@ operator<<(std::basic_ostream<charT>& out, Container const& seq)
 
 namespace tinylog
 {
+namespace detail
+{
 
-template <bool hex_offset = false>
-std::string hexdump(std::string const& data)
+// Layout of a dump, rows of 16 bytes:
+//
+//   DEC OFF | 0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F |   ANSI ASCII
+//   --------------------------------------------------------------------------
+//   0000000 |42 72 61 76 6F 21 20 54 68 65 20 6A 6F 62 20 68 |Bravo! The job h
+struct hexdump_layout
+{
+    static constexpr std::size_t ascii_cnt  = 16;
+    static constexpr std::size_t off_len    = 7;    // digits at least
+    static constexpr std::size_t title_len  = 75;   // rule line alike
+    static constexpr std::size_t row_len    = off_len + 3 * ascii_cnt
+                                              + ascii_cnt + 4;
+
+    // Rows written to a stream at once.
+    static constexpr std::size_t block_rows = 16;
+};
+
+// Upper case hex digits of each byte.
+struct hex_table
+{
+    hex_table()
+    {
+        auto const digits = "0123456789ABCDEF";
+        for (std::size_t i = 0; i != 256; ++i)
+        {
+            pairs[i][0] = digits[i >> 4];
+            pairs[i][1] = digits[i & 0x0F];
+        }
+    }
+
+    static hex_table const& get()
+    {
+        static hex_table const table;
+        return table;
+    }
+
+    char pairs[256][2];
+};
+
+// Width of the offset of a row, wider than off_len once it overflows.
+inline std::size_t hexdump_offset_width(std::size_t off, bool hex_offset)
+{
+    std::size_t const base = hex_offset ? 16 : 10;
+    std::size_t width = 1;
+    for (; off >= base; off /= base)
+    {
+        ++width;
+    }
+    return width > hexdump_layout::off_len ? width : hexdump_layout::off_len;
+}
+
+// Characters of rows [first, last) of a dump of n bytes.
+inline std::size_t hexdump_rows_size(std::size_t first, std::size_t last
+                                     , bool hex_offset)
+{
+    using layout = hexdump_layout;
+
+    std::size_t size = (last - first) * layout::row_len;
+    if (first == last)
+    {
+        return size;
+    }
+
+    // Rows whose offsets have more digits than off_len.
+    std::size_t const base = hex_offset ? 16 : 10;
+    std::size_t const max_off = (last - 1) * layout::ascii_cnt;
+    std::size_t bound = 1;
+    for (std::size_t i = 0; i != layout::off_len; ++i)
+    {
+        bound *= base;
+    }
+    while (bound <= max_off)
+    {
+        auto const row = (bound + layout::ascii_cnt - 1) / layout::ascii_cnt;
+        size += last - (row > first ? row : first);
+        if (bound > max_off / base)
+        {
+            break;
+        }
+        bound *= base;
+    }
+    return size;
+}
+
+inline std::size_t hexdump_row_count(std::size_t n)
+{
+    return (n + hexdump_layout::ascii_cnt - 1) / hexdump_layout::ascii_cnt;
+}
+
+template <class charT>
+charT* put_hexdump_title(charT* out, bool hex_offset)
+{
+    static char const title[] =
+        " OFF | 0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F "
+        "|   ANSI ASCII   \n";
+
+    auto const base = hex_offset ? "HEX" : "DEC";
+    out = std::copy(base, base + 3, out);
+    out = std::copy(title, title + sizeof(title) - 1, out);
+    out = std::fill_n(out, hexdump_layout::title_len - 1, charT('-'));
+    *out++ = charT('\n');
+    return out;
+}
+
+// Row of the bytes at p, n of them are available.
+template <class charT>
+charT* put_hexdump_row(charT* out, unsigned char const* p, std::size_t n
+                       , std::size_t off, bool hex_offset)
 {
-    using namespace std;
+    using layout = hexdump_layout;
 
-    constexpr auto off_len = 8;
-    constexpr auto hex_size = 3;
-    constexpr auto ascii_cnt  = 16;
-    constexpr auto wide_len = off_len + hex_size * ascii_cnt + ascii_cnt + 2;
+    charT digits[24];
+    std::size_t const base = hex_offset ? 16 : 10;
+    auto const width = hexdump_offset_width(off, hex_offset);
+    for (std::size_t i = width; i != 0; off /= base)
+    {
+        digits[--i] = static_cast<charT>("0123456789ABCDEF"[off % base]);
+    }
+    out = std::copy(digits, digits + width, out);
+    *out++ = charT(' ');
+    *out++ = charT('|');
+
+    auto const& hex = hex_table::get().pairs;
+    for (std::size_t c = 0; c != layout::ascii_cnt; ++c)
+    {
+        auto const& h = hex[c < n ? p[c] : 0];
+        out[0] = static_cast<charT>(h[0]);
+        out[1] = static_cast<charT>(h[1]);
+        out[2] = charT(' ');
+        out += 3;
+    }
+    *out++ = charT('|');
+
+    for (std::size_t c = 0; c != layout::ascii_cnt; ++c)
+    {
+        auto const ch = c < n ? p[c] : ' ';
+        *out++ = static_cast<charT>(0x20 <= ch && ch < 0x7F ? ch : ' ');
+    }
+    *out++ = charT('\n');
+    return out;
+}
 
-    constexpr auto space_char = ' ';
-    constexpr auto sep_col = '|';
-    constexpr auto sep_row = '-';
+// Dump n bytes at data to s, written in place.
+template <class charT>
+void hexdump_to(std::basic_string<charT>& s, void const* data, std::size_t n
+                , bool hex_offset)
+{
+    using layout = hexdump_layout;
 
-    string const off(hex_offset ? "HEX OFF" : "DEC OFF");
-    string const ascii("ANSI ASCII");
+    auto const rows = hexdump_row_count(n);
+    s.resize(2 * layout::title_len
+             + hexdump_rows_size(0, rows, hex_offset));
 
-    ostringstream oss;
+    auto out = &s[0];
+    out = put_hexdump_title(out, hex_offset);
 
-    // title
-    oss << setw((off_len - off.size()) / 2 + off.size()) << off
-        << setw((off_len - off.size()) / 2) << space_char;
-    oss << sep_col;
-    for (auto i = 0; i != ascii_cnt; ++i)
+    auto const p = static_cast<unsigned char const*>(data);
+    for (std::size_t r = 0; r != rows; ++r)
     {
-        oss << setw((hex_size - 1) / 2 + 1) << hex << uppercase << i
-            << setw((hex_size - 1) / 2) << space_char;
+        auto const off = r * layout::ascii_cnt;
+        out = put_hexdump_row(out, p + off, n - off, off, hex_offset);
     }
-    oss << sep_col;
-    oss << setw((ascii_cnt - ascii.size()) / 2 + ascii.size()) << ascii
-        << setw((ascii_cnt - ascii.size()) / 2) << space_char << endl;
-    oss << string(wide_len, sep_row) << endl;
-
-    // content
-    auto const row_size = data.size() / ascii_cnt
-    + ((data.size() % ascii_cnt) ? 1 : 0);
-    for (auto r = 0u; r != row_size; ++r)
+}
+
+}  // namespace detail
+
+// Dump written to a stream block by block, rows [first, last) of it and
+// the title if asked. The whole dump is never held in memory.
+//
+// e.g.
+//   std::cout << hexdump_view(buf, len);
+class hexdump_view
+{
+public:
+    explicit hexdump_view(void const* data, std::size_t size
+                          , bool hex_offset = false)
+        : hexdump_view(data, size, hex_offset, true
+                       , 0, detail::hexdump_row_count(size))
+    {}
+
+    explicit hexdump_view(void const* data, std::size_t size
+                          , bool hex_offset, bool title
+                          , std::size_t first, std::size_t last)
+        : data_(static_cast<unsigned char const*>(data)), size_(size)
+        , hex_offset_(hex_offset), title_(title), first_(first), last_(last)
+    {}
+
+    template <class charT>
+    void write(std::basic_ostream<charT>& out) const
     {
-        auto const row_idx = r * ascii_cnt;
-        oss << string((off_len - 9 > 0 ? off_len - 9 : 0), space_char)
-            << setw(7) << setfill('0')
-            << (hex_offset ? hex : dec) << uppercase << r * ascii_cnt
-            << space_char;
-
-        oss << sep_col;
-        for (auto c = 0; c != ascii_cnt; ++c)
+        using layout = detail::hexdump_layout;
+
+        // Offsets have 20 digits at most.
+        charT buf[layout::block_rows * (layout::row_len + 16)];
+        if (title_)
         {
-            auto const idx = row_idx + c;
-            auto const ch = data.size() > idx ? data[idx] : '\0';
-            oss << setw(hex_size - 1) << hex << uppercase
-                << (static_cast<unsigned>(ch) & 0xFF) << space_char;
+            auto const end = detail::put_hexdump_title(buf, hex_offset_);
+            out.write(buf, end - buf);
         }
-        oss << sep_col;
 
-        for (auto c = 0; c != ascii_cnt; ++c)
+        for (auto r = first_; r < last_;)
         {
-            auto const idx = row_idx + c;
-            auto const ch = data.size() > idx ? data[idx] : space_char;
-            oss << (isprint(ch) ? ch : space_char);
+            auto end = buf;
+            for (std::size_t i = 0; i != layout::block_rows && r < last_
+                 ; ++i, ++r)
+            {
+                auto const off = r * layout::ascii_cnt;
+                end = detail::put_hexdump_row(end, data_ + off, size_ - off
+                                              , off, hex_offset_);
+            }
+            out.write(buf, end - buf);
         }
-        oss << endl;
     }
-    return oss.str();
+
+private:
+    unsigned char const* data_;
+    std::size_t size_;
+    bool hex_offset_;
+    bool title_;
+    std::size_t first_;
+    std::size_t last_;
+};
+
+template <class charT>
+std::basic_ostream<charT>& operator<<(std::basic_ostream<charT>& out
+                                      , hexdump_view const& v)
+{
+    v.write(out);
+    return out;
 }
 
+// Dump split into views of some rows each, logged one record a view.
+//
+// @see dlhexdump
+class hexdump_chunks
+{
+public:
+    explicit hexdump_chunks(void const* data, std::size_t size
+                            , bool hex_offset = false
+                            , std::size_t chunk_rows = 256)
+        : data_(data), size_(size), hex_offset_(hex_offset)
+        , chunk_rows_(chunk_rows ? chunk_rows : 1)
+        , rows_(detail::hexdump_row_count(size))
+    {}
+
+    // Move to the next chunk, false if there is none.
+    bool next()
+    {
+        if (started_)
+        {
+            first_ += chunk_rows_;
+        }
+        else
+        {
+            started_ = true;
+        }
+        return first_ == 0 || first_ < rows_;
+    }
+
+    hexdump_view chunk() const
+    {
+        auto const last = rows_ - first_ > chunk_rows_
+                          ? first_ + chunk_rows_ : rows_;
+        return hexdump_view(data_, size_, hex_offset_, first_ == 0
+                            , first_, last);
+    }
+
+private:
+    void const* data_;
+    std::size_t size_;
+    bool hex_offset_;
+    std::size_t chunk_rows_;
+    std::size_t rows_;
+    std::size_t first_ = 0;
+    bool started_ = false;
+};
+
 template <bool hex_offset = false>
 inline std::string hexdump(char const* s, size_t n)
 {
-    return hexdump<hex_offset>(std::string(s, s + n));
+    std::string text;
+    detail::hexdump_to(text, s, n, hex_offset);
+    return text;
 }
 
 template <bool hex_offset = false>
-inline std::string hexdump(std::wstring const& s)
+inline std::string hexdump(std::string const& data)
 {
-    char const* const p = (char const*)s.c_str();
-    size_t const n = s.size() * sizeof(std::wstring::value_type);
-    return hexdump<hex_offset>(p, n);
+    return hexdump<hex_offset>(data.data(), data.size());
 }
 
 template <bool hex_offset = false>
 inline std::string hexdump(wchar_t const* s, size_t n)
 {
-    return hexdump<hex_offset>(std::wstring(s, s + n));
+    return hexdump<hex_offset>(reinterpret_cast<char const*>(s)
+                               , n * sizeof(wchar_t));
 }
 
 template <bool hex_offset = false>
-inline std::wstring whexdump(std::string const& s)
+inline std::string hexdump(std::wstring const& s)
 {
-    auto buf = hexdump<hex_offset>(s);
-    std::wstring ws;
-    string_traits<u8string>::convert(ws, buf);
-    return ws;
+    return hexdump<hex_offset>(s.data(), s.size());
 }
 
 template <bool hex_offset = false>
 inline std::wstring whexdump(char const* s, size_t n)
 {
-    return whexdump<hex_offset>(std::string(s, s + n));
+    std::wstring text;
+    detail::hexdump_to(text, s, n, hex_offset);
+    return text;
 }
 
 template <bool hex_offset = false>
-inline std::wstring whexdump(std::wstring const& s)
+inline std::wstring whexdump(std::string const& s)
 {
-    char const* const p = (char const*)s.c_str();
-    size_t const n = s.size() * sizeof(std::wstring::value_type);
-    return whexdump<hex_offset>(p, n);
+    return whexdump<hex_offset>(s.data(), s.size());
 }
 
 template <bool hex_offset = false>
 inline std::wstring whexdump(wchar_t const* s, size_t n)
 {
-    return whexdump<hex_offset>(std::wstring(s, s + n));
+    return whexdump<hex_offset>(reinterpret_cast<char const*>(s)
+                                , n * sizeof(wchar_t));
+}
+
+template <bool hex_offset = false>
+inline std::wstring whexdump(std::wstring const& s)
+{
+    return whexdump<hex_offset>(s.data(), s.size());
 }
 
 }  // namespace tinylog
 
+// Log a dump as records of 256 rows (4 KiB) each, the first one with the
+// title, instead of one record holding the whole dump.
+//
+// dlhexdump("logger_name", debug, buf, len);
+#define dlhexdump(ln, lvl, data, size)                                  \
+    for (::tinylog::hexdump_chunks _tl_hex_((data), (size))             \
+         ; _tl_hex_.next(); ) dlout((ln), (lvl)) << _tl_hex_.chunk()
+#define wdlhexdump(ln, lvl, data, size)                                 \
+    for (::tinylog::hexdump_chunks _tl_hex_((data), (size))             \
+         ; _tl_hex_.next(); ) wdlout((ln), (lvl)) << _tl_hex_.chunk()
+
+// lhexdump(debug, buf, len);
+#define lhexdump(lvl, data, size)   dlhexdump(TINYLOG_DEFAULT_NAME      \
+                                              , (lvl), (data), (size))
+#define wlhexdump(lvl, data, size)  wdlhexdump(TINYLOG_DEFAULT_NAMEW    \
+                                               , (lvl), (data), (size))
+
 #endif  // TINYTINYLOG_EXTRA_HPP
@@ -0,0 +1,1214 @@
+/* Sinks sending records to a log collector over the network.
+ *
+ * ```.cpp
+ *
+ * using namespace tinylog;
+ *
+ * int main()
+ * {
+ *     auto inst = registry::create_logger("net");
+ *
+ *     // RFC 5424 syslog over UDP.
+ *     set_syslog_identity("myapp", syslog_facility::local0);
+ *     inst->create_sink<sink::udp_sink>("127.0.0.1", 514);
+ *
+ *     // Length-prefixed JSON lines over TCP.
+ *     inst->create_sink<sink::basic_tcp_sink<json_layout>>("collector"
+ *                                                          , 5170);
+ * }
+ *
+ * ```
+ *
+ * @attention On Windows, include this header before 'tinylog.hpp' or define
+ *            WIN32_LEAN_AND_MEAN, winsock2.h conflicts with the winsock.h
+ *            Windows.h brings in otherwise. Link ws2_32.
+ */
+
+/*****************************************************************************/
+/* User Customize:
+ *
+ *   *** Tinylog basic setting see 'tinylog.hpp' ***
+ */
+
+// Messages a UDP sink hands to the kernel per system call (Linux only,
+// one send per message elsewhere).
+
+#if !defined(TINYLOG_NET_SEND_BATCH)
+#   define TINYLOG_NET_SEND_BATCH 64
+#endif
+
+
+// --- User Customize End ---
+
+#ifndef TINYTINYLOG_NET_HPP
+#define TINYTINYLOG_NET_HPP
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+#   include <winsock2.h>
+#   include <ws2tcpip.h>
+#   pragma comment(lib, "ws2_32.lib")
+#else
+#   include <errno.h>
+#   include <fcntl.h>
+#   include <netdb.h>
+#   include <poll.h>
+#   include <unistd.h>
+#   include <netinet/in.h>
+#   include <sys/socket.h>
+#   include <sys/types.h>
+#   include <sys/uio.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tinylog.hpp"
+
+namespace tinylog
+{
+
+/*****************************************************************************/
+/* Syslog Layout: RFC 5424 messages. */
+
+enum class syslog_facility : std::uint8_t
+{
+    kern = 0, user, mail, daemon, auth, syslog, lpr, news, uucp, cron
+    , authpriv, ftp
+    , local0 = 16, local1, local2, local3, local4, local5, local6, local7
+};
+
+namespace detail
+{
+
+// HOSTNAME, APP-NAME and PROCID of the syslog header, shared by all
+// records of the process.
+class syslog_identity
+{
+public:
+    static syslog_identity& instance()
+    {
+        static syslog_identity id;
+        return id;
+    }
+
+    void assign(std::string const& app_name, syslog_facility facility)
+    {
+        app_name_ = header_field(app_name, 48);
+        facility_ = facility;
+    }
+
+    char const* hostname() const
+    {
+        return hostname_.c_str();
+    }
+
+    char const* app_name() const
+    {
+        return app_name_.c_str();
+    }
+
+    char const* procid() const
+    {
+        return procid_.c_str();
+    }
+
+    syslog_facility facility() const
+    {
+        return facility_;
+    }
+
+private:
+    syslog_identity()
+    {
+        char name[256] = {};
+#if defined(TINYLOG_WINDOWS_API)
+        DWORD size = sizeof(name);
+        if (!::GetComputerNameA(name, &size))
+        {
+            name[0] = '\0';
+        }
+        procid_ = std::to_string(::GetCurrentProcessId());
+#else
+        if (::gethostname(name, sizeof(name) - 1) != 0)
+        {
+            name[0] = '\0';
+        }
+        procid_ = std::to_string(::getpid());
+#endif // TINYLOG_WINDOWS_API
+        hostname_ = header_field(name, 255);
+        app_name_ = header_field(program_name(), 48);
+    }
+
+    static std::string program_name()
+    {
+#if defined(TINYLOG_WINDOWS_API)
+        char path[MAX_PATH] = {};
+        ::GetModuleFileNameA(nullptr, path, MAX_PATH);
+        std::string name(path);
+        auto const slash = name.find_last_of("\\/");
+        if (slash != std::string::npos)
+        {
+            name.erase(0, slash + 1);
+        }
+        auto const dot = name.rfind('.');
+        return dot != std::string::npos ? name.substr(0, dot) : name;
+#elif defined(__GLIBC__)
+        return program_invocation_short_name;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) \
+      || defined(__OpenBSD__)
+        return ::getprogname();
+#else
+        return std::string();
+#endif // TINYLOG_WINDOWS_API
+    }
+
+    // Printable ASCII without spaces, "-" if empty.
+    static std::string header_field(std::string s, std::size_t max_size)
+    {
+        if (s.size() > max_size)
+        {
+            s.resize(max_size);
+        }
+        for (auto& c : s)
+        {
+            if (c < '!' || c > '~')
+            {
+                c = '_';
+            }
+        }
+        return s.empty() ? std::string("-") : s;
+    }
+
+private:
+    std::string hostname_;
+    std::string app_name_;
+    std::string procid_;
+    syslog_facility facility_ = syslog_facility::user;
+};
+
+inline unsigned syslog_severity(level lvl)
+{
+    switch (lvl)
+    {
+    case level::trace:
+    case level::debug:
+        return 7;
+    case level::info:
+        return 6;
+    case level::warn:
+        return 4;
+    case level::error:
+        return 3;
+    case level::fatal:
+        return 2;
+    default:
+        return 5;
+    }
+}
+
+// YYYY-MM-DDTHH:MM:SS.uuuuuuZ, gmtime is called once a second per thread.
+template <class bufferT>
+void write_utc_time(bufferT& buf, time_value const& tv)
+{
+    using char_type = typename bufferT::char_type;
+
+    struct cache
+    {
+        std::time_t sec = 0;
+        bool valid      = false;
+        char_type text[20];
+    };
+    static thread_local cache c;
+
+    auto const sec = static_cast<std::time_t>(tv.tv_sec);
+    if (!c.valid || c.sec != sec)
+    {
+        struct tm ti;
+#if defined(TINYLOG_WINDOWS_API)
+        ::gmtime_s(&ti, &sec);
+#else
+        ::gmtime_r(&sec, &ti);
+#endif // TINYLOG_WINDOWS_API
+
+        basic_memory_buffer<char_type, 32> text;
+        write_uint(text, static_cast<unsigned>(ti.tm_year + 1900), 4);
+        text.push_back(char_type('-'));
+        write_uint(text, static_cast<unsigned>(ti.tm_mon + 1), 2);
+        text.push_back(char_type('-'));
+        write_uint(text, static_cast<unsigned>(ti.tm_mday), 2);
+        text.push_back(char_type('T'));
+        write_uint(text, static_cast<unsigned>(ti.tm_hour), 2);
+        text.push_back(char_type(':'));
+        write_uint(text, static_cast<unsigned>(ti.tm_min), 2);
+        text.push_back(char_type(':'));
+        write_uint(text, static_cast<unsigned>(ti.tm_sec), 2);
+        text.push_back(char_type('.'));
+        std::copy(text.data(), text.data() + (std::min)(text.size()
+                                                        , sizeof(c.text)
+                                                          / sizeof(c.text[0]))
+                  , c.text);
+        c.sec   = sec;
+        c.valid = true;
+    }
+    buf.append(c.text, sizeof(c.text) / sizeof(c.text[0]));
+    write_uint(buf, tv.tv_usec, 6);
+    buf.push_back(char_type('Z'));
+}
+
+// PARAM-VALUE body: quote, backslash and ']' are escaped.
+template <class bufferT, class charT>
+void write_sd_value(bufferT& buf, charT const* s, std::size_t n)
+{
+    for (std::size_t i = 0; i != n; ++i)
+    {
+        if (s[i] == charT('"') || s[i] == charT('\\') || s[i] == charT(']'))
+        {
+            buf.push_back(charT('\\'));
+        }
+        buf.push_back(s[i]);
+    }
+}
+
+// PARAM-NAME: 1 to 32 printable US-ASCII characters but '=', space, ']'
+// and quote, others are written as '_' and longer names truncated.
+template <class bufferT, class charT>
+void write_sd_name(bufferT& buf, charT const* s, std::size_t n)
+{
+    static constexpr std::size_t max_name = 32;
+
+    if (n == 0)
+    {
+        buf.push_back(charT('_'));
+        return ;
+    }
+    n = (std::min)(n, max_name);
+    for (std::size_t i = 0; i != n; ++i)
+    {
+        auto const c = s[i];
+        auto const ok = c > charT(0x20) && c < charT(0x7f) && c != charT('=')
+                        && c != charT(']') && c != charT('"');
+        buf.push_back(ok ? c : charT('_'));
+    }
+}
+
+// <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - [fields@32473 k="v"] MSG
+template <class charT>
+struct syslog_constructor
+{
+    using char_type  = charT;
+    using string_t   = std::basic_string<char_type>;
+    using buffer_t   = basic_memory_buffer<char_type>;
+    using record     = basic_record<char_type>;
+    using record_d   = basic_record_d<char_type>;
+
+    static void construct(string_t& s, record const& r
+                          , string_t& /*cache*/, bool /*verbose*/)
+    {
+        buffer_t buf;
+        record_header(buf, r);
+        if (r.fields.empty())
+        {
+            buf.push_back(char_type('-'));
+        }
+        else
+        {
+            write_ascii(buf, "[fields@32473");
+            record_fields(buf, r);
+            buf.push_back(char_type(']'));
+        }
+        record_message(buf, r);
+        s.assign(buf.data(), buf.size());
+    }
+
+    static void construct(string_t& s, record_d const& r
+                          , string_t& cache, bool verbose)
+    {
+        if (!verbose)
+        {
+            construct(s, static_cast<record const&>(r), cache, verbose);
+            return ;
+        }
+
+        auto const file = r.file_name();
+        auto const& func = r.func_name();
+
+        buffer_t buf;
+        record_header(buf, r);
+        write_ascii(buf, "[fields@32473 file=\"");
+        write_sd_value(buf, file, std::char_traits<char_type>::length(file));
+        write_ascii(buf, "\" line=\"");
+        write_uint(buf, r.line_number());
+        write_ascii(buf, "\" func=\"");
+        write_sd_value(buf, func.data(), func.size());
+        buf.push_back(char_type('"'));
+        record_fields(buf, r);
+        buf.push_back(char_type(']'));
+        record_message(buf, r);
+        s.assign(buf.data(), buf.size());
+    }
+
+private:
+    static void record_header(buffer_t& buf, record const& r)
+    {
+        auto const& id = syslog_identity::instance();
+        auto const facility = static_cast<unsigned>(id.facility());
+
+        buf.push_back(char_type('<'));
+        write_uint(buf, facility * 8 + syslog_severity(r.lvl));
+        write_ascii(buf, ">1 ");
+        if (has_time(r.tv))
+        {
+            write_utc_time(buf, r.tv);
+        }
+        else
+        {
+            buf.push_back(char_type('-'));
+        }
+        buf.push_back(char_type(' '));
+        write_ascii(buf, id.hostname());
+        buf.push_back(char_type(' '));
+        write_ascii(buf, id.app_name());
+        buf.push_back(char_type(' '));
+        write_ascii(buf, id.procid());
+        write_ascii(buf, " - ");
+    }
+
+    static void record_fields(buffer_t& buf, record const& r)
+    {
+        auto const& fields = r.fields;
+        for (auto const& f : fields)
+        {
+            buf.push_back(char_type(' '));
+            write_sd_name(buf, fields.key(f), f.key_size);
+            buf.push_back(char_type('='));
+            buf.push_back(char_type('"'));
+            if (f.kind == fmt_kind::string)
+            {
+                write_sd_value(buf, fields.text(f), f.text_size);
+            }
+            else
+            {
+                write_number<buffer_t, char_type>(buf, f);
+            }
+            buf.push_back(char_type('"'));
+        }
+    }
+
+    static void record_message(buffer_t& buf, record const& r)
+    {
+        auto const n = message_size(r);
+        if (n != 0)
+        {
+            buf.push_back(char_type(' '));
+            buf.append(r.message.data(), n);
+        }
+    }
+};
+
+}  // namespace detail
+
+// Name the process in syslog headers, call before logging starts.
+// Hostname and process id are looked up once, the app name defaults to
+// the program name.
+inline void set_syslog_identity(std::string const& app_name
+                                , syslog_facility facility
+                                = syslog_facility::user)
+{
+    detail::syslog_identity::instance().assign(app_name, facility);
+}
+
+// RFC 5424 message, kv fields (and location when verbose) go to the
+// structured data, no line feed at the end.
+//
+// <14>1 2018-05-20T02:30:01.000123Z host app 1234 - [fields@32473 user="42"]
+// login
+struct syslog_layout
+{
+    template <class stringT, class recordT>
+    static void to_string(stringT& s, recordT const& r
+                          , stringT& cache, bool verbose)
+    {
+        using char_type = typename stringT::value_type;
+        detail::syslog_constructor<char_type>::construct(s, r, cache
+                                                         , verbose);
+    }
+};
+
+template <>
+struct is_stateless_layout<syslog_layout> : public std::true_type
+{
+};
+
+/*****************************************************************************/
+/* Net Sink: Records sent by a background I/O thread. */
+
+namespace sink
+{
+
+// How a stream sink marks where a message ends.
+enum class tcp_framing : std::uint8_t
+{
+    octet_counting,     // "LEN " before each message, RFC 6587
+    u32_big_endian,     // 4 bytes length before each message
+};
+
+struct net_policy
+{
+    // Bytes of messages waiting while the collector is slow or unreachable,
+    // messages beyond are dropped and counted.
+    std::size_t max_backlog = 4 * 1024 * 1024;
+
+    // Longer messages are truncated to fit a datagram (UDP).
+    std::size_t max_datagram = 8 * 1024;
+
+    tcp_framing framing = tcp_framing::octet_counting;
+
+    // Wait this long for connecting or for the socket to take more data.
+    std::chrono::milliseconds io_timeout = std::chrono::milliseconds(3000);
+
+    // Delay of retrying after a failed send or connect, doubled on each
+    // failure in a row up to max_backoff.
+    std::chrono::milliseconds min_backoff = std::chrono::milliseconds(100);
+    std::chrono::milliseconds max_backoff = std::chrono::milliseconds(30000);
+
+    // flush() waits this long at most for the backlog to be sent.
+    std::chrono::milliseconds flush_timeout = std::chrono::milliseconds(1000);
+};
+
+}  // namespace sink
+
+namespace detail
+{
+
+#if defined(TINYLOG_WINDOWS_API)
+using socket_t = SOCKET;
+
+inline socket_t invalid_socket()
+{
+    return INVALID_SOCKET;
+}
+
+inline int socket_error()
+{
+    return ::WSAGetLastError();
+}
+
+inline bool would_block(int err)
+{
+    return err == WSAEWOULDBLOCK || err == WSAEINPROGRESS;
+}
+
+// Errors of earlier datagrams or signals, the send may be retried.
+inline bool is_transient(int err)
+{
+    return err == WSAECONNRESET || err == WSAEINTR;
+}
+#else
+using socket_t = int;
+
+inline socket_t invalid_socket()
+{
+    return -1;
+}
+
+inline int socket_error()
+{
+    return errno;
+}
+
+inline bool would_block(int err)
+{
+    return err == EAGAIN || err == EWOULDBLOCK || err == EINPROGRESS;
+}
+
+// Errors of earlier datagrams or signals, the send may be retried.
+inline bool is_transient(int err)
+{
+    return err == ECONNREFUSED || err == EINTR;
+}
+#endif // TINYLOG_WINDOWS_API
+
+inline void socket_startup()
+{
+#if defined(TINYLOG_WINDOWS_API)
+    struct winsock
+    {
+        winsock()
+        {
+            WSADATA data;
+            ::WSAStartup(MAKEWORD(2, 2), &data);
+        }
+        ~winsock()
+        {
+            ::WSACleanup();
+        }
+    };
+    static winsock ws;
+#endif // TINYLOG_WINDOWS_API
+}
+
+// Non-blocking socket connected to a collector.
+class net_socket
+{
+public:
+    net_socket() = default;
+    net_socket(net_socket const&) = delete;
+    net_socket& operator=(net_socket const&) = delete;
+
+    ~net_socket()
+    {
+        close();
+    }
+
+    bool is_open() const
+    {
+        return fd_ != invalid_socket();
+    }
+
+    socket_t get() const
+    {
+        return fd_;
+    }
+
+    // Resolve host and connect, waits up to timeout for a stream socket.
+    bool connect(std::string const& host, std::uint16_t port, int type
+                 , std::chrono::milliseconds timeout)
+    {
+        close();
+        socket_startup();
+
+        addrinfo hints = {};
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = type;
+        addrinfo* res = nullptr;
+        auto const service = std::to_string(port);
+        if (::getaddrinfo(host.c_str(), service.c_str(), &hints, &res) != 0)
+        {
+            return false;
+        }
+
+        for (auto ai = res; ai && !is_open(); ai = ai->ai_next)
+        {
+            if (open(*ai) && !connect(*ai, timeout))
+            {
+                close();
+            }
+        }
+        ::freeaddrinfo(res);
+        return is_open();
+    }
+
+    void close()
+    {
+        if (!is_open())
+        {
+            return ;
+        }
+#if defined(TINYLOG_WINDOWS_API)
+        ::closesocket(fd_);
+#else
+        ::close(fd_);
+#endif // TINYLOG_WINDOWS_API
+        fd_ = invalid_socket();
+    }
+
+    // Wait until the socket takes more data, false on timeout or error.
+    bool wait_writable(std::chrono::milliseconds timeout)
+    {
+#if defined(TINYLOG_WINDOWS_API)
+        WSAPOLLFD pfd = {};
+        pfd.fd = fd_;
+        pfd.events = POLLOUT;
+        auto const rc = ::WSAPoll(&pfd, 1, static_cast<int>(timeout.count()));
+#else
+        pollfd pfd = {};
+        pfd.fd = fd_;
+        pfd.events = POLLOUT;
+        int rc = 0;
+        do
+        {
+            rc = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+        } while (rc < 0 && errno == EINTR);
+#endif // TINYLOG_WINDOWS_API
+        return rc > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) == 0;
+    }
+
+private:
+    bool open(addrinfo const& ai)
+    {
+        fd_ = ::socket(ai.ai_family, ai.ai_socktype, ai.ai_protocol);
+        if (!is_open())
+        {
+            return false;
+        }
+
+#if defined(TINYLOG_WINDOWS_API)
+        u_long on = 1;
+        auto const ok = ::ioctlsocket(fd_, FIONBIO, &on) == 0;
+#else
+        auto const flags = ::fcntl(fd_, F_GETFL, 0);
+        auto const ok = flags >= 0
+                        && ::fcntl(fd_, F_SETFL, flags | O_NONBLOCK) == 0
+                        && ::fcntl(fd_, F_SETFD, FD_CLOEXEC) == 0;
+#   if defined(SO_NOSIGPIPE)
+        int one = 1;
+        ::setsockopt(fd_, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#   endif
+#endif // TINYLOG_WINDOWS_API
+        if (!ok)
+        {
+            close();
+        }
+        return ok;
+    }
+
+    bool connect(addrinfo const& ai, std::chrono::milliseconds timeout)
+    {
+        if (::connect(fd_, ai.ai_addr
+                      , static_cast<socklen_t>(ai.ai_addrlen)) == 0)
+        {
+            return true;
+        }
+        if (!would_block(socket_error()) || !wait_writable(timeout))
+        {
+            return false;
+        }
+
+        int err = 0;
+        socklen_t size = sizeof(err);
+        ::getsockopt(fd_, SOL_SOCKET, SO_ERROR
+                     , reinterpret_cast<char*>(&err), &size);
+        return err == 0;
+    }
+
+private:
+    socket_t fd_ = invalid_socket();
+};
+
+// Messages stored back to back, with the end offset of each.
+struct net_batch
+{
+    std::string bytes;
+    std::vector<std::size_t> ends;
+
+    std::size_t size() const
+    {
+        return ends.size();
+    }
+
+    bool empty() const
+    {
+        return ends.empty();
+    }
+
+    char const* data(std::size_t i) const
+    {
+        return bytes.data() + (i ? ends[i - 1] : 0);
+    }
+
+    std::size_t length(std::size_t i) const
+    {
+        return ends[i] - (i ? ends[i - 1] : 0);
+    }
+
+    void clear()
+    {
+        bytes.clear();
+        ends.clear();
+    }
+};
+
+// Messages waiting for the I/O thread, bounded in bytes. The thread takes
+// all of them at once by swapping batches, both keep their capacity.
+class net_backlog
+{
+public:
+    explicit net_backlog(std::size_t max_bytes)
+        : max_bytes_(max_bytes)
+    {
+    }
+
+    // false if the backlog is full and the message dropped.
+    bool push(char const* s, std::size_t n)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (pending_.bytes.size() + n > max_bytes_)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            pending_.bytes.append(s, n);
+            pending_.ends.push_back(pending_.bytes.size());
+            ++pushed_;
+            if (pending_.size() != 1)
+            {
+                return true;
+            }
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    // Wait up to timeout for messages and take all of them.
+    bool take(net_batch& batch, std::chrono::milliseconds timeout)
+    {
+        batch.clear();
+        std::unique_lock<std::mutex> lock(mtx_);
+        cv_.wait_for(lock, timeout, [this]()
+                     {
+                         return stop_ || !pending_.empty();
+                     });
+        std::swap(batch.bytes, pending_.bytes);
+        std::swap(batch.ends, pending_.ends);
+        return !batch.empty();
+    }
+
+    // n messages taken are sent, failed ones of them are counted dropped.
+    void handled(std::size_t n, std::size_t failed = 0)
+    {
+        if (n == 0)
+        {
+            return ;
+        }
+        dropped_.fetch_add(failed, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            handled_ += n;
+        }
+        done_cv_.notify_all();
+    }
+
+    // Wait until messages pushed before are handled.
+    bool wait_handled(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto const target = pushed_;
+        return done_cv_.wait_for(lock, timeout, [this, target]()
+                                 {
+                                     return handled_ >= target;
+                                 });
+    }
+
+    // Sleep for delay unless stopped.
+    void sleep(std::chrono::milliseconds delay)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cv_.wait_for(lock, delay, [this]() { return stop_; });
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    bool stopped()
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return stop_;
+    }
+
+    std::uint64_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::condition_variable done_cv_;
+    net_batch pending_;
+    std::size_t max_bytes_;
+    std::uint64_t pushed_  = 0;
+    std::uint64_t handled_ = 0;
+    bool stop_ = false;
+    std::atomic<std::uint64_t> dropped_{ 0 };
+};
+
+// One datagram per message, sendmmsg hands many of them to the kernel at
+// once on Linux.
+class udp_transport
+{
+public:
+    udp_transport(std::string host, std::uint16_t port
+                  , sink::net_policy const& policy)
+        : host_(std::move(host)), port_(port), policy_(policy)
+    {
+    }
+
+    // Send messages of batch from first on, returns how many are handled,
+    // the failed ones among them are added to failed.
+    std::size_t send(net_batch const& batch, std::size_t first
+                     , std::size_t& failed)
+    {
+        if (!sock_.is_open()
+            && !sock_.connect(host_, port_, SOCK_DGRAM, policy_.io_timeout))
+        {
+            return 0;
+        }
+
+        auto i = first;
+        while (i != batch.size())
+        {
+            auto const sent = send_some(batch, i);
+            if (sent > 0)
+            {
+                i += static_cast<std::size_t>(sent);
+                continue;
+            }
+
+            auto const err = socket_error();
+            if (would_block(err))
+            {
+                if (!sock_.wait_writable(policy_.io_timeout))
+                {
+                    break;
+                }
+            }
+            else if (!is_transient(err))
+            {
+                ++failed;
+                ++i;
+            }
+        }
+        return i - first;
+    }
+
+    // Forget a batch given up.
+    void reset()
+    {
+    }
+
+private:
+    // Messages sent from i on, <= 0 on error.
+    long send_some(net_batch const& batch, std::size_t i)
+    {
+#if defined(__linux__)
+        constexpr std::size_t max_count = TINYLOG_NET_SEND_BATCH;
+        mmsghdr msgs[max_count];
+        iovec iov[max_count];
+
+        auto const count = (std::min)(max_count, batch.size() - i);
+        for (std::size_t k = 0; k != count; ++k)
+        {
+            iov[k].iov_base = const_cast<char*>(batch.data(i + k));
+            iov[k].iov_len  = datagram_size(batch, i + k);
+            std::memset(&msgs[k], 0, sizeof(msgs[k]));
+            msgs[k].msg_hdr.msg_iov    = &iov[k];
+            msgs[k].msg_hdr.msg_iovlen = 1;
+        }
+        return ::sendmmsg(sock_.get(), msgs, static_cast<unsigned>(count), 0);
+#else
+        auto const rc = ::send(sock_.get(), batch.data(i)
+                               , static_cast<int>(datagram_size(batch, i)), 0);
+        return rc < 0 ? -1 : 1;
+#endif // __linux__
+    }
+
+    std::size_t datagram_size(net_batch const& batch, std::size_t i) const
+    {
+        return (std::min)(batch.length(i), policy_.max_datagram);
+    }
+
+private:
+    std::string host_;
+    std::uint16_t port_;
+    sink::net_policy policy_;
+    net_socket sock_;
+};
+
+// Framed messages of a batch written to a stream by as few sends as the
+// socket takes. A frame cut by a broken connection is sent again whole
+// after reconnecting.
+class tcp_transport
+{
+public:
+    tcp_transport(std::string host, std::uint16_t port
+                  , sink::net_policy const& policy)
+        : host_(std::move(host)), port_(port), policy_(policy)
+    {
+    }
+
+    // Send messages of batch from first on, returns how many are handled.
+    std::size_t send(net_batch const& batch, std::size_t first
+                     , std::size_t& /*failed*/)
+    {
+        if (out_.empty())
+        {
+            frame(batch, first);
+        }
+        if (!sock_.is_open()
+            && !sock_.connect(host_, port_, SOCK_STREAM, policy_.io_timeout))
+        {
+            return 0;
+        }
+
+        std::size_t done = 0;
+        while (pos_ != out_.size())
+        {
+            auto const rc = send_some();
+            if (rc > 0)
+            {
+                pos_ += static_cast<std::size_t>(rc);
+                for (; next_ != ends_.size() && ends_[next_] <= pos_; ++next_)
+                {
+                    ++done;
+                }
+                continue;
+            }
+
+            auto const err = socket_error();
+            if (rc < 0 && (is_interrupted(err)
+                           || (would_block(err)
+                               && sock_.wait_writable(policy_.io_timeout))))
+            {
+                continue;
+            }
+            if (rc < 0 && would_block(err))
+            {
+                // Stalled, keep the connection and try again later.
+                return done;
+            }
+
+            sock_.close();
+            pos_ = next_ ? ends_[next_ - 1] : 0;
+            return done;
+        }
+
+        reset();
+        return done;
+    }
+
+    // Forget a batch given up.
+    void reset()
+    {
+        out_.clear();
+        ends_.clear();
+        pos_  = 0;
+        next_ = 0;
+    }
+
+private:
+    void frame(net_batch const& batch, std::size_t first)
+    {
+        for (auto i = first; i != batch.size(); ++i)
+        {
+            auto const n = batch.length(i);
+            if (policy_.framing == sink::tcp_framing::octet_counting)
+            {
+                out_.append(std::to_string(n));
+                out_.push_back(' ');
+            }
+            else
+            {
+                auto const u = static_cast<std::uint32_t>(n);
+                out_.push_back(static_cast<char>(u >> 24));
+                out_.push_back(static_cast<char>(u >> 16));
+                out_.push_back(static_cast<char>(u >> 8));
+                out_.push_back(static_cast<char>(u));
+            }
+            out_.append(batch.data(i), n);
+            ends_.push_back(out_.size());
+        }
+    }
+
+    long send_some()
+    {
+        auto const p = out_.data() + pos_;
+        auto const n = out_.size() - pos_;
+#if defined(TINYLOG_WINDOWS_API)
+        return ::send(sock_.get(), p, static_cast<int>((std::min)(
+                          n, static_cast<std::size_t>(INT_MAX))), 0);
+#elif defined(MSG_NOSIGNAL)
+        return static_cast<long>(::send(sock_.get(), p, n, MSG_NOSIGNAL));
+#else
+        return static_cast<long>(::send(sock_.get(), p, n, 0));
+#endif // TINYLOG_WINDOWS_API
+    }
+
+    static bool is_interrupted(int err)
+    {
+#if defined(TINYLOG_WINDOWS_API)
+        return err == WSAEINTR;
+#else
+        return err == EINTR;
+#endif // TINYLOG_WINDOWS_API
+    }
+
+private:
+    std::string host_;
+    std::uint16_t port_;
+    sink::net_policy policy_;
+    net_socket sock_;
+
+    std::string out_;
+    std::vector<std::size_t> ends_;
+    std::size_t pos_  = 0;
+    std::size_t next_ = 0;
+};
+
+}  // namespace detail
+
+namespace sink
+{
+
+// Send records to a collector from a background I/O thread, writing only
+// appends the message to a bounded backlog. The thread takes everything
+// pending at once and sends it in batches, backing off while the collector
+// is unreachable. Messages not fitting the backlog are dropped and counted
+// by dropped(), a trailing line feed is stripped.
+//
+// Use through basic_udp_sink and basic_tcp_sink, char records only.
+//
+// e.g.
+//   sink::net_policy policy;
+//   policy.framing = sink::tcp_framing::u32_big_endian;
+//   inst->create_sink<sink::basic_tcp_sink<json_layout>>("10.0.0.1", 5170
+//                                                        , policy);
+//
+// @attention Messages still pending when the sink is destroyed are given
+//            one more try, then dropped.
+template <class transportT, class layoutT, class mutexT, class formatterT>
+class basic_net_sink
+    : public basic_sink<char, layoutT, mutexT, formatterT>
+{
+public:
+    using base      = basic_sink<char, layoutT, mutexT, formatterT>;
+    using char_type = typename base::char_type;
+    using string_t  = typename base::string_t;
+
+public:
+    basic_net_sink(std::string const& host, std::uint16_t port
+                   , net_policy const& policy = net_policy())
+        : policy_(policy), backlog_(policy.max_backlog)
+        , transport_(host, port, policy)
+    {
+        sender_ = std::thread([this]() { run(); });
+    }
+
+    ~basic_net_sink()
+    {
+        backlog_.stop();
+        if (sender_.joinable())
+        {
+            sender_.join();
+        }
+    }
+
+    // Messages are kept while the collector is unreachable.
+    bool is_open() const override final
+    {
+        return true;
+    }
+
+    // Messages dropped for a full backlog or failed sends.
+    std::uint64_t dropped() const
+    {
+        return backlog_.dropped();
+    }
+
+protected:
+    void writing(level /*lvl*/, string_t& msg) override final
+    {
+        auto n = msg.size();
+        if (n != 0 && msg[n - 1] == '\n')
+        {
+            --n;
+        }
+        backlog_.push(msg.data(), n);
+    }
+
+    void flushing() override final
+    {
+        backlog_.wait_handled(policy_.flush_timeout);
+    }
+
+private:
+    void run()
+    {
+        detail::net_batch batch;
+        std::size_t next = 0;
+        auto delay = policy_.min_backoff;
+        for (;;)
+        {
+            if (next == batch.size())
+            {
+                next = 0;
+                if (!backlog_.take(batch, std::chrono::milliseconds(100)))
+                {
+                    if (backlog_.stopped())
+                    {
+                        return ;
+                    }
+                    continue;
+                }
+            }
+
+            std::size_t failed = 0;
+            auto const n = transport_.send(batch, next, failed);
+            backlog_.handled(n, failed);
+            next += n;
+            if (n != 0)
+            {
+                delay = policy_.min_backoff;
+                continue;
+            }
+
+            if (backlog_.stopped())
+            {
+                // Give up the rest, nothing stops the thread otherwise.
+                auto const left = batch.size() - next;
+                backlog_.handled(left, left);
+                transport_.reset();
+                next = batch.size();
+                continue;
+            }
+            backlog_.sleep(delay);
+            delay = (std::min)(delay * 2, policy_.max_backoff);
+        }
+    }
+
+private:
+    net_policy policy_;
+    detail::net_backlog backlog_;
+    transportT transport_;
+    std::thread sender_;
+};
+
+// RFC 5424 syslog over UDP by default, one message per datagram.
+template <class layoutT = syslog_layout
+          , class mutexT = mutex_t
+          , class formatterT = formatter<char, layoutT>>
+using basic_udp_sink = basic_net_sink<detail::udp_transport, layoutT
+                                      , mutexT, formatterT>;
+
+// Length-prefixed messages over TCP, RFC 6587 syslog by default.
+template <class layoutT = syslog_layout
+          , class mutexT = mutex_t
+          , class formatterT = formatter<char, layoutT>>
+using basic_tcp_sink = basic_net_sink<detail::tcp_transport, layoutT
+                                      , mutexT, formatterT>;
+
+using udp_sink = basic_udp_sink<>;
+using tcp_sink = basic_tcp_sink<>;
+
+}  // namespace sink
+
+}  // namespace tinylog
+
+#endif  // TINYTINYLOG_NET_HPP
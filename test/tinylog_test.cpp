@@ -0,0 +1,307 @@
+// Tests of tinylog, one case per run.
+//
+// Usage: tinylog_test <case> [tinylog_decode]
+//
+// Cases: routing, escaping, binary, async, backtrace. binary runs the
+// decode tool on the file it wrote if its path is given. Exits non-zero
+// if a check failed.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tinylog/tinylog.hpp"
+#include "tinylog/tinylog_net.hpp"
+
+namespace
+{
+
+int failures = 0;
+
+#define TINYLOG_CHECK(cond) \
+    check((cond), #cond, __FILE__, __LINE__)
+
+void check(bool ok, char const* what, char const* file, int line)
+{
+    if (!ok)
+    {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        ++failures;
+    }
+}
+
+bool contains(std::string const& s, char const* part)
+{
+    return s.find(part) != std::string::npos;
+}
+
+// Keep the messages written, formatted by layoutT.
+template <class layoutT = tinylog::default_layout>
+class memory_sink : public tinylog::sink::basic_sink<char, layoutT>
+{
+public:
+    using string_t = std::string;
+
+    bool is_open() const override final
+    {
+        return true;
+    }
+
+    std::vector<std::string> messages;
+
+protected:
+    void writing(tinylog::level, string_t& msg) override final
+    {
+        messages.push_back(msg);
+    }
+};
+
+//----------------|
+// Routing        |
+//----------------|
+
+void test_routing()
+{
+    using namespace tinylog;
+
+    auto a = registry::create_logger("route.a");
+    auto b = registry::create_logger("route.b");
+    auto sa = a->create_sink<memory_sink<>>();
+    auto sb = b->create_sink<memory_sink<>>();
+
+    // One call site, the name changes in place between statements.
+    char name[16];
+    for (auto const n : { "route.a", "route.b" })
+    {
+        std::strcpy(name, n);
+        dlout(name, info) << "array";
+    }
+    TINYLOG_CHECK(sa->messages.size() == 1);
+    TINYLOG_CHECK(sb->messages.size() == 1);
+
+    for (auto const n : { "route.a", "route.b", "route.a" })
+    {
+        std::string const s(n);
+        dlout(s, info) << "string";
+    }
+    TINYLOG_CHECK(sa->messages.size() == 3);
+    TINYLOG_CHECK(sb->messages.size() == 2);
+
+    // Levels changed after a call site cached its logger.
+    for (int i = 0; i != 2; ++i)
+    {
+        a->set_level(i == 0 ? warn : trace);
+        dlout(TINYLOG_LITERAL("route.a"), info) << "level " << i;
+    }
+    TINYLOG_CHECK(sa->messages.size() == 4);
+    TINYLOG_CHECK(contains(sa->messages.back(), "level 1"));
+
+    // An unknown name logs nowhere.
+    dlout("route.none", fatal) << "lost";
+    TINYLOG_CHECK(sa->messages.size() == 4);
+    TINYLOG_CHECK(sb->messages.size() == 2);
+}
+
+//----------------|
+// Escaping       |
+//----------------|
+
+void test_escaping()
+{
+    using namespace tinylog;
+
+    auto inst = registry::create_logger("escape");
+    auto json = inst->create_sink<memory_sink<json_layout>>();
+    auto logfmt = inst->create_sink<memory_sink<logfmt_layout>>();
+    auto syslog = inst->create_sink<memory_sink<syslog_layout>>();
+
+    dlout("escape", info).kv("a b", 1).kv("q\"=]", "x \"y\"")
+                         .kv("nan", std::nan("")).kv("", -1.0 / 0.0)
+        << "line\n\"quoted\"";
+
+    TINYLOG_CHECK(json->messages.size() == 1);
+    TINYLOG_CHECK(logfmt->messages.size() == 1);
+    TINYLOG_CHECK(syslog->messages.size() == 1);
+    if (failures)
+    {
+        return ;
+    }
+
+    auto const& j = json->messages[0];
+    TINYLOG_CHECK(contains(j, "\"msg\":\"line\\n\\\"quoted\\\"\""));
+    TINYLOG_CHECK(contains(j, "\"a b\":1"));
+    TINYLOG_CHECK(contains(j, "\"q\\\"=]\":\"x \\\"y\\\"\""));
+    TINYLOG_CHECK(contains(j, "\"nan\":\"NaN\""));
+    TINYLOG_CHECK(contains(j, "\"\":\"-Infinity\""));
+
+    auto const& l = logfmt->messages[0];
+    TINYLOG_CHECK(contains(l, " a_b=1"));
+    TINYLOG_CHECK(contains(l, " q__]=\"x \\\"y\\\"\""));
+    TINYLOG_CHECK(contains(l, " _=-inf"));
+
+    auto const& s = syslog->messages[0];
+    TINYLOG_CHECK(contains(s, "[fields@32473 a_b=\"1\" q___=\"x \\\"y\\\"\""));
+    TINYLOG_CHECK(contains(s, " _=\"-inf\"]"));
+}
+
+//----------------|
+// Binary         |
+//----------------|
+
+char const binary_file[] = "tinylog_test_binary.tlog";
+
+void test_binary(char const* decoder)
+{
+    using namespace tinylog;
+
+    std::remove(binary_file);
+    {
+        auto inst = registry::create_logger("binary");
+        inst->create_sink<sink::binary_file_sink>(binary_file);
+        dlfmt("binary", info, "user {} took {:.1f} ms", 42, 1.5);
+        dlout("binary", warn).kv("user", 42).kv("name", "a b") << "login";
+        dlfmt("binary", error, "{} {}", 'c', std::string("str"));
+        inst->flush();
+    }
+
+    std::vector<std::string> expected =
+    {
+        "[INFO] #", "user 42 took 1.5 ms",
+        "[WARN] #", "login user=42 name=\"a b\"",
+        "[ERROR] #", "c str",
+    };
+
+    std::ifstream is(binary_file, std::ios_base::in | std::ios_base::binary);
+    binary_log_reader reader(is);
+    formatter<char, default_layout> fmt;
+    record_d r;
+    bool verbose = false;
+    std::string text;
+    std::string decoded;
+    while (reader.next(r, verbose))
+    {
+        text.clear();
+        fmt.format(r, verbose, text);
+        decoded += text;
+    }
+    TINYLOG_CHECK(!reader.corrupted());
+    for (auto const& e : expected)
+    {
+        TINYLOG_CHECK(contains(decoded, e.c_str()));
+    }
+
+    if (!decoder)
+    {
+        return ;
+    }
+
+    // The tool prints the same text.
+    std::string const out = std::string(binary_file) + ".txt";
+    std::string const cmd = std::string("\"") + decoder + "\" "
+                            + binary_file + " > " + out;
+    TINYLOG_CHECK(std::system(cmd.c_str()) == 0);
+
+    std::ifstream txt(out.c_str());
+    std::stringstream ss;
+    ss << txt.rdbuf();
+    TINYLOG_CHECK(ss.str() == decoded);
+}
+
+//----------------|
+// Async          |
+//----------------|
+
+void test_async()
+{
+    using namespace tinylog;
+
+    auto inst = registry::create_logger("async");
+    auto sk = inst->create_sink<memory_sink<>>();
+    inst->enable_async();
+
+    for (int i = 0; i != 1000; ++i)
+    {
+        dlout("async", info) << "record " << i;
+    }
+    inst->flush();
+    TINYLOG_CHECK(sk->messages.size() + inst->dropped() == 1000);
+    TINYLOG_CHECK(inst->failed() == 0);
+    TINYLOG_CHECK(contains(sk->messages.back(), "record 999"));
+}
+
+//----------------|
+// Backtrace      |
+//----------------|
+
+void test_backtrace()
+{
+    using namespace tinylog;
+
+    auto inst = registry::create_logger("backtrace");
+    auto sk = inst->create_sink<memory_sink<>>();
+    inst->set_level(info);
+    inst->enable_backtrace(4, debug);
+
+    for (int i = 0; i != 6; ++i)
+    {
+        dlout("backtrace", debug) << "debug " << i;
+        dlout("backtrace", trace) << "trace " << i;
+    }
+    TINYLOG_CHECK(sk->messages.empty());
+
+    dlout("backtrace", error) << "boom";
+    TINYLOG_CHECK(sk->messages.size() == 5);
+    if (sk->messages.size() == 5)
+    {
+        TINYLOG_CHECK(contains(sk->messages[0], "debug 2"));
+        TINYLOG_CHECK(contains(sk->messages[4], "boom"));
+    }
+
+    inst->disable_backtrace();
+    dlout("backtrace", debug) << "filtered";
+    TINYLOG_CHECK(sk->messages.size() == 5);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::fputs("Usage: tinylog_test <case> [tinylog_decode]\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    std::string const name(argv[1]);
+    if (name == "routing")
+    {
+        test_routing();
+    }
+    else if (name == "escaping")
+    {
+        test_escaping();
+    }
+    else if (name == "binary")
+    {
+        test_binary(argc > 2 ? argv[2] : nullptr);
+    }
+    else if (name == "async")
+    {
+        test_async();
+    }
+    else if (name == "backtrace")
+    {
+        test_backtrace();
+    }
+    else
+    {
+        std::fprintf(stderr, "unknown case %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
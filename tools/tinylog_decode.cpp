@@ -0,0 +1,228 @@
+// Decode binary logs of binary_file_sink to text.
+//
+// Usage: tinylog_decode [options] <file>...
+//
+// Options:
+//   -l, --level <level>   minimum level: trace, debug, info, warn, error,
+//                         fatal
+//   -t, --thread <id>     records of thread id only, may repeat
+//   -f, --from <time>     records at or after time
+//   -u, --until <time>    records before time
+//
+// Time is "YYYY-MM-DD HH:MM:SS" in local time or seconds since epoch.
+// Records are printed as default_layout, kv fields as logfmt after the
+// message, one file after another.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "tinylog/tinylog.hpp"
+
+namespace
+{
+
+struct options
+{
+    tinylog::level lvl = tinylog::level::trace;
+    std::vector<std::uintmax_t> threads;
+    std::int64_t from  = std::numeric_limits<std::int64_t>::min();
+    std::int64_t until = std::numeric_limits<std::int64_t>::max();
+    std::vector<char const*> files;
+};
+
+void usage()
+{
+    std::fputs("Usage: tinylog_decode [options] <file>...\n"
+               "  -l, --level <level>  minimum level: trace, debug, info"
+               ", warn, error, fatal\n"
+               "  -t, --thread <id>    records of thread id only"
+               ", may repeat\n"
+               "  -f, --from <time>    records at or after time\n"
+               "  -u, --until <time>   records before time\n"
+               "time: \"YYYY-MM-DD HH:MM:SS\" (local) or seconds"
+               " since epoch\n"
+               , stderr);
+}
+
+bool parse_level(char const* s, tinylog::level& lvl)
+{
+    static char const* const names[] =
+    {
+        "trace", "debug", "info", "warn", "error", "fatal"
+    };
+
+    std::string name(s);
+    for (auto& c : name)
+    {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+
+    for (std::size_t i = 0; i != sizeof(names) / sizeof(names[0]); ++i)
+    {
+        if (name == names[i])
+        {
+            lvl = static_cast<tinylog::level>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Time in seconds since epoch.
+bool parse_time(char const* s, std::int64_t& t)
+{
+    std::tm tm = {};
+    if (std::sscanf(s, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon
+                    , &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) >= 3)
+    {
+        tm.tm_year -= 1900;
+        tm.tm_mon  -= 1;
+        tm.tm_isdst = -1;
+        auto const sec = std::mktime(&tm);
+        if (sec == static_cast<std::time_t>(-1))
+        {
+            return false;
+        }
+        t = static_cast<std::int64_t>(sec);
+        return true;
+    }
+
+    char* end = nullptr;
+    t = static_cast<std::int64_t>(std::strtoll(s, &end, 10));
+    return end != s && *end == '\0';
+}
+
+bool parse_options(int argc, char* argv[], options& opts)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        auto const arg = argv[i];
+        auto is = [arg](char const* shrt, char const* lng)
+        {
+            return std::strcmp(arg, shrt) == 0 || std::strcmp(arg, lng) == 0;
+        };
+
+        if (is("-h", "--help"))
+        {
+            return false;
+        }
+        if (arg[0] != '-')
+        {
+            opts.files.push_back(arg);
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            std::fprintf(stderr, "missing value of %s\n", arg);
+            return false;
+        }
+
+        auto const value = argv[++i];
+        bool ok = true;
+        if (is("-l", "--level"))
+        {
+            ok = parse_level(value, opts.lvl);
+        }
+        else if (is("-t", "--thread"))
+        {
+            char* end = nullptr;
+            opts.threads.push_back(std::strtoull(value, &end, 10));
+            ok = end != value && *end == '\0';
+        }
+        else if (is("-f", "--from"))
+        {
+            ok = parse_time(value, opts.from);
+        }
+        else if (is("-u", "--until"))
+        {
+            ok = parse_time(value, opts.until);
+        }
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+
+        if (!ok)
+        {
+            std::fprintf(stderr, "bad value of %s: %s\n", arg, value);
+            return false;
+        }
+    }
+    return !opts.files.empty();
+}
+
+bool accept(options const& opts, tinylog::record_d const& r)
+{
+    if (r.lvl < opts.lvl)
+    {
+        return false;
+    }
+    if (!opts.threads.empty()
+        && std::find(opts.threads.begin(), opts.threads.end(), r.id)
+           == opts.threads.end())
+    {
+        return false;
+    }
+    auto const sec = static_cast<std::int64_t>(r.tv.tv_sec);
+    return opts.from <= sec && sec < opts.until;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    options opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    int rc = EXIT_SUCCESS;
+    tinylog::formatter<char, tinylog::default_layout> fmt;
+    tinylog::record_d r;
+    std::string text;
+
+    for (auto const file : opts.files)
+    {
+        std::ifstream is(file, std::ios_base::in | std::ios_base::binary);
+        if (!is)
+        {
+            std::fprintf(stderr, "can't open %s\n", file);
+            rc = EXIT_FAILURE;
+            continue;
+        }
+
+        tinylog::binary_log_reader reader(is);
+        bool verbose = false;
+        while (reader.next(r, verbose))
+        {
+            if (!accept(opts, r))
+            {
+                continue;
+            }
+            text.clear();
+            fmt.format(r, verbose, text);
+            std::fwrite(text.data(), 1, text.size(), stdout);
+        }
+
+        if (reader.corrupted())
+        {
+            is.clear();
+            std::fprintf(stderr, "%s: corrupted data at offset %lld\n"
+                         , file, static_cast<long long>(is.tellg()));
+            rc = EXIT_FAILURE;
+        }
+    }
+    return rc;
+}